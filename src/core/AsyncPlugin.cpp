@@ -0,0 +1,177 @@
+/**
+ * @file AsyncPlugin.cpp
+ * @brief Implementation of the AsyncPlugin class for Coda.
+ * @author Dario Romandini
+ */
+
+#include "AsyncPlugin.h"
+#include "ScriptBuffer.h"
+#include "ScriptCache.h"
+#include <QMetaObject>
+#include <iostream>
+
+AsyncPlugin::AsyncPlugin(const std::string &path, const ScriptBudget &budget, QObject *parent)
+    : QObject(parent), scriptPath(path) {
+    profiler.setBudget(path, budget);
+    worker = std::thread(&AsyncPlugin::run, this);
+}
+
+AsyncPlugin::~AsyncPlugin() {
+    {
+        QMutexLocker locker(&mutex);
+        stopping = true;
+    }
+    wake.wakeAll();
+    worker.join();
+}
+
+void AsyncPlugin::post(const std::string &eventName, const std::string &filePath, const PieceTable &text,
+                       quint64 revision) {
+    QMutexLocker locker(&mutex);
+    events.enqueue(Event{eventName, filePath, text, revision});
+    wake.wakeOne();
+}
+
+const std::string &AsyncPlugin::path() const {
+    return scriptPath;
+}
+
+QVector<ScriptStats> AsyncPlugin::stats() const {
+    return profiler.stats();
+}
+
+QVector<MemoryUsage> AsyncPlugin::memory() const {
+    QVector<MemoryUsage> usage = profiler.memory();
+    // The whole state belongs to the plugin: drop the empty entry of memory charged to nobody.
+    usage.removeFirst();
+    return usage;
+}
+
+void AsyncPlugin::run() {
+    // Everything in this state, including the libraries, is charged to the plugin.
+    profiler.allocator().setOwner(profiler.allocator().owner(scriptPath));
+    sol::state lua(sol::default_at_panic, &LuaAllocator::allocate, &profiler.allocator());
+    lua.open_libraries(sol::lib::base, sol::lib::package, sol::lib::string);
+    profiler.attach(lua.lua_state(), &stopping);
+    EventHandlers handlers;
+    registerAsyncAPI(lua, handlers);
+
+    profiler.begin(scriptPath, "load");
+    try {
+        sol::protected_function_result result = ScriptCache::load(lua, scriptPath)();
+        if (!result.valid()) {
+            throw sol::error(profiler.errorMessage(result));
+        }
+    } catch (const sol::error &e) {
+        profiler.end();
+        std::cerr << "Lua error: " << e.what() << std::endl;
+        return;
+    }
+    profiler.end();
+
+    while (true) {
+        Event event;
+        {
+            QMutexLocker locker(&mutex);
+            while (events.isEmpty() && !stopping) {
+                wake.wait(&mutex);
+            }
+            if (stopping) {
+                return;
+            }
+            event = events.dequeue();
+        }
+
+        std::vector<sol::protected_function> called;
+        sol::object global = lua[event.name];
+        if (global.get_type() == sol::type::function) {
+            called.push_back(global.as<sol::protected_function>());
+        }
+        auto subscribed = handlers.find(event.name);
+        if (subscribed != handlers.end()) {
+            for (const EventHandler &handler : subscribed->second) {
+                called.push_back(handler.function);
+            }
+        }
+        if (called.empty()) {
+            continue;
+        }
+
+        snapshot = event.text;
+        proposals.clear();
+        for (const sol::protected_function &handler : called) {
+            profiler.begin(scriptPath, event.name);
+            sol::protected_function_result result = handler(event.filePath);
+            profiler.end();
+            if (!result.valid()) {
+                std::cerr << "Lua error in " << event.name << " (" << scriptPath << "): "
+                          << profiler.errorMessage(result) << std::endl;
+            }
+        }
+        snapshot = PieceTable();
+
+        if (!proposals.isEmpty()) {
+            QMetaObject::invokeMethod(this, [this, revision = event.revision, edits = proposals]() {
+                emit editsProposed(revision, edits);
+            }, Qt::QueuedConnection);
+        }
+    }
+}
+
+void AsyncPlugin::registerAsyncAPI(sol::state &lua, EventHandlers &handlers) {
+    ScriptingEngine::registerBufferType(lua);
+
+    lua["Coda"] = lua.create_table();
+
+    lua["Coda"]["showMessage"] = [](const std::string &msg) {
+        std::cout << "[Coda] " << msg << std::endl;
+    };
+
+    ScriptingEngine::registerEventBus(lua, handlers, scriptPath);
+    ScriptingEngine::registerProfileQuery(lua, [this]() { return stats(); }, [this]() { return memory(); });
+
+    // Reads see the snapshot taken when the event fired; edits are applied in order once the handler returns.
+    lua["editor"] = lua.create_table();
+
+    lua["editor"]["getText"] = [this]() {
+        return snapshot.toStdString();
+    };
+
+    lua["editor"]["getBuffer"] = [this]() {
+        return ScriptBuffer(snapshot);
+    };
+
+    lua["editor"]["setText"] = [this](const std::string &text) {
+        EditProposal edit;
+        edit.wholeText = true;
+        edit.text = text;
+        proposals.append(edit);
+    };
+
+    lua["editor"]["insertTextAt"] = [this](int line, int column, const std::string &text) {
+        EditProposal edit;
+        edit.firstLine = edit.lastLine = line;
+        edit.firstColumn = edit.lastColumn = column;
+        edit.text = text;
+        proposals.append(edit);
+    };
+
+    lua["editor"]["replaceRange"] = [this](int firstLine, int firstColumn, int lastLine, int lastColumn,
+                                           const std::string &text) {
+        EditProposal edit;
+        edit.firstLine = firstLine;
+        edit.firstColumn = firstColumn;
+        edit.lastLine = lastLine;
+        edit.lastColumn = lastColumn;
+        edit.text = text;
+        proposals.append(edit);
+    };
+
+    // Edits are already grouped into one transaction.
+    lua["editor"]["batch"] = [this](sol::protected_function edits) {
+        sol::protected_function_result result = edits();
+        if (!result.valid()) {
+            throw sol::error(profiler.errorMessage(result));
+        }
+    };
+}
@@ -0,0 +1,131 @@
+/**
+ * @file AsyncPlugin.h
+ * @brief Lua plugin running on its own worker thread in Coda.
+ *        Event handlers of plugins declared with "mode": "async" in plugins.json run in a private Lua state
+ *        against an immutable snapshot of the document. Edits they make are recorded as proposals and
+ *        sent back to the UI thread, which applies them only if the document has not changed meanwhile.
+ * @author Dario Romandini
+ */
+
+#pragma once
+
+#include <QMutex>
+#include <QObject>
+#include <QQueue>
+#include <QVector>
+#include <QWaitCondition>
+#include <atomic>
+#include <string>
+#include <thread>
+
+#include "PieceTable.h"
+#include "ScriptingEngine.h"
+
+/**
+ * @struct EditProposal
+ * @brief An edit requested by an async plugin: replace a range, or the whole text, with new text.
+ *        Positions are 1-based (line, column) pairs, as in the synchronous editor API.
+ */
+struct EditProposal {
+    bool wholeText = false; ///< True to replace the whole text; the positions are ignored.
+    int firstLine = 1;      ///< Line of the start of the range.
+    int firstColumn = 1;    ///< Column of the start of the range.
+    int lastLine = 1;       ///< Line of the end of the range.
+    int lastColumn = 1;     ///< Column of the end of the range, which is not included.
+    std::string text;       ///< Replacement text, UTF-8.
+};
+
+/**
+ * @class AsyncPlugin
+ * @brief Owns one worker thread and one Lua state for one plugin script.
+ *        Events are queued and handled in order. A handler that is still running when the plugin is
+ *        destroyed, or that exceeds its budget, is stopped with a Lua error.
+ */
+class AsyncPlugin : public QObject {
+    Q_OBJECT
+
+public:
+    /**
+     * @brief Constructor. Starts the worker thread, which loads the script.
+     * @param path Path of the Lua script.
+     * @param budget Time and instruction budget of each handler call.
+     * @param parent Optional parent object.
+     */
+    AsyncPlugin(const std::string &path, const ScriptBudget &budget, QObject *parent = nullptr);
+
+    /**
+     * @brief Destructor. Stops the running handler and waits for the worker thread.
+     */
+    ~AsyncPlugin() override;
+
+    /**
+     * @brief Queues an event for the plugin's handler of that name, if it defines one.
+     * @param eventName Name of the handler, e.g. "onFileSave".
+     * @param filePath File path passed to the handler.
+     * @param text Snapshot of the document the handler reads.
+     * @param revision Revision of the snapshot; returned with the proposals.
+     */
+    void post(const std::string &eventName, const std::string &filePath, const PieceTable &text, quint64 revision);
+
+    /**
+     * @brief Returns the path of the plugin script.
+     * @return The script path.
+     */
+    const std::string &path() const;
+
+    /**
+     * @brief Returns the profiling counters of the plugin.
+     * @return The counters per event.
+     */
+    QVector<ScriptStats> stats() const;
+
+    /**
+     * @brief Returns the memory held by the plugin's Lua state.
+     * @return One entry for the plugin.
+     */
+    QVector<MemoryUsage> memory() const;
+
+signals:
+    /**
+     * @brief Emitted on the UI thread after a handler that made edits has finished.
+     * @param revision Revision of the snapshot the handler read.
+     * @param edits The edits, in the order the handler made them.
+     */
+    void editsProposed(quint64 revision, const QVector<EditProposal> &edits);
+
+private:
+    /**
+     * @struct Event
+     * @brief A queued event.
+     */
+    struct Event {
+        std::string name;     ///< Handler name.
+        std::string filePath; ///< Argument of the handler.
+        PieceTable text;      ///< Document snapshot.
+        quint64 revision;     ///< Revision of the snapshot.
+    };
+
+    /**
+     * @brief Worker thread body: loads the script, then handles queued events.
+     */
+    void run();
+
+    /**
+     * @brief Registers the snapshot-backed editor API in the worker's Lua state.
+     * @param lua The worker's Lua state.
+     * @param handlers Map receiving the functions subscribed with Coda.on().
+     */
+    void registerAsyncAPI(sol::state &lua, EventHandlers &handlers);
+
+    std::string scriptPath;             ///< Path of the Lua script.
+    QMutex mutex;                       ///< Guards events.
+    QWaitCondition wake;                ///< Signals a new event or shutdown.
+    QQueue<Event> events;               ///< Events waiting to be handled.
+    std::atomic_bool stopping{false};   ///< Set to stop the worker and the running handler.
+    ScriptProfiler profiler;            ///< Counters and budget of the worker's Lua state.
+    std::thread worker;                 ///< The worker thread.
+
+    // Worker-only state.
+    PieceTable snapshot;                ///< Text of the event being handled.
+    QVector<EditProposal> proposals;    ///< Edits made by the running handler.
+};
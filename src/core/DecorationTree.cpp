@@ -0,0 +1,45 @@
+/**
+ * @file DecorationTree.cpp
+ * @brief Implementation of the DecorationTree class for Coda.
+ * @author Dario Romandini
+ */
+
+#include "DecorationTree.h"
+
+void DecorationTree::insert(const Decoration &decoration) {
+    tree.insert(decoration);
+}
+
+void DecorationTree::applyEdit(int position, int removed, int added) {
+    // Decorations starting after the removed text only move. Those starting inside it, and those starting
+    // before the edit but reaching into it, change shape: take them out, map their ends and put them back.
+    std::vector<Decoration> changed = tree.extractForEdit(position, position + removed, position, added - removed);
+    for (Decoration decoration : changed) {
+        bool empty = decoration.start == decoration.end;
+        if (decoration.start >= position) {
+            decoration.start = position + added;
+        }
+        if (empty) {
+            decoration.end = decoration.start;
+        } else if (decoration.end >= position + removed) {
+            decoration.end += added - removed;
+        } else {
+            decoration.end = position;
+        }
+        if (empty || decoration.end > decoration.start) {
+            tree.insert(decoration);
+        }
+    }
+}
+
+int DecorationTree::removeIf(const std::function<bool(const Decoration &)> &predicate) {
+    return tree.removeIf(predicate);
+}
+
+void DecorationTree::clear() {
+    tree.clear();
+}
+
+int DecorationTree::size() const {
+    return tree.size();
+}
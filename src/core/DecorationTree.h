@@ -0,0 +1,86 @@
+/**
+ * @file DecorationTree.h
+ * @brief Interval tree of text decorations for the Coda text editor.
+ *        An IntervalTreap ordered by start position. Edits move every decoration after them with one lazy
+ *        offset, so an edit costs O(log n) plus the decorations it overlaps, and a viewport query costs
+ *        O(log n) plus the decorations it returns.
+ * @author Dario Romandini
+ */
+
+#pragma once
+
+#include "IntervalTreap.h"
+#include <QtGlobal>
+#include <functional>
+
+/**
+ * @struct Decoration
+ * @brief A decorated range of the document.
+ */
+struct Decoration {
+    int start;     ///< Document position of the first decorated character.
+    int end;       ///< Document position after the last decorated character.
+    quint32 id;    ///< Identifier, unique within the tree's owner.
+    quint32 group; ///< Group the decoration belongs to.
+    quint32 style; ///< Index of the decoration's style.
+};
+
+/**
+ * @class DecorationTree
+ * @brief Stores decorations and keeps their positions in step with document edits.
+ */
+class DecorationTree {
+public:
+    /**
+     * @brief Adds a decoration.
+     * @param decoration The decoration; end must not be before start.
+     */
+    void insert(const Decoration &decoration);
+
+    /**
+     * @brief Moves the decorations after an edit.
+     *        Text inserted at the start of a decoration goes before it, text inserted at its end after it.
+     *        A decoration whose whole text is removed is removed too.
+     * @param position Position of the edit.
+     * @param removed Number of characters removed at position.
+     * @param added Number of characters inserted at position.
+     */
+    void applyEdit(int position, int removed, int added);
+
+    /**
+     * @brief Calls a function for every decoration overlapping a range, in order of their start.
+     *        Empty decorations are reported if they lie inside the range.
+     * @param from First position of the range.
+     * @param to Position after the range.
+     * @param visitor Called with each decoration.
+     */
+    template <typename Visitor>
+    void visit(int from, int to, Visitor &&visitor) const {
+        tree.visit(from, to, [&](const Decoration &decoration) {
+            if (decoration.end > from || (decoration.start == decoration.end && decoration.start >= from)) {
+                visitor(decoration);
+            }
+        });
+    }
+
+    /**
+     * @brief Removes the decorations matching a predicate and rebalances the tree.
+     * @param predicate Returns true for the decorations to remove.
+     * @return Number of decorations removed.
+     */
+    int removeIf(const std::function<bool(const Decoration &)> &predicate);
+
+    /**
+     * @brief Removes all decorations.
+     */
+    void clear();
+
+    /**
+     * @brief Returns the number of decorations.
+     * @return The decoration count.
+     */
+    int size() const;
+
+private:
+    IntervalTreap<Decoration> tree; ///< Decorations by start position.
+};
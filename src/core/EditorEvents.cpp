@@ -0,0 +1,107 @@
+/**
+ * @file EditorEvents.cpp
+ * @brief Implementation of the EditorEvents class for Coda.
+ * @author Dario Romandini
+ */
+
+#include "EditorEvents.h"
+#include "EditorWidget.h"
+
+EditorEvents::EditorEvents(EditorWidget *editor, QObject *parent) : QObject(parent), editor(editor) {
+    for (int event = 0; event < EventCount; ++event) {
+        timers[event].setSingleShot(true);
+        connect(&timers[event], &QTimer::timeout, this, [this, event]() { fire(static_cast<Event>(event)); });
+    }
+
+    connect(editor->document(), &QTextDocument::contentsChange, this, &EditorEvents::onContentsChange);
+    connect(editor, &QPlainTextEdit::cursorPositionChanged, this, &EditorEvents::onCursorPositionChanged);
+}
+
+EditorEvents::Event EditorEvents::eventForName(const std::string &name) {
+    if (name == "onTextChanged") {
+        return TextChanged;
+    }
+    if (name == "onCursorMoved") {
+        return CursorMoved;
+    }
+    if (name == "onIdle") {
+        return Idle;
+    }
+    return EventCount;
+}
+
+void EditorEvents::setDelay(Event event, int milliseconds) {
+    delays[event] = qMax(0, milliseconds);
+}
+
+void EditorEvents::onContentsChange(int position, int charsRemoved, int charsAdded) {
+    // A progressive load is reported through onFileOpen instead.
+    if (editor->isLoading()) {
+        return;
+    }
+
+    int length = editor->document()->characterCount() - 1;
+    if (changes.isEmpty()) {
+        lengthBefore = length - charsAdded + charsRemoved;
+    }
+
+    TextChange *last = changes.isEmpty() ? nullptr : &changes.last();
+    if (last && charsRemoved == 0 && last->position + last->added == position) {
+        last->added += charsAdded;
+    } else if (changes.size() < MaxPendingChanges) {
+        QTextBlock block = editor->document()->findBlock(position);
+        changes.append(TextChange{position, block.blockNumber(), position - block.position(), charsRemoved,
+                                  charsAdded});
+    } else {
+        // Too many scattered changes: report them as one replacement of the whole text.
+        changes = {TextChange{0, 0, 0, lengthBefore, length}};
+    }
+
+    schedule(TextChanged);
+    schedule(Idle);
+}
+
+void EditorEvents::onCursorPositionChanged() {
+    if (editor->isLoading()) {
+        return;
+    }
+    schedule(CursorMoved);
+    schedule(Idle);
+}
+
+void EditorEvents::schedule(Event event) {
+    if (!timers[event].isActive()) {
+        pendingSince[event].start();
+    }
+    // Idle waits for real quiet; the other events are reported at least every MaxWaitFactor delays.
+    qint64 remaining = event == Idle ? delays[event]
+                                     : qint64(delays[event]) * MaxWaitFactor - pendingSince[event].elapsed();
+    timers[event].start(static_cast<int>(qBound<qint64>(0, remaining, delays[event])));
+}
+
+void EditorEvents::fire(Event event) {
+    switch (event) {
+    case TextChanged: {
+        QVector<TextChange> pending;
+        pending.swap(changes);
+        if (!pending.isEmpty()) {
+            emit textChanged(pending);
+        }
+        break;
+    }
+    case CursorMoved: {
+        QTextCursor cursor = editor->textCursor();
+        if (cursor.blockNumber() != lastLine || cursor.positionInBlock() != lastColumn) {
+            lastLine = cursor.blockNumber();
+            lastColumn = cursor.positionInBlock();
+            emit cursorMoved(lastLine, lastColumn);
+        }
+        break;
+    }
+    case Idle:
+        emit idle();
+        break;
+    case EventCount:
+        break;
+    }
+}
@@ -0,0 +1,129 @@
+/**
+ * @file EditorEvents.h
+ * @brief High-frequency editor events for Lua plugins in Coda.
+ *        Collects text changes and cursor moves as they happen and reports them in coalesced, debounced
+ *        batches, so that plugins listening to keystroke-rate events run a few times per second at most.
+ * @author Dario Romandini
+ */
+
+#pragma once
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QTimer>
+#include <QVector>
+#include <string>
+
+class EditorWidget;
+
+/**
+ * @struct TextChange
+ * @brief One change of the text. Positions refer to the text as it was just before the change.
+ */
+struct TextChange {
+    int position; ///< 0-based character position of the change.
+    int line;     ///< 0-based line of the change.
+    int column;   ///< 0-based column of the change.
+    int removed;  ///< Number of characters removed.
+    int added;    ///< Number of characters inserted.
+};
+
+/**
+ * @class EditorEvents
+ * @brief Turns document and cursor notifications into the onTextChanged, onCursorMoved and onIdle events.
+ *        Each event is debounced: it is reported once no new notification arrived for its delay, and at
+ *        most MaxWaitFactor delays after the first pending notification, so continuous typing cannot
+ *        starve it.
+ */
+class EditorEvents : public QObject {
+    Q_OBJECT
+
+public:
+    /// Events reported by this class.
+    enum Event {
+        TextChanged, ///< The text changed.
+        CursorMoved, ///< The cursor moved.
+        Idle,        ///< No edits or cursor moves for a while.
+        EventCount
+    };
+
+    /**
+     * @brief Constructor.
+     * @param editor Editor to watch.
+     * @param parent Optional parent object.
+     */
+    explicit EditorEvents(EditorWidget *editor, QObject *parent = nullptr);
+
+    /**
+     * @brief Returns the event with a given plugin name.
+     * @param name "onTextChanged", "onCursorMoved" or "onIdle".
+     * @return The event, or EventCount if the name is unknown.
+     */
+    static Event eventForName(const std::string &name);
+
+    /**
+     * @brief Sets the delay of an event.
+     * @param event The event.
+     * @param milliseconds Quiet time before the event is reported; 0 reports it on the next event loop pass.
+     */
+    void setDelay(Event event, int milliseconds);
+
+signals:
+    /**
+     * @brief Reports the text changes made since the previous report, in the order they were made.
+     *        Consecutive changes are merged when the second one extends the first, as when typing.
+     * @param changes The changes.
+     */
+    void textChanged(const QVector<TextChange> &changes);
+
+    /**
+     * @brief Reports the cursor position after it moved.
+     * @param line 0-based line of the cursor.
+     * @param column 0-based column of the cursor.
+     */
+    void cursorMoved(int line, int column);
+
+    /**
+     * @brief Reports that the editor has been idle for the idle delay since the last edit or cursor move.
+     */
+    void idle();
+
+private slots:
+    /**
+     * @brief Records a document change.
+     * @param position Position of the change.
+     * @param charsRemoved Number of characters removed.
+     * @param charsAdded Number of characters added.
+     */
+    void onContentsChange(int position, int charsRemoved, int charsAdded);
+
+    /**
+     * @brief Records a cursor move.
+     */
+    void onCursorPositionChanged();
+
+private:
+    static constexpr int MaxWaitFactor = 4;        ///< Longest wait, in delays, before a pending event fires.
+    static constexpr int MaxPendingChanges = 1024; ///< Changes kept before they collapse into one.
+
+    /**
+     * @brief Schedules an event after a notification.
+     * @param event The event.
+     */
+    void schedule(Event event);
+
+    /**
+     * @brief Reports a pending event.
+     * @param event The event.
+     */
+    void fire(Event event);
+
+    EditorWidget *editor;                  ///< The watched editor.
+    QTimer timers[EventCount];             ///< Debounce timer per event.
+    QElapsedTimer pendingSince[EventCount]; ///< Time of the first pending notification per event.
+    int delays[EventCount] = {50, 50, 1000}; ///< Debounce delay per event, in milliseconds.
+    QVector<TextChange> changes;           ///< Changes not reported yet.
+    int lengthBefore = 0;                  ///< Text length before the first pending change.
+    int lastLine = -1;                     ///< Cursor line of the last cursorMoved report.
+    int lastColumn = -1;                   ///< Cursor column of the last cursorMoved report.
+};
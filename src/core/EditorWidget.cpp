@@ -8,45 +8,75 @@
  */
 
 #include "EditorWidget.h"
+#include "LongLineLayout.h"
+#include <QKeyEvent>
+#include <QMouseEvent>
+#include <QPaintEvent>
 #include <QPainter>
+#include <QScrollBar>
+#include <QSet>
 #include <QTextBlock>
+#include <QTextLayout>
+#include <QDebug>
+#include <cmath>
 
 EditorWidget::EditorWidget(QWidget *parent) : QPlainTextEdit(parent) {
     lineNumberArea = new LineNumberArea(this);
     syntaxHighlighter = nullptr;
 
+    // The layout has to be in place before setDocument(), which is when QPlainTextEdit connects to it.
+    auto *textDocument = new QTextDocument(this);
+    longLines = new LongLineLayout(textDocument);
+    textDocument->setDocumentLayout(longLines);
+    setDocument(textDocument);
+
     connect(this, &QPlainTextEdit::blockCountChanged, this, &EditorWidget::updateLineNumberAreaWidth);
     connect(this, &QPlainTextEdit::updateRequest, this, &EditorWidget::updateLineNumberArea);
+    connect(this, &QPlainTextEdit::cursorPositionChanged, this, &EditorWidget::revealCursorLine);
     connect(this, &QPlainTextEdit::cursorPositionChanged, this, &EditorWidget::highlightCurrentLine);
-
-    updateLineNumberAreaWidth(0);
-    highlightCurrentLine();
+    connect(this, &QPlainTextEdit::cursorPositionChanged, this, &EditorWidget::ensureLongLineCursorVisible);
+    connect(document(), &QTextDocument::contentsChange, this, &EditorWidget::mirrorContentsChange);
+    connect(document(), &QTextDocument::contentsChange, this, &EditorWidget::shiftLineMarkers);
+    connect(document(), &QTextDocument::contentsChange, this, &EditorWidget::moveDecorations);
+    connect(document(), &QTextDocument::contentsChange, this, &EditorWidget::moveFolds);
 
     setLineWrapMode(QPlainTextEdit::NoWrap);
     setFont(QFont("Courier", 12));
+    gutter.setFont(font());
     filePath = ""; // Initialize file path
+
+    updateLineNumberAreaWidth(0);
+    highlightCurrentLine();
 }
 
 int EditorWidget::lineNumberAreaWidth() {
     int digits = 1;
-    int max = qMax(1, blockCount());
+    int max = qMax(1, qMax(blockCount(), lineCountHint));
     while (max >= 10) {
         max /= 10;
         ++digits;
     }
-    int space = 3 + fontMetrics().horizontalAdvance(QLatin1Char('9')) * digits;
-    return space;
+    return gutter.width(digits);
 }
 
 void EditorWidget::updateLineNumberAreaWidth(int) {
-    setViewportMargins(lineNumberAreaWidth(), 0, 0, 0);
+    // Setting the margins relayouts the viewport even when they do not change.
+    int width = lineNumberAreaWidth();
+    if (width != gutterWidth) {
+        gutterWidth = width;
+        setViewportMargins(width, 0, 0, 0);
+        QRect cr = contentsRect();
+        lineNumberArea->setGeometry(QRect(cr.left(), cr.top(), width, cr.height()));
+    }
 }
 
 void EditorWidget::updateLineNumberArea(const QRect &rect, int dy) {
-    if (dy)
+    if (dy) {
+        gutter.scroll(dy);
         lineNumberArea->scroll(0, dy);
-    else
+    } else {
         lineNumberArea->update(0, rect.y(), lineNumberArea->width(), rect.height());
+    }
 
     if (rect.contains(viewport()->rect()))
         updateLineNumberAreaWidth(0);
@@ -59,49 +89,754 @@ void EditorWidget::resizeEvent(QResizeEvent *event) {
     lineNumberArea->setGeometry(QRect(cr.left(), cr.top(), lineNumberAreaWidth(), cr.height()));
 }
 
+void EditorWidget::changeEvent(QEvent *event) {
+    QPlainTextEdit::changeEvent(event);
+    if (event->type() == QEvent::FontChange) {
+        gutter.setFont(font());
+        updateLineNumberAreaWidth(0);
+        lineNumberArea->update();
+    }
+}
+
 void EditorWidget::lineNumberAreaPaintEvent(QPaintEvent *event) {
-    QPainter painter(lineNumberArea);
-    painter.fillRect(event->rect(), Qt::lightGray);
+    int cursorLine = textCursor().blockNumber();
+    int height = lineNumberArea->height();
 
+    QVector<GutterRenderer::Row> rows;
     QTextBlock block = firstVisibleBlock();
     int blockNumber = block.blockNumber();
     int top = static_cast<int>(blockBoundingGeometry(block).translated(contentOffset()).top());
-    int bottom = top + static_cast<int>(blockBoundingRect(block).height());
-
-    while (block.isValid() && top <= event->rect().bottom()) {
-        if (block.isVisible() && bottom >= event->rect().top()) {
-            QString number = QString::number(blockNumber + 1);
-            painter.setPen(Qt::black);
-            painter.drawText(0, top, lineNumberArea->width() - 5, fontMetrics().height(),
-                             Qt::AlignRight, number);
+    while (block.isValid() && top < height) {
+        int blockHeight = static_cast<int>(blockBoundingRect(block).height());
+        if (block.isVisible()) {
+            GutterRenderer::Row row;
+            row.top = top;
+            row.height = blockHeight;
+            row.current = blockNumber == cursorLine;
+            row.number = relativeNumbers && !row.current ? qAbs(blockNumber - cursorLine) : blockNumber + 1;
+            row.marker = lineMarkers.isEmpty() ? GutterRenderer::NoMarker
+                                               : lineMarkers.value(blockNumber, GutterRenderer::NoMarker);
+            FoldRegion region;
+            row.fold = folds.size() == 0 || !folds.find(blockNumber, region) ? GutterRenderer::NoFold
+                       : region.collapsed                                     ? GutterRenderer::FoldClosed
+                                                                              : GutterRenderer::FoldOpen;
+            rows.append(row);
         }
 
-        block = block.next();
-        top = bottom;
-        bottom = top + static_cast<int>(blockBoundingRect(block).height());
-        ++blockNumber;
+        block = nextShownBlock(block);
+        top += blockHeight;
+        blockNumber = block.blockNumber();
+    }
+
+    QPainter painter(lineNumberArea);
+    gutter.paint(painter, event->rect(), lineNumberArea->size(), lineNumberArea->devicePixelRatioF(), rows);
+}
+
+void EditorWidget::lineNumberAreaMousePressEvent(QMouseEvent *event) {
+    // Only the fold column toggles; it is at the right edge of the gutter.
+    if (event->button() != Qt::LeftButton || event->pos().x() < lineNumberArea->width() - gutter.foldColumnWidth()) {
+        return;
+    }
+    QTextBlock block = cursorForPosition(QPoint(0, event->pos().y())).block();
+    if (block.isValid()) {
+        toggleFold(block.blockNumber());
     }
 }
 
+QRect EditorWidget::gutterRowRect(int line) {
+    QTextBlock block = document()->findBlockByNumber(line);
+    if (!block.isValid()) {
+        return QRect();
+    }
+    QRectF geometry = blockBoundingGeometry(block).translated(contentOffset());
+    return QRect(0, static_cast<int>(geometry.top()), lineNumberArea->width(), static_cast<int>(geometry.height()));
+}
+
+void EditorWidget::setRelativeLineNumbers(bool relative) {
+    relativeNumbers = relative;
+    lineNumberArea->update();
+}
+
+void EditorWidget::setLineMarker(int line, GutterRenderer::Marker marker) {
+    if (marker == GutterRenderer::NoMarker) {
+        lineMarkers.remove(line);
+    } else {
+        lineMarkers.insert(line, marker);
+    }
+    lineNumberArea->update(gutterRowRect(line));
+}
+
+void EditorWidget::clearLineMarkers() {
+    lineMarkers.clear();
+    lineNumberArea->update();
+}
+
+void EditorWidget::shiftLineMarkers(int position) {
+    int blockCount = document()->blockCount();
+    int delta = blockCount - markerBlockCount;
+    markerBlockCount = blockCount;
+    if (delta == 0 || lineMarkers.isEmpty()) {
+        return;
+    }
+
+    // Lines after the changed one move by the change in line count; removed lines lose their markers.
+    int first = document()->findBlock(position).blockNumber();
+    QMap<int, GutterRenderer::Marker> moved;
+    for (auto marker = lineMarkers.constBegin(); marker != lineMarkers.constEnd(); ++marker) {
+        if (marker.key() <= first) {
+            moved.insert(marker.key(), marker.value());
+        } else if (marker.key() > first - delta) {
+            moved.insert(marker.key() + delta, marker.value());
+        }
+    }
+    lineMarkers.swap(moved);
+}
+
 void EditorWidget::highlightCurrentLine() {
-    QList<QTextEdit::ExtraSelection> extraSelections;
+    // The highlight is painted with the decorations: only the old and the new current row change.
+    int line = textCursor().blockNumber();
+    if (line != currentLine) {
+        for (int row : {currentLine, line}) {
+            QRect rect = gutterRowRect(row);
+            viewport()->update(0, rect.top(), viewport()->width(), rect.height());
+        }
+        // Relative numbers change on every row.
+        if (relativeNumbers) {
+            lineNumberArea->update();
+        } else {
+            lineNumberArea->update(gutterRowRect(currentLine));
+            lineNumberArea->update(gutterRowRect(line));
+        }
+        currentLine = line;
+    }
+}
+
+quint32 EditorWidget::addDecoration(int start, int end, const DecorationStyle &style, const QString &group) {
+    int styleIndex = decorationStyles.indexOf(style);
+    if (styleIndex < 0) {
+        styleIndex = decorationStyles.size();
+        decorationStyles.append(style);
+    }
+    quint32 groupId = decorationGroups.value(group);
+    if (groupId == 0) {
+        groupId = decorationGroups.size() + 1;
+        decorationGroups.insert(group, groupId);
+    }
+
+    quint32 id = nextDecorationId++;
+    decorations.insert(Decoration{start, qMax(start, end), id, groupId, static_cast<quint32>(styleIndex)});
+    viewport()->update();
+    return id;
+}
+
+int EditorWidget::removeDecorations(const QString &group) {
+    quint32 groupId = decorationGroups.value(group);
+    if (groupId == 0) {
+        return 0;
+    }
+    int removed = decorations.removeIf([groupId](const Decoration &decoration) {
+        return decoration.group == groupId;
+    });
+    if (removed > 0) {
+        viewport()->update();
+    }
+    return removed;
+}
+
+bool EditorWidget::removeDecoration(quint32 id, const QString &groupPrefix) {
+    QSet<quint32> groups;
+    for (auto it = decorationGroups.cbegin(); it != decorationGroups.cend(); ++it) {
+        if (it.key().startsWith(groupPrefix)) {
+            groups.insert(it.value());
+        }
+    }
+    bool removed = decorations.removeIf([id, &groups](const Decoration &decoration) {
+        return decoration.id == id && groups.contains(decoration.group);
+    }) > 0;
+    if (removed) {
+        viewport()->update();
+    }
+    return removed;
+}
+
+void EditorWidget::moveDecorations(int position, int charsRemoved, int charsAdded) {
+    decorations.applyEdit(position, charsRemoved, charsAdded);
+}
+
+void EditorWidget::paintEvent(QPaintEvent *event) {
+    // QPlainTextEdit draws the text without clearing the viewport, so backgrounds painted first stay under it.
+    {
+        QPainter painter(viewport());
+        paintDecorations(painter, event->rect(), false);
+    }
+    QPlainTextEdit::paintEvent(event);
+    QPainter painter(viewport());
+    paintLongLines(painter, event->rect());
+    paintFoldMarkers(painter, event->rect());
+    if (decorations.size() > 0) {
+        paintDecorations(painter, event->rect(), true);
+    }
+}
+
+void EditorWidget::paintDecorations(QPainter &painter, const QRect &area, bool overText) {
+    QPointF offset = contentOffset();
+    QTextBlock current = isReadOnly() ? QTextBlock() : textCursor().block();
+    qreal lineBreakWidth = fontMetrics().horizontalAdvance(QLatin1Char(' '));
+
+    auto paintRange = [&](const DecorationStyle &style, const QRectF &rect, qreal ascent) {
+        if (!overText) {
+            painter.fillRect(rect, style.background);
+            return;
+        }
+        if (style.border.isValid()) {
+            painter.setPen(style.border);
+            painter.setBrush(Qt::NoBrush);
+            painter.drawRect(rect.adjusted(0, 0, -1, -1));
+        }
+        if (style.underline.isValid()) {
+            painter.setPen(style.underline);
+            qreal y = qMin(rect.top() + ascent + 2, rect.bottom() - 2);
+            if (style.squiggle) {
+                QPolygonF wave;
+                for (qreal x = rect.left(); x <= rect.right(); x += 2) {
+                    wave << QPointF(x, (static_cast<int>(x - rect.left()) / 2) % 2 ? y - 1 : y + 1);
+                }
+                painter.drawPolyline(wave);
+            } else {
+                painter.drawLine(QPointF(rect.left(), y), QPointF(rect.right(), y));
+            }
+        }
+    };
+
+    for (QTextBlock block = firstVisibleBlock(); block.isValid(); block = nextShownBlock(block)) {
+        QRectF bounds = blockBoundingGeometry(block).translated(offset);
+        if (bounds.top() > area.bottom()) {
+            break;
+        }
+        if (!block.isVisible() || bounds.bottom() < area.top()) {
+            continue;
+        }
+        if (!overText && block == current) {
+            painter.fillRect(QRectF(0, bounds.top(), viewport()->width(), bounds.height()),
+                             QColor(Qt::yellow).lighter(160));
+        }
+        if (decorations.size() == 0) {
+            continue;
+        }
 
-    if (!isReadOnly()) {
-        QTextEdit::ExtraSelection selection;
-        selection.format.setBackground(QColor(Qt::yellow).lighter(160));
-        selection.format.setProperty(QTextFormat::FullWidthSelection, true);
-        selection.cursor = textCursor();
-        selection.cursor.clearSelection();
-        extraSelections.append(selection);
+        // Only the decorations overlapping this block are visited; a range that continues on the next
+        // line also covers the line break.
+        QTextLayout *layout = block.layout();
+        int blockStart = block.position();
+        int lineBreak = blockStart + block.length() - 1;
+        int visitStart = blockStart;
+        int visitEnd = lineBreak + 1;
+        bool longLine = LongLineLayout::isLongBlock(block);
+        if (longLine) {
+            // A long line is one row of fixed-width columns; only the visible ones are looked at.
+            QPair<int, int> columns = longLineColumns(area, block.length() - 1);
+            visitStart = blockStart + columns.first;
+            visitEnd = columns.second == block.length() - 1 ? lineBreak + 1 : blockStart + columns.second;
+        }
+        decorations.visit(visitStart, visitEnd, [&](const Decoration &decoration) {
+            const DecorationStyle &style = decorationStyles[decoration.style];
+            if (overText ? !style.underline.isValid() && !style.border.isValid() : !style.background.isValid()) {
+                return;
+            }
+            int first = qMax(decoration.start, blockStart) - blockStart;
+            int last = qMin(decoration.end, lineBreak) - blockStart;
+            if (longLine) {
+                qreal left = longLineX(first);
+                qreal right = longLineX(last) + (decoration.end > lineBreak ? lineBreakWidth : 0);
+                paintRange(style, QRectF(left, bounds.top(), right - left, longLines->rowHeight()),
+                           QFontMetricsF(document()->defaultFont()).ascent());
+                return;
+            }
+            for (int i = 0; i < layout->lineCount(); ++i) {
+                QTextLine line = layout->lineAt(i);
+                int lineStart = line.textStart();
+                int lineEnd = lineStart + line.textLength();
+                if (last < lineStart || first > lineEnd || (last == lineStart && first < last)) {
+                    continue;
+                }
+                qreal left = line.cursorToX(qMax(first, lineStart));
+                qreal right = line.cursorToX(qMin(last, lineEnd));
+                if (decoration.end > lineBreak && i == layout->lineCount() - 1) {
+                    right += lineBreakWidth;
+                }
+                paintRange(style, QRectF(offset.x() + left, bounds.top() + line.y(), right - left, line.height()),
+                           line.ascent());
+            }
+        });
     }
+}
+
+void EditorWidget::paintLongLines(QPainter &painter, const QRect &area) {
+    QPointF offset = contentOffset();
+    QTextCursor cursor = textCursor();
+    QFontMetricsF metrics(document()->defaultFont());
+    qreal rowHeight = longLines->rowHeight();
+    painter.setFont(document()->defaultFont());
 
-    setExtraSelections(extraSelections);
+    for (QTextBlock block = firstVisibleBlock(); block.isValid(); block = nextShownBlock(block)) {
+        QRectF bounds = blockBoundingGeometry(block).translated(offset);
+        if (bounds.top() > area.bottom()) {
+            break;
+        }
+        if (!block.isVisible() || bounds.bottom() < area.top() || !LongLineLayout::isLongBlock(block)) {
+            continue;
+        }
+
+        // Only the visible columns are read and drawn, in segments that start at multiples of
+        // SegmentColumns so the glyphs do not shift while scrolling.
+        int length = block.length() - 1;
+        QPair<int, int> columns = longLineColumns(area, length);
+        int first = columns.first / SegmentColumns * SegmentColumns;
+        int last = columns.second;
+        QTextCursor range(document());
+        range.setPosition(block.position() + first);
+        range.setPosition(block.position() + last, QTextCursor::KeepAnchor);
+        QString text = range.selectedText();
+        qreal baseline = bounds.top() + metrics.ascent();
+        auto drawText = [&] {
+            for (int segment = 0; segment < text.size(); segment += SegmentColumns) {
+                painter.drawText(QPointF(longLineX(first + segment), baseline), text.mid(segment, SegmentColumns));
+            }
+        };
+        painter.setPen(palette().color(QPalette::Text));
+        drawText();
+
+        int selectionFirst = qMax(cursor.selectionStart() - block.position(), first);
+        int selectionLast = qMin(cursor.selectionEnd() - block.position(), last);
+        if (selectionFirst < selectionLast) {
+            QRectF selection(longLineX(selectionFirst), bounds.top(),
+                             longLineX(selectionLast) - longLineX(selectionFirst), rowHeight);
+            painter.save();
+            painter.setClipRect(selection);
+            painter.fillRect(selection, palette().highlight());
+            painter.setPen(palette().color(QPalette::HighlightedText));
+            drawText();
+            painter.restore();
+        }
+
+        // The cursor is drawn without blinking; QPlainTextEdit's blink state is not accessible.
+        int caret = cursor.position() - block.position();
+        if (hasFocus() && caret >= 0 && caret <= length) {
+            painter.fillRect(QRectF(longLineX(caret), bounds.top(), cursorWidth(), rowHeight),
+                             palette().color(QPalette::Text));
+        }
+    }
+}
+
+void EditorWidget::paintFoldMarkers(QPainter &painter, const QRect &area) {
+    if (folds.size() == 0) {
+        return;
+    }
+    QPointF offset = contentOffset();
+    QFontMetricsF metrics(document()->defaultFont());
+    QString ellipsis(QChar(0x2026));
+    qreal gap = metrics.horizontalAdvance(QLatin1Char(' '));
+    qreal boxWidth = metrics.horizontalAdvance(ellipsis) + gap;
+    painter.setFont(document()->defaultFont());
+
+    for (QTextBlock block = firstVisibleBlock(); block.isValid(); block = nextShownBlock(block)) {
+        QRectF bounds = blockBoundingGeometry(block).translated(offset);
+        if (bounds.top() > area.bottom()) {
+            break;
+        }
+        FoldRegion region;
+        if (!block.isVisible() || bounds.bottom() < area.top() || !folds.find(block.blockNumber(), region) ||
+            !region.collapsed) {
+            continue;
+        }
+
+        // The marker goes after the end of the line, on its last row.
+        qreal x;
+        qreal top = bounds.top();
+        qreal height = longLines->rowHeight();
+        if (LongLineLayout::isLongBlock(block)) {
+            x = longLineX(block.length() - 1);
+        } else {
+            QTextLayout *layout = block.layout();
+            if (layout->lineCount() == 0) {
+                continue;
+            }
+            QTextLine line = layout->lineAt(layout->lineCount() - 1);
+            x = offset.x() + line.cursorToX(block.length() - 1);
+            top += line.y();
+            height = line.height();
+        }
+        QRectF marker(x + gap, top + 1, boxWidth, height - 2);
+        painter.setPen(palette().color(QPalette::Mid));
+        painter.setBrush(Qt::NoBrush);
+        painter.drawRect(marker);
+        painter.setPen(palette().color(QPalette::Text));
+        painter.drawText(marker, Qt::AlignCenter, ellipsis);
+    }
+}
+
+qreal EditorWidget::longLineX(int column) const {
+    return contentOffset().x() + document()->documentMargin() + column * longLines->columnWidth();
+}
+
+QPair<int, int> EditorWidget::longLineColumns(const QRect &area, int length) const {
+    qreal left = longLineX(0);
+    qreal width = longLines->columnWidth();
+    int first = static_cast<int>(qBound<qreal>(0, std::floor((area.left() - left) / width), length));
+    int last = static_cast<int>(qBound<qreal>(0, std::ceil((area.right() + 1 - left) / width), length));
+    return qMakePair(first, last);
+}
+
+bool EditorWidget::moveCursorInLongLine(const QPoint &pos, QTextCursor::MoveMode mode) {
+    QTextBlock block = cursorForPosition(pos).block();
+    if (!LongLineLayout::isLongBlock(block)) {
+        return false;
+    }
+    int column = qBound(0, qRound((pos.x() - longLineX(0)) / longLines->columnWidth()), block.length() - 1);
+    QTextCursor cursor = textCursor();
+    cursor.setPosition(block.position() + column, mode);
+    setTextCursor(cursor);
+    return true;
+}
+
+void EditorWidget::ensureLongLineCursorVisible() {
+    QTextCursor cursor = textCursor();
+    QTextBlock block = cursor.block();
+    if (!LongLineLayout::isLongBlock(block) || !block.isVisible()) {
+        return;
+    }
+    // QPlainTextEdit repaints the cursor where its layout would put it, which a long line does not have.
+    QRect row = gutterRowRect(block.blockNumber());
+    viewport()->update(0, row.top(), viewport()->width(), row.height());
+
+    // Without wrapping the vertical scroll bar counts lines.
+    QScrollBar *vertical = verticalScrollBar();
+    int rows = qMax(1, static_cast<int>(viewport()->height() / longLines->rowHeight()));
+    int line = block.firstLineNumber();
+    if (line < vertical->value()) {
+        vertical->setValue(line);
+    } else if (line >= vertical->value() + rows) {
+        vertical->setValue(line - rows + 1);
+    }
+
+    QScrollBar *horizontal = horizontalScrollBar();
+    qreal column = longLines->columnWidth();
+    int x = static_cast<int>(document()->documentMargin() + cursor.positionInBlock() * column);
+    int width = viewport()->width();
+    if (x < horizontal->value() || x + column > horizontal->value() + width) {
+        horizontal->setValue(qMax(0, x - width / 2));
+    }
+}
+
+void EditorWidget::keyPressEvent(QKeyEvent *event) {
+    bool select = event == QKeySequence::SelectPreviousLine || event == QKeySequence::SelectNextLine;
+    bool up = event == QKeySequence::MoveToPreviousLine || event == QKeySequence::SelectPreviousLine;
+    bool down = event == QKeySequence::MoveToNextLine || event == QKeySequence::SelectNextLine;
+    if (up || down) {
+        // Folded lines are jumped over; QTextCursor would step onto them and unfold them.
+        QTextCursor cursor = textCursor();
+        QTextBlock block = cursor.block();
+        QTextBlock target = up ? block.previous() : nextShownBlock(block);
+        if (up && target.isValid() && !target.isVisible()) {
+            target = document()->findBlockByNumber(foldHeader(target.blockNumber()));
+        }
+        while (target.isValid() && !target.isVisible()) {
+            target = up ? target.previous() : target.next();
+        }
+        bool overFold = target.isValid() && qAbs(target.blockNumber() - block.blockNumber()) > 1;
+        if (target.isValid() &&
+            (overFold || LongLineLayout::isLongBlock(block) || LongLineLayout::isLongBlock(target))) {
+            int column = qMin(cursor.positionInBlock(), target.length() - 1);
+            cursor.setPosition(target.position() + column, select ? QTextCursor::KeepAnchor : QTextCursor::MoveAnchor);
+            setTextCursor(cursor);
+            return;
+        }
+    }
+    QPlainTextEdit::keyPressEvent(event);
+}
+
+void EditorWidget::mousePressEvent(QMouseEvent *event) {
+    QPlainTextEdit::mousePressEvent(event);
+    if (event->button() == Qt::LeftButton) {
+        moveCursorInLongLine(event->pos(), event->modifiers() & Qt::ShiftModifier ? QTextCursor::KeepAnchor
+                                                                                  : QTextCursor::MoveAnchor);
+    }
+}
+
+void EditorWidget::mouseMoveEvent(QMouseEvent *event) {
+    QPlainTextEdit::mouseMoveEvent(event);
+    if (event->buttons() & Qt::LeftButton) {
+        moveCursorInLongLine(event->pos(), QTextCursor::KeepAnchor);
+    }
+}
+
+void EditorWidget::mouseDoubleClickEvent(QMouseEvent *event) {
+    QPlainTextEdit::mouseDoubleClickEvent(event);
+    if (event->button() == Qt::LeftButton && moveCursorInLongLine(event->pos(), QTextCursor::MoveAnchor)) {
+        QTextCursor cursor = textCursor();
+        cursor.select(QTextCursor::WordUnderCursor);
+        setTextCursor(cursor);
+    }
 }
 
 void LineNumberArea::paintEvent(QPaintEvent *event) {
     static_cast<EditorWidget *>(parent())->lineNumberAreaPaintEvent(event);
 }
 
+void LineNumberArea::mousePressEvent(QMouseEvent *event) {
+    static_cast<EditorWidget *>(parent())->lineNumberAreaMousePressEvent(event);
+}
+
+void EditorWidget::updateFoldRegions(int first, int last, const std::vector<FoldRegion> &regions) {
+    if (first > last) {
+        return;
+    }
+    std::vector<FoldRegion> previous = folds.take(first, last);
+    if (regions.empty() && previous.empty()) {
+        return;
+    }
+
+    // A folded region stays folded if the new regions still have one with the same lines; both lists
+    // are sorted by start.
+    std::vector<FoldRegion> updated = regions;
+    std::vector<FoldRegion> dropped;
+    bool hadCollapsed = false;
+    size_t next = 0;
+    for (const FoldRegion &region : previous) {
+        if (!region.collapsed) {
+            continue;
+        }
+        hadCollapsed = true;
+        while (next < updated.size() && updated[next].start < region.start) {
+            ++next;
+        }
+        if (next < updated.size() && updated[next].start == region.start && updated[next].end == region.end) {
+            updated[next].collapsed = true;
+        } else {
+            dropped.push_back(region);
+        }
+    }
+    if (folds.size() == 0) {
+        folds.assign(updated);
+    } else {
+        for (const FoldRegion &region : updated) {
+            folds.insert(region);
+        }
+    }
+
+    // The lines of a region that changed are shown again, unless a region that is still folded hides them.
+    for (const FoldRegion &region : dropped) {
+        if (foldHeader(region.start) == region.start) {
+            showRegion(region);
+        }
+    }
+    lineNumberArea->update();
+    if (hadCollapsed) {
+        viewport()->update();
+    }
+}
+
+void EditorWidget::fold(int line) {
+    // Regions are visited in order of their start, so the last unfolded one is the innermost.
+    FoldRegion target{};
+    bool found = false;
+    folds.visit(line, line + 1, [&](const FoldRegion &region) {
+        if (!region.collapsed) {
+            target = region;
+            found = true;
+        }
+    });
+    if (found) {
+        setRegionCollapsed(target, true);
+    }
+}
+
+void EditorWidget::unfold(int line) {
+    FoldRegion target{};
+    bool found = folds.find(line, target) && target.collapsed;
+    if (!found) {
+        folds.visit(line, line + 1, [&](const FoldRegion &region) {
+            if (region.collapsed) {
+                target = region;
+                found = true;
+            }
+        });
+    }
+    if (found) {
+        setRegionCollapsed(target, false);
+    }
+}
+
+void EditorWidget::toggleFold(int line) {
+    FoldRegion region{};
+    if (folds.find(line, region)) {
+        setRegionCollapsed(region, !region.collapsed);
+    }
+}
+
+void EditorWidget::foldAll() {
+    if (folds.size() == 0) {
+        return;
+    }
+    folds.setAllCollapsed(true);
+    moveCursorOutOfFolds();
+    // Nested regions are skipped, but each block of an outermost region is still set hidden one by one.
+    int line = 0;
+    folds.visit(0, blockCount(), [&](const FoldRegion &region) {
+        if (region.start >= line) {
+            setLinesVisible(region.start + 1, region.end, false);
+            line = region.end + 1;
+        }
+    });
+    lineNumberArea->update();
+    viewport()->update();
+}
+
+void EditorWidget::unfoldAll() {
+    if (folds.size() == 0) {
+        return;
+    }
+    // Showing the outermost folded regions shows everything folded inside them too.
+    int line = 0;
+    folds.visit(0, blockCount(), [&](const FoldRegion &region) {
+        if (region.collapsed && region.start >= line) {
+            setLinesVisible(region.start + 1, region.end, true);
+            line = region.end + 1;
+        }
+    });
+    folds.setAllCollapsed(false);
+    lineNumberArea->update();
+    viewport()->update();
+}
+
+QTextBlock EditorWidget::nextShownBlock(const QTextBlock &block) const {
+    QTextBlock next = block.next();
+    FoldRegion region;
+    if (next.isValid() && !next.isVisible() && folds.find(block.blockNumber(), region) && region.collapsed) {
+        return document()->findBlockByNumber(region.end + 1);
+    }
+    return next;
+}
+
+int EditorWidget::foldHeader(int line) const {
+    // Regions are visited in order of their start, so the first folded one is the outermost.
+    int header = line;
+    folds.visit(line, line + 1, [&](const FoldRegion &region) {
+        if (region.collapsed && region.start < header) {
+            header = region.start;
+        }
+    });
+    return header;
+}
+
+void EditorWidget::moveCursorOutOfFolds() {
+    QTextCursor cursor = textCursor();
+    int line = cursor.blockNumber();
+    int header = foldHeader(line);
+    if (header != line) {
+        QTextBlock block = document()->findBlockByNumber(header);
+        cursor.setPosition(block.position() + block.length() - 1);
+        setTextCursor(cursor);
+    }
+}
+
+void EditorWidget::setRegionCollapsed(const FoldRegion &region, bool collapsed) {
+    folds.setCollapsed(region.start, collapsed);
+    if (collapsed) {
+        moveCursorOutOfFolds();
+        setLinesVisible(region.start + 1, region.end, false);
+    } else {
+        showRegion(region);
+    }
+    lineNumberArea->update(gutterRowRect(region.start));
+    viewport()->update();
+}
+
+void EditorWidget::showRegion(const FoldRegion &region) {
+    int line = region.start + 1;
+    folds.visit(region.start + 1, region.end + 1, [&](const FoldRegion &inner) {
+        if (inner.collapsed && inner.start >= line) {
+            setLinesVisible(line, inner.start, true);
+            line = inner.end + 1;
+        }
+    });
+    setLinesVisible(line, region.end, true);
+}
+
+void EditorWidget::setLinesVisible(int first, int last, bool visible) {
+    QTextBlock block = document()->findBlockByNumber(first);
+    if (first > last || !block.isValid()) {
+        return;
+    }
+
+    // A dirty range within one block is taken for an edit that keeps its line count, so the range
+    // starts one block earlier. The layout then recounts the lines of just these blocks.
+    QTextBlock previous = block.previous();
+    int from = previous.isValid() ? previous.position() : block.position();
+    int to = from;
+    for (int line = first; block.isValid() && line <= last; ++line) {
+        block.setVisible(visible);
+        to = block.position() + block.length();
+        block = block.next();
+    }
+    document()->markContentsDirty(from, to - from);
+}
+
+void EditorWidget::moveFolds(int position, int, int charsAdded) {
+    QTextDocument *doc = document();
+    int blockCount = doc->blockCount();
+    int delta = blockCount - foldBlockCount;
+    foldBlockCount = blockCount;
+    if (folds.size() == 0) {
+        return;
+    }
+
+    int end = qMin(position + charsAdded, doc->characterCount() - 1);
+    int first = doc->findBlock(position).blockNumber();
+    int oldLast = doc->findBlock(end).blockNumber() - delta;
+
+    // A folded region whose lines the edit touches is unfolded, so no edited line stays hidden; typing on
+    // the first line of a region leaves it folded.
+    std::vector<FoldRegion> opened;
+    folds.visit(first, oldLast + 1, [&](const FoldRegion &region) {
+        if (region.collapsed && !(delta == 0 && first == oldLast && region.start == first)) {
+            opened.push_back(region);
+        }
+    });
+    for (const FoldRegion &region : opened) {
+        folds.setCollapsed(region.start, false);
+    }
+    folds.applyEdit(first, oldLast, delta);
+
+    int newLast = oldLast + delta;
+    auto map = [&](int line) { return line > oldLast ? line + delta : qMin(line, newLast); };
+    for (const FoldRegion &region : opened) {
+        FoldRegion moved = region;
+        moved.start = region.start < first ? region.start : map(region.start);
+        moved.end = map(region.end);
+        showRegion(moved);
+    }
+}
+
+void EditorWidget::revealCursorLine() {
+    QTextBlock block = textCursor().block();
+    if (block.isVisible() || folds.size() == 0) {
+        return;
+    }
+    // Outer regions first: unfolding one leaves the folded regions inside it hidden.
+    int line = block.blockNumber();
+    std::vector<FoldRegion> hiding;
+    folds.visit(line, line + 1, [&](const FoldRegion &region) {
+        if (region.collapsed && region.start < line) {
+            hiding.push_back(region);
+        }
+    });
+    for (const FoldRegion &region : hiding) {
+        setRegionCollapsed(region, false);
+    }
+    ensureCursorVisible();
+}
+
 void EditorWidget::setSyntaxHighlighter(ISyntaxHighlighter *highlighter) {
     syntaxHighlighter = highlighter;
     if (syntaxHighlighter) {
@@ -120,3 +855,154 @@ void EditorWidget::setCurrentFilePath(const QString &path) {
 ISyntaxHighlighter *EditorWidget::getSyntaxHighlighter() const {
     return syntaxHighlighter;
 }
+
+void EditorWidget::setLineCountHint(int lines) {
+    lineCountHint = lines;
+    updateLineNumberAreaWidth(0);
+}
+
+void EditorWidget::beginLoad() {
+    mirrorSuspended = true;
+    ++revision;
+    buffer = PieceTable();
+    lineMarkers.clear();
+    decorations.clear();
+    folds.clear();
+    document()->setUndoRedoEnabled(false);
+    clear();
+    setReadOnly(true);
+    highlightCurrentLine();
+}
+
+void EditorWidget::appendText(const QString &text) {
+    QTextCursor cursor(document());
+    cursor.movePosition(QTextCursor::End);
+    cursor.insertText(text);
+}
+
+void EditorWidget::appendTail(const QString &text, int maxLines) {
+    QScrollBar *scrollBar = verticalScrollBar();
+    bool atEnd = scrollBar->value() == scrollBar->maximum();
+
+    QTextCursor cursor(document());
+    cursor.movePosition(QTextCursor::End);
+    cursor.insertText(text);
+
+    int excess = maxLines > 0 ? blockCount() - maxLines : 0;
+    if (excess > 0) {
+        int top = scrollBar->value();
+        QTextCursor head(document());
+        head.setPosition(document()->findBlockByNumber(excess).position(), QTextCursor::KeepAnchor);
+        head.removeSelectedText();
+        if (!atEnd) {
+            // Without wrapping the scroll bar counts lines.
+            scrollBar->setValue(qMax(0, top - excess));
+        }
+    }
+    if (atEnd) {
+        scrollBar->setValue(scrollBar->maximum());
+    }
+}
+
+void EditorWidget::replaceLines(int line, int count, const QString &text) {
+    // Line n starts at block n; a line past the last block starts at the end of the text.
+    auto lineStart = [this](int number) {
+        QTextBlock block = document()->findBlockByNumber(number);
+        return block.isValid() ? block.position() : document()->characterCount() - 1;
+    };
+    int top = firstVisibleBlock().blockNumber();
+    int blocks = blockCount();
+
+    QTextCursor cursor(document());
+    cursor.setPosition(lineStart(line));
+    cursor.setPosition(lineStart(line + count), QTextCursor::KeepAnchor);
+    cursor.insertText(text);
+
+    if (line + count <= top) {
+        // Without wrapping the scroll bar counts lines.
+        verticalScrollBar()->setValue(verticalScrollBar()->value() + blockCount() - blocks);
+    }
+}
+
+void EditorWidget::endLoad(const PieceTable &loaded) {
+    mirrorSuspended = false;
+    ++revision;
+    buffer = loaded;
+    if (buffer.length() != document()->characterCount() - 1) {
+        buffer = PieceTable::fromUtf8(toPlainText().toUtf8());
+    }
+    // The document holds every line now, and edits would leave the indexed count behind.
+    lineCountHint = 0;
+    updateLineNumberAreaWidth(0);
+    setReadOnly(false);
+    document()->setUndoRedoEnabled(true);
+    viewport()->update();
+    highlightCurrentLine();
+    emit bufferReset();
+}
+
+const PieceTable &EditorWidget::textBuffer() const {
+    return buffer;
+}
+
+TextFormat EditorWidget::textFormat() const {
+    return format;
+}
+
+void EditorWidget::setTextFormat(const TextFormat &textFormat) {
+    format = textFormat;
+}
+
+PieceTable EditorWidget::snapshot() const {
+    return buffer;
+}
+
+void EditorWidget::beginBatch() {
+    if (batchDepth++ == 0) {
+        batchCursor = QTextCursor(document());
+        batchCursor.beginEditBlock();
+    }
+}
+
+void EditorWidget::endBatch() {
+    if (batchDepth > 0 && --batchDepth == 0) {
+        // Emits one merged contentsChange, so layout, highlighting and the text buffer update once.
+        batchCursor.endEditBlock();
+        batchCursor = QTextCursor();
+    }
+}
+
+bool EditorWidget::isLoading() const {
+    return mirrorSuspended;
+}
+
+quint64 EditorWidget::textRevision() const {
+    return revision;
+}
+
+void EditorWidget::mirrorContentsChange(int position, int charsRemoved, int charsAdded) {
+    ++revision;
+    if (mirrorSuspended) {
+        return;
+    }
+
+    // Whole-document changes count the final paragraph separator, which the buffer does not hold.
+    qint64 documentLength = document()->characterCount() - 1;
+    qint64 removed = qMin<qint64>(charsRemoved, buffer.length() - position);
+    qint64 added = qMin<qint64>(charsAdded, documentLength - position);
+
+    buffer.remove(position, removed);
+    if (added > 0) {
+        QTextCursor cursor(document());
+        cursor.setPosition(position);
+        cursor.setPosition(static_cast<int>(position + added), QTextCursor::KeepAnchor);
+        QString text = cursor.selectedText();
+        text.replace(QChar::ParagraphSeparator, QLatin1Char('\n'));
+        buffer.insert(position, text);
+    }
+
+    if (buffer.length() != documentLength) {
+        qWarning() << "Text buffer out of sync with the document, rebuilding it";
+        buffer = PieceTable::fromUtf8(toPlainText().toUtf8());
+    }
+}
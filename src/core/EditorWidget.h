@@ -3,14 +3,47 @@
  * @brief Editor widget for the Coda text editor, based on QPlainTextEdit.
  *        Provides the text editing area functionality with line numbers and syntax highlighting support.
  *        Supports multiple languages via the ISyntaxHighlighter interface and KSyntaxHighlightingAdapter implementation.
+ *        Mirrors every document edit into a PieceTable that saving and scripting read from.
+ *        Draws range decorations from an interval tree, so only those on visible lines are looked at.
+ *        Lines too long to lay out are painted and hit-tested by column, see LongLineLayout.
+ *        Folds the regions reported by the syntax definition by hiding their blocks, see FoldTree.
  * @author Dario Romandini
  */
 
 #pragma once
 
+#include "DecorationTree.h"
+#include "FoldTree.h"
+#include "GutterRenderer.h"
 #include "ISyntaxHighlighter.h"
+#include "PieceTable.h"
+#include "TextFormat.h"
+#include <QColor>
+#include <QHash>
+#include <QMap>
 #include <QPlainTextEdit>
+#include <QTextCursor>
+#include <QVector>
 #include <QWidget>
+#include <vector>
+
+class LongLineLayout;
+
+/**
+ * @struct DecorationStyle
+ * @brief How a decorated range is drawn. Invalid colours are not drawn.
+ */
+struct DecorationStyle {
+    QColor background;     ///< Fill behind the text.
+    QColor underline;      ///< Line under the text.
+    bool squiggle = false; ///< True to draw the underline as a wave.
+    QColor border;         ///< Frame around the text.
+
+    bool operator==(const DecorationStyle &other) const {
+        return background == other.background && underline == other.underline && squiggle == other.squiggle &&
+               border == other.border;
+    }
+};
 
 /**
  * @class LineNumberArea
@@ -38,6 +71,12 @@ protected:
      * @param event The paint event.
      */
     void paintEvent(QPaintEvent *event) override;
+
+    /**
+     * @brief Toggles the fold region of the clicked line.
+     * @param event The mouse event.
+     */
+    void mousePressEvent(QMouseEvent *event) override;
 };
 
 /**
@@ -61,6 +100,12 @@ public:
      */
     void lineNumberAreaPaintEvent(QPaintEvent *event);
 
+    /**
+     * @brief Folds or unfolds the region starting on the line clicked in the line number area.
+     * @param event The mouse event, in line number area coordinates.
+     */
+    void lineNumberAreaMousePressEvent(QMouseEvent *event);
+
     /**
      * @brief Sets the syntax highlighter.
      * @param highlighter Pointer to an ISyntaxHighlighter implementation.
@@ -85,6 +130,187 @@ public:
     */
     ISyntaxHighlighter *getSyntaxHighlighter() const;
 
+    /**
+     * @brief Shows line numbers relative to the cursor's line, which keeps its absolute number.
+     * @param relative True for relative numbers, false for absolute ones.
+     */
+    void setRelativeLineNumbers(bool relative);
+
+    /**
+     * @brief Sets the diagnostic marker shown in the gutter for a line. Markers move with inserted and
+     *        removed lines.
+     * @param line 0-based line number.
+     * @param marker The marker, or GutterRenderer::NoMarker to remove it.
+     */
+    void setLineMarker(int line, GutterRenderer::Marker marker);
+
+    /**
+     * @brief Removes all gutter markers.
+     */
+    void clearLineMarkers();
+
+    /**
+     * @brief Decorates a range of the document. The decoration moves with edits and is removed when all
+     *        of its text is deleted.
+     * @param start Document position of the first character.
+     * @param end Document position after the last character.
+     * @param style How to draw the range.
+     * @param group Group to remove the decoration with.
+     * @return Identifier of the decoration.
+     */
+    quint32 addDecoration(int start, int end, const DecorationStyle &style, const QString &group);
+
+    /**
+     * @brief Removes the decorations of a group.
+     * @param group The group.
+     * @return Number of decorations removed.
+     */
+    int removeDecorations(const QString &group);
+
+    /**
+     * @brief Removes one decoration. Prefer removing a group to removing many decorations one by one.
+     * @param id Identifier returned by addDecoration().
+     * @param groupPrefix Prefix the decoration's group must start with, so that callers cannot remove
+     *        decorations they did not add; empty to match any group.
+     * @return True if the decoration existed in a matching group.
+     */
+    bool removeDecoration(quint32 id, const QString &groupPrefix = QString());
+
+    /**
+     * @brief Replaces the foldable regions starting on a range of lines. Folded regions that still exist with
+     *        the same lines stay folded; the others are unfolded. Costs O(log n) per region in the range.
+     * @param first First line of the range.
+     * @param last Last line of the range.
+     * @param regions Regions starting in the range, sorted by start, with distinct starts.
+     */
+    void updateFoldRegions(int first, int last, const std::vector<FoldRegion> &regions);
+
+    /**
+     * @brief Folds the innermost unfolded region containing a line.
+     * @param line 0-based line number.
+     */
+    void fold(int line);
+
+    /**
+     * @brief Unfolds the region starting on a line, or else the innermost folded region containing it.
+     * @param line 0-based line number.
+     */
+    void unfold(int line);
+
+    /**
+     * @brief Folds the region starting on a line if it is unfolded, and unfolds it otherwise.
+     * @param line 0-based line number.
+     */
+    void toggleFold(int line);
+
+    /**
+     * @brief Folds every region. Only the lines of the outermost regions are hidden; nested ones are
+     *        already inside them. QTextBlock has no range setter, so this still visits every block of
+     *        those regions, which is nearly the whole document when one region spans it.
+     */
+    void foldAll();
+
+    /**
+     * @brief Unfolds every region. Like foldAll(), visits every block of the outermost folded regions.
+     */
+    void unfoldAll();
+
+    /**
+     * @brief Sets the line count known from indexing the file, so the gutter is sized before layout.
+     *        endLoad() clears it.
+     * @param lines Total number of lines of the file being loaded, 0 to rely on blockCount() only.
+     */
+    void setLineCountHint(int lines);
+
+    /**
+     * @brief Prepares the editor for a progressive load: clears it and makes it read-only without undo history.
+     */
+    void beginLoad();
+
+    /**
+     * @brief Appends text at the end of the document without moving the cursor or the view.
+     * @param text The text to append.
+     */
+    void appendText(const QString &text);
+
+    /**
+     * @brief Appends text at the end of the document as one edit, for follow mode. Lines beyond a limit
+     *        are dropped from the start in a second edit, so neither touches the blocks in between.
+     *        A view scrolled to the end stays at the end; any other view keeps showing the same lines.
+     * @param text The text to append.
+     * @param maxLines Most lines to keep, 0 for no limit.
+     */
+    void appendTail(const QString &text, int maxLines);
+
+    /**
+     * @brief Replaces whole lines as one edit, so only the lines touched are laid out and highlighted
+     *        again. The cursor stays on its text, and a change above the view does not scroll it.
+     * @param line Zero-based first line to replace.
+     * @param count Number of lines to replace, 0 to insert before line.
+     * @param text Replacement lines, each with its '\n' except possibly the last line of the document.
+     */
+    void replaceLines(int line, int count, const QString &text);
+
+    /**
+     * @brief Ends a progressive load, clears the line count hint and makes the editor writable again.
+     * @param loaded Piece table over the loaded file; it must hold the same text as the document.
+     */
+    void endLoad(const PieceTable &loaded = PieceTable());
+
+    /**
+     * @brief Returns the piece table holding the current text.
+     * @return Reference to the text buffer.
+     */
+    const PieceTable &textBuffer() const;
+
+    /**
+     * @brief Returns the on-disk format the document was loaded with.
+     * @return Encoding, byte order mark and line endings to save with.
+     */
+    TextFormat textFormat() const;
+
+    /**
+     * @brief Sets the on-disk format of the document.
+     * @param format Encoding, byte order mark and line endings to save with.
+     */
+    void setTextFormat(const TextFormat &format);
+
+    /**
+     * @brief Returns an immutable copy of the current text that may be read on any thread.
+     * @return O(1) snapshot of the text buffer.
+     */
+    PieceTable snapshot() const;
+
+    /**
+     * @brief Starts a batch of edits. Batches nest; only the outermost one takes effect.
+     *        Until endBatch(), the document collects all edits into one undo step and holds back
+     *        contentsChange, relayout, rehighlighting and gutter updates.
+     */
+    void beginBatch();
+
+    /**
+     * @brief Ends a batch of edits. Ending the outermost batch applies all its edits in one pass.
+     */
+    void endBatch();
+
+    /**
+     * @brief Returns whether a progressive load is filling the document.
+     * @return True between beginLoad() and endLoad(); the text buffer is not updated meanwhile.
+     */
+    bool isLoading() const;
+
+    /**
+     * @brief Returns the revision of the text, which changes with every edit and every load.
+     * @return The text revision.
+     */
+    quint64 textRevision() const;
+
+signals:
+    /**
+     * @brief Emitted when the text buffer is replaced as a whole rather than edited, e.g. at the end of a load.
+     */
+    void bufferReset();
+
 protected:
     /**
      * @brief Handles resizing of the editor widget and adjusts the line number area.
@@ -92,6 +318,44 @@ protected:
      */
     void resizeEvent(QResizeEvent *event) override;
 
+    /**
+     * @brief Rebuilds the gutter's digit atlas when the font changes.
+     * @param event The change event.
+     */
+    void changeEvent(QEvent *event) override;
+
+    /**
+     * @brief Paints the current line and the decoration backgrounds under the text, the long lines
+     *        QPlainTextEdit leaves blank, the markers of folded lines, and underlines and frames over the text.
+     * @param event The paint event.
+     */
+    void paintEvent(QPaintEvent *event) override;
+
+    /**
+     * @brief Moves the cursor up or down by column when the line it leaves or enters is a long line,
+     *        which QTextCursor cannot do without the line's layout.
+     * @param event The key event.
+     */
+    void keyPressEvent(QKeyEvent *event) override;
+
+    /**
+     * @brief Places the cursor by column when a long line is clicked.
+     * @param event The mouse event.
+     */
+    void mousePressEvent(QMouseEvent *event) override;
+
+    /**
+     * @brief Extends the selection by column while dragging over a long line.
+     * @param event The mouse event.
+     */
+    void mouseMoveEvent(QMouseEvent *event) override;
+
+    /**
+     * @brief Selects the word under the mouse when a long line is double-clicked.
+     * @param event The mouse event.
+     */
+    void mouseDoubleClickEvent(QMouseEvent *event) override;
+
 private slots:
     /**
      * @brief Updates the width of the line number area when the number of blocks changes.
@@ -111,14 +375,171 @@ private slots:
      */
     void updateLineNumberArea(const QRect &rect, int dy);
 
+    /**
+     * @brief Applies a document edit to the text buffer.
+     * @param position Position of the change.
+     * @param charsRemoved Number of characters removed.
+     * @param charsAdded Number of characters added.
+     */
+    void mirrorContentsChange(int position, int charsRemoved, int charsAdded);
+
+    /**
+     * @brief Moves the gutter markers after lines were inserted or removed.
+     * @param position Position of the change.
+     */
+    void shiftLineMarkers(int position);
+
+    /**
+     * @brief Moves the decorations after an edit.
+     * @param position Position of the change.
+     * @param charsRemoved Number of characters removed.
+     * @param charsAdded Number of characters added.
+     */
+    void moveDecorations(int position, int charsRemoved, int charsAdded);
+
+    /**
+     * @brief Scrolls a cursor on a long line into view and repaints its row; QPlainTextEdit only does
+     *        either for laid-out lines.
+     */
+    void ensureLongLineCursorVisible();
+
+    /**
+     * @brief Moves the fold regions after an edit and unfolds those whose hidden lines it touches.
+     * @param position Position of the change.
+     * @param charsRemoved Number of characters removed.
+     * @param charsAdded Number of characters added.
+     */
+    void moveFolds(int position, int charsRemoved, int charsAdded);
+
+    /**
+     * @brief Unfolds the regions hiding the cursor's line, e.g. after a search or a jump moved it there.
+     */
+    void revealCursorLine();
+
 private:
+    static constexpr int SegmentColumns = 256; ///< Columns of a long line drawn with one drawText() call.
+
+    LongLineLayout *longLines; ///< Layout of the document, which leaves long lines unshaped.
     QWidget *lineNumberArea; ///< Widget for displaying line numbers.
     ISyntaxHighlighter *syntaxHighlighter; ///< The syntax highlighter used by the editor.
     QString filePath; ///< Path of the currently opened file.
+    int lineCountHint = 0; ///< Line count reported by the LineIndex of the loaded file.
+    PieceTable buffer; ///< Piece table mirroring the document text.
+    bool mirrorSuspended = false; ///< True while a progressive load fills the document.
+    TextFormat format; ///< On-disk format of the current file.
+    QTextCursor batchCursor; ///< Cursor holding the document's edit block during a batch.
+    int batchDepth = 0; ///< Nesting depth of beginBatch() calls.
+    quint64 revision = 0; ///< Incremented whenever the text changes.
+    GutterRenderer gutter; ///< Cached renderer of the line number area.
+    int gutterWidth = -1; ///< Width the viewport margin was last set to.
+    bool relativeNumbers = false; ///< True to number lines relative to the cursor.
+    int currentLine = -1; ///< Cursor line last shown in the gutter.
+    QMap<int, GutterRenderer::Marker> lineMarkers; ///< Gutter markers by 0-based line.
+    int markerBlockCount = 1; ///< Block count when the markers were last moved.
+    DecorationTree decorations; ///< Decorated ranges by document position.
+    QVector<DecorationStyle> decorationStyles; ///< Distinct styles, indexed by Decoration::style.
+    QHash<QString, quint32> decorationGroups; ///< Group identifiers by name.
+    quint32 nextDecorationId = 1; ///< Identifier of the next decoration.
+    FoldTree folds; ///< Foldable regions by first line.
+    int foldBlockCount = 1; ///< Block count when the fold regions were last moved.
 
     /**
      * @brief Computes the width of the line number area.
      * @return The width in pixels.
      */
     int lineNumberAreaWidth();
+
+    /**
+     * @brief Returns the gutter rectangle of a line.
+     * @param line 0-based line number.
+     * @return The line's row in gutter coordinates, or an empty rectangle if the line does not exist.
+     */
+    QRect gutterRowRect(int line);
+
+    /**
+     * @brief Paints the decorations of the visible lines.
+     * @param painter Painter on the viewport.
+     * @param area Area to repaint.
+     * @param overText False for what goes under the text, true for what goes over it.
+     */
+    void paintDecorations(QPainter &painter, const QRect &area, bool overText);
+
+    /**
+     * @brief Paints the visible columns of the long lines, with their selection and the cursor.
+     * @param painter Painter on the viewport.
+     * @param area Area to repaint.
+     */
+    void paintLongLines(QPainter &painter, const QRect &area);
+
+    /**
+     * @brief Paints a marker after the first line of every visible folded region.
+     * @param painter Painter on the viewport.
+     * @param area Area to repaint.
+     */
+    void paintFoldMarkers(QPainter &painter, const QRect &area);
+
+    /**
+     * @brief Returns the viewport x of a column of a long line.
+     * @param column The column.
+     * @return Left edge of the column.
+     */
+    qreal longLineX(int column) const;
+
+    /**
+     * @brief Returns the columns of a long line that are inside an area of the viewport.
+     * @param area Area of the viewport.
+     * @param length Length of the line.
+     * @return First column and the column after the last one, both clamped to [0, length].
+     */
+    QPair<int, int> longLineColumns(const QRect &area, int length) const;
+
+    /**
+     * @brief Moves the cursor to the column under a point if the point is on a long line.
+     * @param pos Point in viewport coordinates.
+     * @param mode Whether to keep the anchor, extending the selection.
+     * @return True if the point was on a long line.
+     */
+    bool moveCursorInLongLine(const QPoint &pos, QTextCursor::MoveMode mode);
+
+    /**
+     * @brief Returns the block painted after a block, jumping over the lines of a folded region
+     *        instead of stepping through them.
+     * @param block A visible block.
+     * @return The next block, which may still be hidden if it is not in a region starting on block.
+     */
+    QTextBlock nextShownBlock(const QTextBlock &block) const;
+
+    /**
+     * @brief Returns the first line of the outermost folded region hiding a line.
+     * @param line 0-based line number.
+     * @return The region's first line, or line itself if it is not hidden.
+     */
+    int foldHeader(int line) const;
+
+    /**
+     * @brief Moves a cursor hidden in a folded region to the end of the region's first line.
+     */
+    void moveCursorOutOfFolds();
+
+    /**
+     * @brief Folds or unfolds a region, hiding or showing its lines.
+     * @param region The region, with its lines as in the tree.
+     * @param collapsed True to fold it.
+     */
+    void setRegionCollapsed(const FoldRegion &region, bool collapsed);
+
+    /**
+     * @brief Shows the lines of a region, except those of the folded regions inside it.
+     * @param region The region.
+     */
+    void showRegion(const FoldRegion &region);
+
+    /**
+     * @brief Shows or hides a range of lines. Each block of the range is visited once, O(last - first),
+     *        and the layout is told once for the whole range.
+     * @param first First line.
+     * @param last Last line; nothing happens if it is before first.
+     * @param visible True to show the lines.
+     */
+    void setLinesVisible(int first, int last, bool visible);
 };
@@ -0,0 +1,110 @@
+/**
+ * @file FileFollower.cpp
+ * @brief Implementation of the FileFollower class for Coda.
+ * @author Dario Romandini
+ */
+
+#include "FileFollower.h"
+#include <QFile>
+#include <QTextCodec>
+#include <QTextDecoder>
+
+FileFollower::FileFollower(QObject *parent) : QObject(parent) {
+    pollTimer.setInterval(PollIntervalMs);
+    connect(&pollTimer, &QTimer::timeout, this, &FileFollower::poll);
+    connect(&watcher, &QFileSystemWatcher::fileChanged, this, &FileFollower::poll);
+}
+
+FileFollower::~FileFollower() = default;
+
+void FileFollower::follow(const QString &filePath, qint64 start, const TextFormat &textFormat) {
+    stop();
+    path = filePath;
+    format = textFormat;
+    rewind(start);
+    watcher.addPath(path);
+    pollTimer.start();
+    // Catch up with whatever was written since the file was loaded.
+    poll();
+}
+
+void FileFollower::stop() {
+    path.clear();
+    pollTimer.stop();
+    if (!watcher.files().isEmpty()) {
+        watcher.removePaths(watcher.files());
+    }
+    decoder.reset();
+}
+
+bool FileFollower::isFollowing() const {
+    return !path.isEmpty();
+}
+
+qint64 FileFollower::position() const {
+    return offset;
+}
+
+void FileFollower::rewind(qint64 start) {
+    offset = start;
+    carriageReturn = false;
+    QTextCodec *codec = QTextCodec::codecForName(format.codec);
+    decoder.reset((codec ? codec : QTextCodec::codecForLocale())->makeDecoder());
+
+    QFile file(path);
+    fingerprint = file.open(QIODevice::ReadOnly) ? file.read(qMin(start, FingerprintSize)) : QByteArray();
+}
+
+void FileFollower::poll() {
+    if (path.isEmpty()) {
+        return;
+    }
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        // Rotated away and not recreated yet: keep polling until it is.
+        return;
+    }
+    // A file replaced by rename is a new inode, which the watcher no longer watches.
+    if (!watcher.files().contains(path)) {
+        watcher.addPath(path);
+    }
+
+    qint64 size = file.size();
+    if (size < offset || (!fingerprint.isEmpty() && file.read(fingerprint.size()) != fingerprint)) {
+        rewind(0);
+        emit reset();
+        if (path.isEmpty()) {
+            return;
+        }
+    }
+    if (size <= offset || !file.seek(offset)) {
+        return;
+    }
+
+    QByteArray bytes = file.read(qMin(ReadSize, size - offset));
+    offset += bytes.size();
+    if (fingerprint.size() < FingerprintSize && file.seek(0)) {
+        fingerprint = file.read(qMin(offset, FingerprintSize));
+    }
+
+    // Line endings are normalized like FileLoader does; a "\r\n" split between two reads stays one break.
+    QString text = decoder->toUnicode(bytes);
+    if (carriageReturn) {
+        text.prepend(QLatin1Char('\r'));
+        carriageReturn = false;
+    }
+    if (text.endsWith(QLatin1Char('\r'))) {
+        text.chop(1);
+        carriageReturn = true;
+    }
+    text.replace(QLatin1String("\r\n"), QLatin1String("\n"));
+    text.replace(QLatin1Char('\r'), QLatin1Char('\n'));
+    if (!text.isEmpty()) {
+        emit appended(text);
+    }
+
+    // Read the rest of a large burst after the UI has caught up with this slice.
+    if (offset < size && !path.isEmpty()) {
+        QMetaObject::invokeMethod(this, &FileFollower::poll, Qt::QueuedConnection);
+    }
+}
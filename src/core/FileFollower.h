@@ -0,0 +1,104 @@
+/**
+ * @file FileFollower.h
+ * @brief Follow mode (tail -f) for the Coda text editor.
+ *        Watches a growing file and reads only the bytes written past the last offset. A file that
+ *        shrinks, or whose first bytes change because it was rotated, is followed again from its start.
+ * @author Dario Romandini
+ */
+
+#pragma once
+
+#include <QByteArray>
+#include <QFileSystemWatcher>
+#include <QObject>
+#include <QString>
+#include <QTimer>
+#include <memory>
+
+#include "TextFormat.h"
+
+class QTextDecoder;
+
+/**
+ * @class FileFollower
+ * @brief Follows one file at a time. Appends are usually small, so they are read on the follower's
+ *        thread; a large burst is read a slice at a time with the event loop running in between.
+ */
+class FileFollower : public QObject {
+    Q_OBJECT
+
+public:
+    /**
+     * @brief Constructor for FileFollower.
+     * @param parent Optional parent object.
+     */
+    explicit FileFollower(QObject *parent = nullptr);
+
+    /**
+     * @brief Destructor.
+     */
+    ~FileFollower() override;
+
+    /**
+     * @brief Starts following a file, stopping any file followed before.
+     * @param path Path of the file.
+     * @param offset Bytes already shown; reading starts there.
+     * @param format Encoding of the file.
+     */
+    void follow(const QString &path, qint64 offset, const TextFormat &format);
+
+    /**
+     * @brief Stops following.
+     */
+    void stop();
+
+    /**
+     * @brief Returns whether a file is followed.
+     * @return True between follow() and stop().
+     */
+    bool isFollowing() const;
+
+    /**
+     * @brief Returns the offset up to which the file has been read.
+     * @return Bytes read, counting those shown before following started.
+     */
+    qint64 position() const;
+
+signals:
+    /**
+     * @brief Emitted with text appended to the file, decoded and with LF line endings.
+     * @param text The new text.
+     */
+    void appended(const QString &text);
+
+    /**
+     * @brief Emitted when the file was truncated or replaced. The new contents follow as appended text.
+     */
+    void reset();
+
+private slots:
+    /**
+     * @brief Reads what was appended since the last check, or starts over if the file was rotated.
+     */
+    void poll();
+
+private:
+    static constexpr int PollIntervalMs = 500;     ///< Checks made even without change notifications.
+    static constexpr qint64 ReadSize = 1024 * 1024; ///< Most bytes read in one go.
+    static constexpr qint64 FingerprintSize = 256;  ///< Leading bytes compared to detect rotation.
+
+    /**
+     * @brief Restarts decoding, and remembers the first bytes of the file, for reading from a new offset.
+     * @param start Offset to read from.
+     */
+    void rewind(qint64 start);
+
+    QString path;                          ///< File being followed, empty when stopped.
+    qint64 offset = 0;                     ///< Bytes read so far.
+    TextFormat format;                     ///< Encoding of the file.
+    std::unique_ptr<QTextDecoder> decoder; ///< Keeps characters split between two reads.
+    QByteArray fingerprint;                ///< First bytes of the file, to notice it being replaced.
+    bool carriageReturn = false;           ///< True if the last text read ended with a held back '\r'.
+    QFileSystemWatcher watcher;            ///< Reports writes to the file.
+    QTimer pollTimer;                      ///< Polls when notifications are missed or unavailable.
+};
@@ -0,0 +1,214 @@
+/**
+ * @file FileLoader.cpp
+ * @brief Implementation of the FileLoader class for Coda. The worker posts every result back to the
+ *        loader's thread, where it is dropped if the load it belongs to is no longer current.
+ * @author Dario Romandini
+ */
+
+#include "FileLoader.h"
+#include "LineIndex.h"
+#include "Utf8.h"
+#include <QFile>
+#include <QTextCodec>
+#include <QTextDecoder>
+#include <climits>
+#include <cstring>
+
+FileLoader::FileLoader(QObject *parent) : QObject(parent) {}
+
+FileLoader::~FileLoader() {
+    stopWorker();
+}
+
+void FileLoader::load(const QString &path) {
+    cancel();
+    stopWorker();
+
+    current = std::make_shared<LoadState>();
+    current->path = path;
+    worker = std::thread(&FileLoader::run, this, current);
+}
+
+void FileLoader::cancel() {
+    if (!current) {
+        return;
+    }
+    QString path = current->path;
+    stopWorker();
+    emit cancelled(path);
+}
+
+bool FileLoader::isLoading() const {
+    return current != nullptr;
+}
+
+void FileLoader::stopWorker() {
+    if (current) {
+        current->cancelled = true;
+        current->credits.release(MaxChunksInFlight);
+        current.reset();
+    }
+    if (worker.joinable()) {
+        worker.join();
+    }
+}
+
+void FileLoader::run(std::shared_ptr<LoadState> state) {
+    // Results are delivered on the loader's thread and ignored once a newer load has started.
+    auto post = [this, state](auto &&deliver) {
+        QMetaObject::invokeMethod(this, [this, state, deliver] {
+            if (state == current) {
+                deliver();
+            }
+        }, Qt::QueuedConnection);
+    };
+
+    // The bytes are read rather than mapped: the piece table of a clean file keeps them, and a shared
+    // mapping of the user's file would change, or fault, when another program rewrites it.
+    QFile file(state->path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        post([this, state] {
+            current.reset();
+            emit failed(state->path);
+        });
+        return;
+    }
+
+    QByteArray bytes = file.readAll();
+    file.close();
+    const char *data = bytes.constData();
+    qint64 size = bytes.size();
+
+    LineIndex index;
+    index.build(data, static_cast<std::size_t>(size), 1024);
+    int lineCount = static_cast<int>(qMin<std::size_t>(index.lineCount(), INT_MAX));
+    post([this, state, lineCount] { emit started(state->path, lineCount); });
+
+    TextFormat format;
+    qint64 bom = detectByteOrderMark(data, size, format);
+    bool valid = format.byteOrderMark ? format.codec == "UTF-8" && Utf8::isValid(data + bom, size - bom)
+                                      : detectEncoding(data, size, format);
+    QTextCodec *codec = QTextCodec::codecForName(format.codec);
+    format.codec = codec->name();
+    // Valid UTF-8 is transcoded directly; anything else goes through the codec.
+    std::unique_ptr<QTextDecoder> decoder(valid ? nullptr : codec->makeDecoder(QTextCodec::IgnoreHeader));
+
+    // The bytes read can back the piece table directly only if they decode 1:1 to what the document
+    // holds; otherwise the piece table is built from the decoded chunks, with line breaks normalized to "\n".
+    bool utf8 = codec->mibEnum() == 106;
+    bool clean = valid && (size == 0 || !std::memchr(data, '\r', static_cast<size_t>(size)));
+    QByteArray normalized;
+    qint64 newlines = 0;
+    qint64 crlfs = 0;
+
+    QString carry;
+    qint64 offset = bom;
+    qint64 chunk = FirstChunkSize;
+    while (offset < size) {
+        qint64 length = qMin(chunk, size - offset);
+        QString text;
+        if (valid) {
+            if (offset + length < size) {
+                length = Utf8::completeLength(data + offset, length);
+            }
+            text.resize(static_cast<int>(length));
+            text.resize(static_cast<int>(Utf8::toUtf16(data + offset, length, text.data())));
+            text.prepend(carry);
+        } else {
+            text = carry + decoder->toUnicode(data + offset, static_cast<int>(length));
+        }
+        carry.clear();
+        offset += length;
+        chunk = ChunkSize;
+
+        // A "\r\n" split across two chunks would otherwise become two block separators.
+        if (offset < size && text.endsWith(QLatin1Char('\r'))) {
+            text.chop(1);
+            carry = QStringLiteral("\r");
+        }
+        if (!clean) {
+            QString lines = text;
+            if (!utf8) {
+                newlines += lines.count(QLatin1Char('\n'));
+                crlfs += lines.count(QLatin1String("\r\n"));
+            }
+            lines.replace(QLatin1String("\r\n"), QLatin1String("\n"));
+            lines.replace(QLatin1Char('\r'), QLatin1Char('\n'));
+            normalized += lines.toUtf8();
+        }
+
+        state->credits.acquire();
+        if (state->cancelled) {
+            return;
+        }
+        post([this, state, text, offset, size] {
+            emit chunkLoaded(text);
+            emit progress(offset, size);
+            state->credits.release();
+        });
+    }
+
+    if (utf8) {
+        // Mixed files cannot be written back line by line; they are saved with LF.
+        format.lineEnding = index.lineEnding() == LineEnding::CRLF ? LineEnding::CRLF : LineEnding::LF;
+    } else {
+        format.lineEnding = newlines > 0 && crlfs == newlines ? LineEnding::CRLF : LineEnding::LF;
+    }
+    PieceTable buffer = clean ? PieceTable::fromUtf8(bytes, bom) : PieceTable::fromUtf8(normalized);
+
+    post([this, state, buffer, format] {
+        current.reset();
+        emit finished(state->path, buffer, format);
+    });
+}
+
+qint64 FileLoader::detectByteOrderMark(const char *data, qint64 size, TextFormat &format) {
+    struct Mark {
+        const char *bytes;
+        qint64 length;
+        const char *codec;
+    };
+    // UTF-32LE must be tested before UTF-16LE, whose mark is its prefix.
+    static const Mark marks[] = {
+        {"\xEF\xBB\xBF", 3, "UTF-8"},
+        {"\xFF\xFE\x00\x00", 4, "UTF-32LE"},
+        {"\x00\x00\xFE\xFF", 4, "UTF-32BE"},
+        {"\xFF\xFE", 2, "UTF-16LE"},
+        {"\xFE\xFF", 2, "UTF-16BE"},
+    };
+    for (const Mark &mark : marks) {
+        if (size >= mark.length && std::memcmp(data, mark.bytes, static_cast<size_t>(mark.length)) == 0) {
+            format.codec = mark.codec;
+            format.byteOrderMark = true;
+            return mark.length;
+        }
+    }
+    return 0;
+}
+
+bool FileLoader::detectEncoding(const char *data, qint64 size, TextFormat &format) {
+    // ASCII characters in UTF-16 have a zero byte in every other position, which byte encodings never do.
+    if (size >= 2 && size % 2 == 0) {
+        qint64 pairs = qMin(size, SniffSize) / 2;
+        qint64 evenZeros = 0;
+        qint64 oddZeros = 0;
+        for (qint64 i = 0; i < pairs; ++i) {
+            evenZeros += data[2 * i] == 0;
+            oddZeros += data[2 * i + 1] == 0;
+        }
+        if (oddZeros * 2 > pairs && evenZeros * 20 < pairs) {
+            format.codec = "UTF-16LE";
+            return false;
+        }
+        if (evenZeros * 2 > pairs && oddZeros * 20 < pairs) {
+            format.codec = "UTF-16BE";
+            return false;
+        }
+    }
+    if (Utf8::isValid(data, size)) {
+        format.codec = "UTF-8";
+        return true;
+    }
+    format.codec = "ISO-8859-1";
+    return false;
+}
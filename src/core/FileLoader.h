@@ -0,0 +1,150 @@
+/**
+ * @file FileLoader.h
+ * @brief Background file loader for the Coda text editor.
+ *        Maps and decodes a file on a worker thread and hands it to the UI thread in chunks,
+ *        so the event loop keeps running while large files stream into the editor.
+ *        When done it also provides the PieceTable that backs the loaded document.
+ * @author Dario Romandini
+ */
+
+#pragma once
+
+#include <QObject>
+#include <QSemaphore>
+#include <QString>
+#include <atomic>
+#include <memory>
+#include <thread>
+
+#include "PieceTable.h"
+#include "TextFormat.h"
+
+/**
+ * @class FileLoader
+ * @brief Loads one file at a time on a worker thread and reports it chunk by chunk.
+ *        All signals are emitted on the thread the loader lives in. Starting a new load or calling
+ *        cancel() stops the previous one; chunks it had already queued are dropped.
+ */
+class FileLoader : public QObject {
+    Q_OBJECT
+
+public:
+    /**
+     * @brief Constructor for FileLoader.
+     * @param parent Optional parent object.
+     */
+    explicit FileLoader(QObject *parent = nullptr);
+
+    /**
+     * @brief Destructor. Cancels a running load and waits for the worker thread.
+     */
+    ~FileLoader() override;
+
+    /**
+     * @brief Starts loading a file, cancelling any load in progress.
+     * @param path Path of the file to load.
+     */
+    void load(const QString &path);
+
+    /**
+     * @brief Cancels the current load. Emits cancelled() if a load was running.
+     */
+    void cancel();
+
+    /**
+     * @brief Returns whether a load is in progress.
+     * @return True between load() and finished(), failed() or cancelled().
+     */
+    bool isLoading() const;
+
+signals:
+    /**
+     * @brief Emitted once the file is read and indexed, before the first chunk.
+     * @param path The file being loaded.
+     * @param lineCount Total number of lines in the file.
+     */
+    void started(const QString &path, int lineCount);
+
+    /**
+     * @brief Emitted for every decoded chunk, in file order.
+     * @param text The decoded text of the chunk.
+     */
+    void chunkLoaded(const QString &text);
+
+    /**
+     * @brief Emitted after every chunk.
+     * @param bytesRead Bytes decoded so far.
+     * @param totalBytes Size of the file.
+     */
+    void progress(qint64 bytesRead, qint64 totalBytes);
+
+    /**
+     * @brief Emitted after the last chunk.
+     * @param path The file that was loaded.
+     * @param buffer Piece table over the file, sharing the bytes read when they are clean UTF-8.
+     * @param format Detected encoding, byte order mark and line endings of the file.
+     */
+    void finished(const QString &path, const PieceTable &buffer, const TextFormat &format);
+
+    /**
+     * @brief Emitted if the file could not be opened.
+     * @param path The file that failed to load.
+     */
+    void failed(const QString &path);
+
+    /**
+     * @brief Emitted when a running load is cancelled.
+     * @param path The file whose load was cancelled.
+     */
+    void cancelled(const QString &path);
+
+private:
+    static constexpr qint64 FirstChunkSize = 64 * 1024; ///< Small first chunk so the first screen appears at once.
+    static constexpr qint64 ChunkSize = 1024 * 1024;    ///< Size of every following chunk.
+    static constexpr int MaxChunksInFlight = 4;         ///< Chunks the worker may queue ahead of the UI thread.
+    static constexpr qint64 SniffSize = 4096;           ///< Bytes looked at to recognize UTF-16 without a mark.
+
+    /**
+     * @struct LoadState
+     * @brief State shared between the UI thread and the worker of one load.
+     */
+    struct LoadState {
+        QString path;                          ///< The file being loaded.
+        std::atomic_bool cancelled{false};     ///< Set by the UI thread to stop the worker.
+        QSemaphore credits{MaxChunksInFlight}; ///< Limits how far the worker runs ahead of the UI thread.
+    };
+
+    /**
+     * @brief Worker thread body: maps, indexes and decodes the file.
+     * @param state State of the load this worker belongs to.
+     */
+    void run(std::shared_ptr<LoadState> state);
+
+    /**
+     * @brief Detects a Unicode byte order mark at the start of a file.
+     * @param data First bytes of the file.
+     * @param size Size of the file.
+     * @param format Receives the codec name and byteOrderMark flag when a mark is found.
+     * @return Length of the mark in bytes, 0 if there is none.
+     */
+    static qint64 detectByteOrderMark(const char *data, qint64 size, TextFormat &format);
+
+    /**
+     * @brief Detects the encoding of a file without a byte order mark. UTF-16 is recognized by the zero
+     *        bytes of its ASCII characters; otherwise valid UTF-8 is UTF-8 and anything else is read as
+     *        Latin-1, which maps every byte to a character and so saves back unchanged.
+     * @param data Bytes of the file.
+     * @param size Size of the file.
+     * @param format Receives the codec name.
+     * @return True if the file is valid UTF-8.
+     */
+    static bool detectEncoding(const char *data, qint64 size, TextFormat &format);
+
+    /**
+     * @brief Stops the worker thread and waits for it.
+     */
+    void stopWorker();
+
+    std::thread worker;                 ///< Thread running the current load.
+    std::shared_ptr<LoadState> current; ///< State of the current load, null when idle.
+};
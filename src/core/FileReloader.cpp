@@ -0,0 +1,261 @@
+/**
+ * @file FileReloader.cpp
+ * @brief Implementation of the FileReloader class for Coda. Lines are compared by hash with Myers'
+ *        O(ND) algorithm after the common head and tail are trimmed, so the cost follows the size of
+ *        the change rather than the size of the file.
+ * @author Dario Romandini
+ */
+
+#include "FileReloader.h"
+#include <QFile>
+#include <QTextCodec>
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+/**
+ * @struct Span
+ * @brief Lines [oldStart, oldStart + oldCount) of the old text replaced by [newStart, newStart + newCount) of the new.
+ */
+struct Span {
+    int oldStart;
+    int oldCount;
+    int newStart;
+    int newCount;
+};
+
+/**
+ * @brief Hashes the lines of UTF-8 text, each with its '\n'; a last line without one counts as a line.
+ */
+std::vector<std::size_t> hashLines(const char *data, std::size_t size, std::vector<std::size_t> *starts) {
+    std::vector<std::size_t> hashes;
+    std::hash<std::string_view> hash;
+    std::size_t start = 0;
+    while (start < size) {
+        const void *newline = std::memchr(data + start, '\n', size - start);
+        std::size_t end = newline ? static_cast<const char *>(newline) - data + 1 : size;
+        hashes.push_back(hash(std::string_view(data + start, end - start)));
+        if (starts) {
+            starts->push_back(start);
+        }
+        start = end;
+    }
+    if (starts) {
+        starts->push_back(size);
+    }
+    return hashes;
+}
+
+/**
+ * @brief Returns the spans that turn the old lines into the new ones. Gives up on a minimal diff and
+ *        returns the untrimmed middle as one span past maxDistance edits.
+ * @return Spans in ascending order, or nothing if cancelled.
+ */
+std::vector<Span> diffLines(const std::vector<std::size_t> &a, const std::vector<std::size_t> &b, int maxDistance,
+                            const std::atomic_bool &cancelled) {
+    int head = 0;
+    int aEnd = static_cast<int>(a.size());
+    int bEnd = static_cast<int>(b.size());
+    while (head < aEnd && head < bEnd && a[head] == b[head]) {
+        ++head;
+    }
+    while (aEnd > head && bEnd > head && a[aEnd - 1] == b[bEnd - 1]) {
+        --aEnd;
+        --bEnd;
+    }
+    int n = aEnd - head;
+    int m = bEnd - head;
+    if (n == 0 && m == 0) {
+        return {};
+    }
+    if (n == 0 || m == 0) {
+        return {{head, n, head, m}};
+    }
+
+    // Furthest x reached on each diagonal k = x - y, kept for every edit count d to walk the path back.
+    int limit = std::min(maxDistance, n + m);
+    std::vector<int> v(2 * limit + 3, 0);
+    int offset = limit + 1;
+    std::vector<std::vector<int>> trace;
+    int distance = -1;
+    for (int d = 0; d <= limit && distance < 0; ++d) {
+        if (cancelled) {
+            return {};
+        }
+        for (int k = -d; k <= d; k += 2) {
+            bool down = k == -d || (k != d && v[offset + k - 1] < v[offset + k + 1]);
+            int x = down ? v[offset + k + 1] : v[offset + k - 1] + 1;
+            int y = x - k;
+            while (x < n && y < m && a[head + x] == b[head + y]) {
+                ++x;
+                ++y;
+            }
+            v[offset + k] = x;
+            if (x >= n && y >= m) {
+                distance = d;
+                break;
+            }
+        }
+        trace.emplace_back(v.begin() + offset - d, v.begin() + offset + d + 1);
+    }
+    if (distance < 0) {
+        return {{head, n, head, m}};
+    }
+
+    // Walk back from the end, recording every step that is not a match.
+    std::vector<std::pair<int, int>> edits; // (x, y) before a deletion (y < 0 marks it) or an insertion
+    int x = n;
+    int y = m;
+    for (int d = distance; d > 0; --d) {
+        const std::vector<int> &previous = trace[d - 1];
+        int k = x - y;
+        auto at = [&](int diagonal) { return previous[diagonal + d - 1]; };
+        bool down = k == -d || (k != d && at(k - 1) < at(k + 1));
+        int previousK = down ? k + 1 : k - 1;
+        int previousX = at(previousK);
+        int previousY = previousX - previousK;
+        if (down) {
+            edits.emplace_back(previousX, previousY); // inserts b[previousY]
+        } else {
+            edits.emplace_back(previousX, -1 - previousY); // deletes a[previousX]
+        }
+        x = previousX;
+        y = previousY;
+    }
+
+    // Adjacent edits, in forward order, form one span.
+    std::vector<Span> spans;
+    for (auto edit = edits.rbegin(); edit != edits.rend(); ++edit) {
+        bool insertion = edit->second >= 0;
+        int ex = edit->first;
+        int ey = insertion ? edit->second : -1 - edit->second;
+        if (!spans.empty()) {
+            Span &last = spans.back();
+            if (last.oldStart + last.oldCount == head + ex && last.newStart + last.newCount == head + ey) {
+                ++(insertion ? last.newCount : last.oldCount);
+                continue;
+            }
+        }
+        spans.push_back({head + ex, insertion ? 0 : 1, head + ey, insertion ? 1 : 0});
+    }
+    return spans;
+}
+
+} // namespace
+
+FileReloader::FileReloader(QObject *parent) : QObject(parent) {
+    settleTimer.setSingleShot(true);
+    settleTimer.setInterval(SettleDelayMs);
+    connect(&watcher, &QFileSystemWatcher::fileChanged, this, [this] {
+        // Saving through a rename replaces the file, which drops it from the watcher.
+        if (!path.isEmpty() && !watcher.files().contains(path) && QFile::exists(path)) {
+            watcher.addPath(path);
+        }
+        settleTimer.start();
+    });
+    connect(&settleTimer, &QTimer::timeout, this, [this] {
+        if (!path.isEmpty() && !watcher.files().contains(path) && QFile::exists(path)) {
+            watcher.addPath(path);
+        }
+        if (!path.isEmpty() && QFile::exists(path)) {
+            emit changed(path);
+        }
+    });
+}
+
+FileReloader::~FileReloader() {
+    stopWorker();
+}
+
+void FileReloader::watch(const QString &filePath) {
+    stop();
+    path = filePath;
+    watcher.addPath(path);
+}
+
+void FileReloader::stop() {
+    stopWorker();
+    settleTimer.stop();
+    if (!watcher.files().isEmpty()) {
+        watcher.removePaths(watcher.files());
+    }
+    path.clear();
+}
+
+void FileReloader::diff(const PieceTable &text, quint64 revision, const TextFormat &format) {
+    stopWorker();
+    if (path.isEmpty()) {
+        return;
+    }
+    current = std::make_shared<DiffState>();
+    current->path = path;
+    current->text = text;
+    current->revision = revision;
+    current->format = format;
+    worker = std::thread(&FileReloader::run, this, current);
+}
+
+void FileReloader::stopWorker() {
+    if (current) {
+        current->cancelled = true;
+        current.reset();
+    }
+    if (worker.joinable()) {
+        worker.join();
+    }
+}
+
+void FileReloader::run(std::shared_ptr<DiffState> state) {
+    // Read rather than mapped: the program that changed the file may still be rewriting it, and a
+    // mapping faults on pages past a shrinking end.
+    QFile file(state->path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return;
+    }
+    QByteArray bytes = file.readAll();
+    file.close();
+    // Decode the way FileLoader does, so unchanged lines compare equal to what the editor holds.
+    // Without a state argument the codec drops a byte order mark.
+    QTextCodec *codec = QTextCodec::codecForName(state->format.codec);
+    QString decoded = (codec ? codec : QTextCodec::codecForLocale())->toUnicode(bytes);
+    bytes.clear();
+    decoded.replace(QLatin1String("\r\n"), QLatin1String("\n"));
+    decoded.replace(QLatin1Char('\r'), QLatin1Char('\n'));
+    QByteArray disk = decoded.toUtf8();
+    decoded.clear();
+    std::string memory = state->text.toStdString();
+    if (state->cancelled) {
+        return;
+    }
+
+    std::vector<std::size_t> diskStarts;
+    std::vector<std::size_t> diskLines = hashLines(disk.constData(), static_cast<std::size_t>(disk.size()), &diskStarts);
+    std::vector<std::size_t> memoryLines = hashLines(memory.data(), memory.size(), nullptr);
+    std::vector<Span> spans = diffLines(memoryLines, diskLines, MaxEditDistance, state->cancelled);
+    if (state->cancelled) {
+        return;
+    }
+
+    QVector<LineHunk> hunks;
+    hunks.reserve(static_cast<int>(spans.size()));
+    for (const Span &span : spans) {
+        LineHunk hunk;
+        hunk.line = span.oldStart;
+        hunk.removed = span.oldCount;
+        std::size_t from = diskStarts[span.newStart];
+        std::size_t to = diskStarts[span.newStart + span.newCount];
+        hunk.text = QString::fromUtf8(disk.constData() + from, static_cast<int>(to - from));
+        hunks.append(hunk);
+    }
+
+    QMetaObject::invokeMethod(this, [this, state, hunks] {
+        if (state == current) {
+            current.reset();
+            emit diffed(state->path, state->revision, hunks);
+        }
+    }, Qt::QueuedConnection);
+}
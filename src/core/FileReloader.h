@@ -0,0 +1,121 @@
+/**
+ * @file FileReloader.h
+ * @brief External change reload for the Coda text editor.
+ *        Watches the open file and, when it changes on disk, diffs it line by line against a snapshot of
+ *        the editor text on a worker thread. The result is a list of hunks, so that only the lines that
+ *        differ are replaced and the rest of the document keeps its layout, highlighting and undo history.
+ * @author Dario Romandini
+ */
+
+#pragma once
+
+#include <QFileSystemWatcher>
+#include <QObject>
+#include <QString>
+#include <QTimer>
+#include <QVector>
+#include <atomic>
+#include <memory>
+#include <thread>
+
+#include "PieceTable.h"
+#include "TextFormat.h"
+
+/**
+ * @struct LineHunk
+ * @brief Lines of the editor text to replace with lines of the file on disk.
+ */
+struct LineHunk {
+    int line = 0;    ///< Zero-based first line of the editor text.
+    int removed = 0; ///< Number of lines replaced, 0 for a pure insertion.
+    QString text;    ///< New lines, each with its '\n' except possibly the last line of the file.
+};
+
+/**
+ * @class FileReloader
+ * @brief Watches one file and runs one diff at a time. All signals are emitted on the thread the
+ *        reloader lives in; starting a new diff or calling stop() drops the result of the previous one.
+ */
+class FileReloader : public QObject {
+    Q_OBJECT
+
+public:
+    static constexpr int MaxEditDistance = 2000; ///< Beyond this many changed lines the diff is one hunk.
+
+    /**
+     * @brief Constructor for FileReloader.
+     * @param parent Optional parent object.
+     */
+    explicit FileReloader(QObject *parent = nullptr);
+
+    /**
+     * @brief Destructor. Cancels a running diff and waits for the worker thread.
+     */
+    ~FileReloader() override;
+
+    /**
+     * @brief Starts watching a file, replacing the file watched before.
+     * @param path Path of the file.
+     */
+    void watch(const QString &path);
+
+    /**
+     * @brief Stops watching and cancels a running diff.
+     */
+    void stop();
+
+    /**
+     * @brief Starts diffing the watched file against a snapshot, cancelling a diff in progress.
+     * @param text Snapshot of the editor text.
+     * @param revision Editor revision of the snapshot, passed back with the result.
+     * @param format Encoding of the file on disk.
+     */
+    void diff(const PieceTable &text, quint64 revision, const TextFormat &format);
+
+signals:
+    /**
+     * @brief Emitted once writes to the watched file have settled.
+     * @param path The file that changed.
+     */
+    void changed(const QString &path);
+
+    /**
+     * @brief Emitted when a diff is complete.
+     * @param path The file that was diffed.
+     * @param revision Revision of the snapshot it was diffed against.
+     * @param hunks Changes in ascending line order; empty if the file matches the snapshot.
+     */
+    void diffed(const QString &path, quint64 revision, const QVector<LineHunk> &hunks);
+
+private:
+    static constexpr int SettleDelayMs = 200; ///< Quiet time after a change, so multi-step writes are read once.
+
+    /**
+     * @struct DiffState
+     * @brief State shared between the UI thread and the worker of one diff.
+     */
+    struct DiffState {
+        QString path;                      ///< File to read.
+        PieceTable text;                   ///< Snapshot to diff against.
+        quint64 revision = 0;              ///< Revision of the snapshot.
+        TextFormat format;                 ///< Encoding of the file.
+        std::atomic_bool cancelled{false}; ///< Set by the UI thread to stop the worker.
+    };
+
+    /**
+     * @brief Worker thread body: reads the file, diffs it and posts the hunks.
+     * @param state State of the diff this worker belongs to.
+     */
+    void run(std::shared_ptr<DiffState> state);
+
+    /**
+     * @brief Stops the worker thread and waits for it.
+     */
+    void stopWorker();
+
+    QString path;                       ///< File being watched, empty when stopped.
+    QFileSystemWatcher watcher;         ///< Reports writes to the file.
+    QTimer settleTimer;                 ///< Delays changed() until writes stop.
+    std::thread worker;                 ///< Thread running the current diff.
+    std::shared_ptr<DiffState> current; ///< State of the current diff, null when idle.
+};
@@ -0,0 +1,128 @@
+/**
+ * @file FileSaver.cpp
+ * @brief Implementation of the FileSaver class for Coda. Uses QSaveFile, which writes to a temporary file,
+ *        syncs it to disk on commit and only then renames it over the target.
+ * @author Dario Romandini
+ */
+
+#include "FileSaver.h"
+#include <QSaveFile>
+#include <QTextCodec>
+#include <QTextEncoder>
+#include <cstring>
+
+FileSaver::FileSaver(QObject *parent) : QObject(parent) {}
+
+FileSaver::~FileSaver() {
+    if (worker.joinable()) {
+        worker.join();
+    }
+}
+
+void FileSaver::save(const QString &path, const PieceTable &text, const TextFormat &format, quint64 revision) {
+    SaveRequest request{path, text, format, revision};
+    if (running) {
+        queued = std::make_unique<SaveRequest>(request);
+        return;
+    }
+    start(request);
+}
+
+bool FileSaver::isSaving() const {
+    return running || queued;
+}
+
+void FileSaver::start(const SaveRequest &request) {
+    if (worker.joinable()) {
+        worker.join();
+    }
+    running = true;
+    worker = std::thread(&FileSaver::run, this, request);
+}
+
+void FileSaver::workerDone() {
+    running = false;
+    if (queued) {
+        SaveRequest next = *queued;
+        queued.reset();
+        start(next);
+    }
+}
+
+void FileSaver::run(SaveRequest request) {
+    auto report = [this, path = request.path, revision = request.revision](const QString &error) {
+        QMetaObject::invokeMethod(this, [this, path, revision, error] {
+            workerDone();
+            if (error.isEmpty()) {
+                emit saved(path, revision);
+            } else {
+                emit failed(path, error);
+            }
+        }, Qt::QueuedConnection);
+    };
+
+    QSaveFile file(request.path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        report(file.errorString());
+        return;
+    }
+
+    QTextCodec *codec = QTextCodec::codecForName(request.format.codec);
+    bool utf8 = !codec || codec->mibEnum() == 106;
+    std::unique_ptr<QTextEncoder> encoder;
+    if (!utf8) {
+        encoder.reset(codec->makeEncoder(QTextCodec::IgnoreHeader));
+    }
+
+    // The piece table holds UTF-8 with "\n"; other encodings are converted one write chunk at a time.
+    QByteArray pending;
+    pending.reserve(WriteChunkSize + WriteChunkSize / 8);
+    auto flush = [&]() {
+        QByteArray encoded = utf8 ? pending : encoder->fromUnicode(QString::fromUtf8(pending));
+        pending.clear();
+        return file.write(encoded) == encoded.size();
+    };
+
+    if (request.format.byteOrderMark) {
+        pending = utf8 ? QByteArray("\xEF\xBB\xBF") : QString(QChar(QChar::ByteOrderMark)).toUtf8();
+    }
+
+    bool crlf = request.format.lineEnding == LineEnding::CRLF;
+    bool ok = true;
+    request.text.readBytes(0, request.text.byteSize(), [&](const char *data, qint64 size) {
+        if (!crlf) {
+            pending.append(data, static_cast<int>(size));
+        } else {
+            const char *end = data + size;
+            for (const char *p = data; p < end;) {
+                const char *newline = static_cast<const char *>(std::memchr(p, '\n', static_cast<size_t>(end - p)));
+                const char *stop = newline ? newline : end;
+                pending.append(p, static_cast<int>(stop - p));
+                if (newline) {
+                    pending.append("\r\n", 2);
+                }
+                p = stop + (newline ? 1 : 0);
+            }
+        }
+        // Pieces always end on a character boundary, so a flush never splits a UTF-8 sequence.
+        if (pending.size() >= WriteChunkSize) {
+            ok = flush();
+        }
+        return ok;
+    });
+
+    if (ok && !pending.isEmpty()) {
+        ok = flush();
+    }
+    if (!ok) {
+        QString error = file.errorString();
+        file.cancelWriting();
+        report(error.isEmpty() ? QStringLiteral("Write failed") : error);
+        return;
+    }
+    if (!file.commit()) {
+        report(file.errorString());
+        return;
+    }
+    report(QString());
+}
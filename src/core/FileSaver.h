@@ -0,0 +1,103 @@
+/**
+ * @file FileSaver.h
+ * @brief Background file saver for the Coda text editor.
+ *        Streams a PieceTable snapshot piece by piece into a temporary file on a worker thread and
+ *        atomically renames it over the target, so saving never builds the whole text in memory.
+ * @author Dario Romandini
+ */
+
+#pragma once
+
+#include <QObject>
+#include <QString>
+#include <memory>
+#include <thread>
+
+#include "PieceTable.h"
+#include "TextFormat.h"
+
+/**
+ * @class FileSaver
+ * @brief Saves one snapshot at a time. A save requested while another is running is queued;
+ *        only the most recent queued request is kept. Signals are emitted on the saver's thread.
+ */
+class FileSaver : public QObject {
+    Q_OBJECT
+
+public:
+    /**
+     * @brief Constructor for FileSaver.
+     * @param parent Optional parent object.
+     */
+    explicit FileSaver(QObject *parent = nullptr);
+
+    /**
+     * @brief Destructor. Waits for a running save to finish so no file is left half written.
+     */
+    ~FileSaver() override;
+
+    /**
+     * @brief Saves a snapshot, or queues it if a save is already running.
+     * @param path Path of the file to write.
+     * @param text Snapshot of the text to save.
+     * @param format Encoding, byte order mark and line endings to write.
+     * @param revision Editor revision of the snapshot, passed back by saved().
+     */
+    void save(const QString &path, const PieceTable &text, const TextFormat &format, quint64 revision);
+
+    /**
+     * @brief Returns whether a save is running or queued.
+     * @return True until the last requested save has finished.
+     */
+    bool isSaving() const;
+
+signals:
+    /**
+     * @brief Emitted once the data is flushed to disk and renamed into place.
+     * @param path The file that was saved.
+     * @param revision Editor revision of the snapshot that was written.
+     */
+    void saved(const QString &path, quint64 revision);
+
+    /**
+     * @brief Emitted if the file could not be written; the previous file is left untouched.
+     * @param path The file that failed to save.
+     * @param error Description of the error.
+     */
+    void failed(const QString &path, const QString &error);
+
+private:
+    static constexpr int WriteChunkSize = 1024 * 1024; ///< Bytes collected before each write.
+
+    /**
+     * @struct SaveRequest
+     * @brief One save: target, snapshot and format.
+     */
+    struct SaveRequest {
+        QString path;      ///< Target file.
+        PieceTable text;   ///< Snapshot to write.
+        TextFormat format; ///< On-disk format.
+        quint64 revision;  ///< Editor revision of the snapshot.
+    };
+
+    /**
+     * @brief Starts the worker thread for a request.
+     * @param request The save to perform.
+     */
+    void start(const SaveRequest &request);
+
+    /**
+     * @brief Worker thread body: encodes and writes the snapshot, then commits.
+     * @param request The save to perform.
+     */
+    void run(SaveRequest request);
+
+    /**
+     * @brief Called on the saver's thread when the worker is done; starts the queued save if any.
+     */
+    void workerDone();
+
+    std::thread worker;                     ///< Thread running the current save.
+    bool running = false;                   ///< True while the worker runs.
+    std::unique_ptr<SaveRequest> queued;    ///< Save requested while another was running.
+};
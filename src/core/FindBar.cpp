@@ -0,0 +1,385 @@
+/**
+ * @file FindBar.cpp
+ * @brief Implementation of the FindBar class for Coda.
+ * @author Dario Romandini
+ */
+
+#include "FindBar.h"
+#include "EditorWidget.h"
+#include <QApplication>
+#include <QGridLayout>
+#include <QKeyEvent>
+#include <QLabel>
+#include <QLineEdit>
+#include <QPushButton>
+#include <QStyle>
+#include <QTextBlock>
+#include <QToolButton>
+#include <algorithm>
+#include <climits>
+
+namespace {
+
+const QString DecorationGroup = QStringLiteral("find"); ///< Editor decoration group of the matches.
+
+/**
+ * @brief Expands \0 to \9 in a replacement to the groups captured by a match; \\ stands for a backslash.
+ */
+QString expandReplacement(const QString &replacement, const QRegularExpressionMatch &match) {
+    QString result;
+    result.reserve(replacement.size());
+    for (int i = 0; i < replacement.size(); ++i) {
+        QChar c = replacement[i];
+        if (c == QLatin1Char('\\') && i + 1 < replacement.size()) {
+            QChar next = replacement[i + 1];
+            if (next.isDigit()) {
+                result += match.captured(next.digitValue());
+                ++i;
+                continue;
+            }
+            if (next == QLatin1Char('\\')) {
+                result += next;
+                ++i;
+                continue;
+            }
+        }
+        result += c;
+    }
+    return result;
+}
+
+} // namespace
+
+FindBar::FindBar(EditorWidget *editor, QWidget *parent) : QWidget(parent), editor(editor) {
+    findField = new QLineEdit(this);
+    findField->setPlaceholderText("Find");
+    replaceField = new QLineEdit(this);
+    replaceField->setPlaceholderText("Replace");
+
+    auto toggle = [this](const QString &text, const QString &toolTip) {
+        auto *button = new QToolButton(this);
+        button->setText(text);
+        button->setToolTip(toolTip);
+        button->setCheckable(true);
+        connect(button, &QToolButton::toggled, this, &FindBar::restart);
+        return button;
+    };
+    caseButton = toggle("Aa", "Match case");
+    wordButton = toggle("W", "Match whole words");
+    regexButton = toggle(".*", "Regular expression; \\1 in the replacement inserts the first group");
+
+    auto *previousButton = new QPushButton("Previous", this);
+    auto *nextButton = new QPushButton("Next", this);
+    replaceButton = new QPushButton("Replace", this);
+    replaceAllButton = new QPushButton("Replace All", this);
+    countLabel = new QLabel(this);
+    countLabel->setMinimumWidth(fontMetrics().horizontalAdvance("0000000 of 0000000"));
+    auto *closeButton = new QToolButton(this);
+    closeButton->setIcon(style()->standardIcon(QStyle::SP_TitleBarCloseButton));
+    closeButton->setAutoRaise(true);
+
+    auto *layout = new QGridLayout(this);
+    layout->setContentsMargins(4, 2, 4, 2);
+    layout->addWidget(findField, 0, 0);
+    layout->addWidget(caseButton, 0, 1);
+    layout->addWidget(wordButton, 0, 2);
+    layout->addWidget(regexButton, 0, 3);
+    layout->addWidget(previousButton, 0, 4);
+    layout->addWidget(nextButton, 0, 5);
+    layout->addWidget(countLabel, 0, 6);
+    layout->addWidget(closeButton, 0, 7);
+    layout->addWidget(replaceField, 1, 0);
+    layout->addWidget(replaceButton, 1, 4);
+    layout->addWidget(replaceAllButton, 1, 5);
+
+    connect(findField, &QLineEdit::textEdited, this, &FindBar::restart);
+    connect(findField, &QLineEdit::returnPressed, this, [this] {
+        if (QApplication::keyboardModifiers() & Qt::ShiftModifier) {
+            findPrevious();
+        } else {
+            findNext();
+        }
+    });
+    connect(replaceField, &QLineEdit::returnPressed, this, &FindBar::replace);
+    connect(previousButton, &QPushButton::clicked, this, &FindBar::findPrevious);
+    connect(nextButton, &QPushButton::clicked, this, &FindBar::findNext);
+    connect(replaceButton, &QPushButton::clicked, this, &FindBar::replace);
+    connect(replaceAllButton, &QPushButton::clicked, this, &FindBar::replaceAll);
+    connect(closeButton, &QToolButton::clicked, this, &QWidget::hide);
+
+    connect(&engine, &FindEngine::matchesFound, this, &FindBar::onMatchesFound);
+    connect(&engine, &FindEngine::finished, this, &FindBar::onFinished);
+
+    // Matches found in older text would land in the wrong place: search again once typing pauses.
+    restartTimer.setSingleShot(true);
+    restartTimer.setInterval(RestartDelayMs);
+    connect(&restartTimer, &QTimer::timeout, this, &FindBar::restart);
+    connect(editor->document(), &QTextDocument::contentsChange, this, [this] {
+        if (isVisible()) {
+            restartTimer.start();
+        }
+    });
+    connect(editor, &EditorWidget::bufferReset, this, [this] {
+        if (isVisible()) {
+            restart();
+        }
+    });
+
+    hide();
+}
+
+void FindBar::open(bool replace) {
+    replaceField->setVisible(replace);
+    replaceButton->setVisible(replace);
+    replaceAllButton->setVisible(replace);
+
+    QString selected = editor->textCursor().selectedText();
+    if (!selected.isEmpty() && !selected.contains(QChar::ParagraphSeparator)) {
+        findField->setText(selected);
+    }
+    show();
+    findField->setFocus();
+    findField->selectAll();
+    restart();
+}
+
+void FindBar::findNext() {
+    step(1);
+}
+
+void FindBar::findPrevious() {
+    step(-1);
+}
+
+void FindBar::replace() {
+    QTextCursor cursor = editor->textCursor();
+    auto match = std::lower_bound(matches.cbegin(), matches.cend(), cursor.selectionStart(),
+                                  [](const FindMatch &m, int position) { return m.position < position; });
+    if (!isCurrent() || match == matches.cend() || match->position != cursor.selectionStart() ||
+        match->position + match->length != cursor.selectionEnd()) {
+        step(1);
+        return;
+    }
+
+    FindOptions search = options();
+    QString replacement = replaceField->text();
+    if (search.regex) {
+        QString selected = editor->textBuffer().text(match->position, match->length);
+        QRegularExpressionMatch groups = FindEngine::expression(search).match(
+            selected, 0, QRegularExpression::NormalMatch, QRegularExpression::AnchoredMatchOption);
+        replacement = expandReplacement(replacement, groups);
+    }
+    cursor.insertText(replacement);
+    editor->setTextCursor(cursor);
+    step(1);
+}
+
+void FindBar::replaceAll() {
+    if (!isCurrent()) {
+        restart();
+    }
+    if (!complete) {
+        pendingReplaceAll = true;
+        return;
+    }
+    if (matches.isEmpty()) {
+        return;
+    }
+
+    // Rebuild the text from the first to the last matching line and put it back in one edit. A search
+    // stopped at the match limit did not see the matches after the last one, so the rest of the document
+    // is rebuilt too and every match gets replaced.
+    QTextDocument *document = editor->document();
+    int first = document->findBlock(matches.first().position).position();
+    int last = document->characterCount() - 1;
+    if (!limited) {
+        QTextBlock lastBlock = document->findBlock(matches.last().position + matches.last().length);
+        last = lastBlock.position() + lastBlock.length() - 1;
+    }
+    QString text = editor->textBuffer().text(first, last - first);
+
+    FindOptions search = options();
+    QString replacement = replaceField->text();
+    QString result;
+    result.reserve(text.size());
+    int copied = 0;
+    int replaced = 0;
+    QRegularExpressionMatchIterator found = FindEngine::expression(search).globalMatch(text);
+    while (found.hasNext()) {
+        QRegularExpressionMatch match = found.next();
+        if (match.capturedLength() == 0) {
+            continue;
+        }
+        result += text.midRef(copied, match.capturedStart() - copied);
+        result += search.regex ? expandReplacement(replacement, match) : replacement;
+        copied = match.capturedEnd();
+        ++replaced;
+    }
+    result += text.midRef(copied);
+
+    editor->beginBatch();
+    QTextCursor cursor(document);
+    cursor.setPosition(first);
+    cursor.setPosition(last, QTextCursor::KeepAnchor);
+    cursor.insertText(result);
+    editor->endBatch();
+    countLabel->setText(QString("Replaced %1").arg(replaced));
+}
+
+void FindBar::keyPressEvent(QKeyEvent *event) {
+    if (event->key() == Qt::Key_Escape) {
+        hide();
+        return;
+    }
+    QWidget::keyPressEvent(event);
+}
+
+void FindBar::hideEvent(QHideEvent *event) {
+    restartTimer.stop();
+    engine.cancel();
+    editor->removeDecorations(DecorationGroup);
+    matches.clear();
+    current = -1;
+    pendingStep = 0;
+    pendingReplaceAll = false;
+    editor->setFocus();
+    QWidget::hideEvent(event);
+}
+
+void FindBar::restart() {
+    restartTimer.stop();
+    engine.cancel();
+    matches.clear();
+    current = -1;
+    complete = false;
+    limited = false;
+    searchedUpTo = 0;
+    searchedRevision = editor->textRevision();
+
+    // A load ends with bufferReset, which searches the loaded text.
+    QString error;
+    if (editor->isLoading() || !engine.find(editor->snapshot(), options(), &error)) {
+        editor->removeDecorations(DecorationGroup);
+        staleDecorations = false;
+        complete = true;
+        pendingStep = 0;
+        pendingReplaceAll = false;
+        countLabel->setText(error);
+        return;
+    }
+    // The old decorations still follow the edits; keep them until the new ones arrive.
+    staleDecorations = true;
+    updateCount();
+}
+
+void FindBar::onMatchesFound(const QVector<FindMatch> &found, int searched) {
+    if (!isCurrent()) {
+        return;
+    }
+    if (staleDecorations) {
+        editor->removeDecorations(DecorationGroup);
+        staleDecorations = false;
+    }
+
+    DecorationStyle style;
+    style.background = QColor(255, 165, 0, 96);
+    style.border = QColor(230, 140, 0);
+    for (const FindMatch &match : found) {
+        editor->addDecoration(match.position, match.position + match.length, style, DecorationGroup);
+    }
+    matches += found;
+    searchedUpTo = searched;
+
+    if (pendingStep != 0) {
+        int direction = pendingStep;
+        pendingStep = 0;
+        step(direction);
+    }
+    updateCount();
+}
+
+void FindBar::onFinished(int, bool stopped) {
+    if (!isCurrent()) {
+        return;
+    }
+    if (staleDecorations) {
+        editor->removeDecorations(DecorationGroup);
+        staleDecorations = false;
+    }
+    complete = true;
+    limited = stopped;
+    searchedUpTo = INT_MAX;
+
+    if (pendingReplaceAll) {
+        pendingReplaceAll = false;
+        replaceAll();
+        return;
+    }
+    if (pendingStep != 0) {
+        int direction = pendingStep;
+        pendingStep = 0;
+        step(direction);
+    }
+    updateCount();
+}
+
+FindOptions FindBar::options() const {
+    FindOptions result;
+    result.pattern = findField->text();
+    result.regex = regexButton->isChecked();
+    result.caseSensitive = caseButton->isChecked();
+    result.wholeWords = wordButton->isChecked();
+    return result;
+}
+
+void FindBar::step(int direction) {
+    if (!isCurrent()) {
+        restart();
+        pendingStep = complete ? 0 : direction;
+        return;
+    }
+
+    // Matches arrive in order, so one found after the selection is the nearest; one before it is the
+    // nearest only once the search has passed the selection.
+    QTextCursor cursor = editor->textCursor();
+    int from = direction > 0 ? cursor.selectionEnd() : cursor.selectionStart();
+    int next = static_cast<int>(std::lower_bound(matches.cbegin(), matches.cend(), from,
+                                                 [](const FindMatch &m, int position) {
+                                                     return m.position < position;
+                                                 }) - matches.cbegin());
+    if (direction > 0 && next < matches.size()) {
+        select(next);
+    } else if (direction < 0 && searchedUpTo >= from && next > 0) {
+        select(next - 1);
+    } else if (!complete) {
+        pendingStep = direction;
+    } else if (!matches.isEmpty()) {
+        select(direction > 0 ? 0 : matches.size() - 1);
+    }
+}
+
+void FindBar::select(int index) {
+    current = index;
+    QTextCursor cursor(editor->document());
+    cursor.setPosition(matches[index].position);
+    cursor.setPosition(matches[index].position + matches[index].length, QTextCursor::KeepAnchor);
+    editor->setTextCursor(cursor);
+    updateCount();
+}
+
+bool FindBar::isCurrent() const {
+    return searchedRevision == editor->textRevision();
+}
+
+void FindBar::updateCount() {
+    QString count = QString::number(matches.size()) + (limited ? "+" : "");
+    if (!complete) {
+        countLabel->setText(count + " matches...");
+    } else if (matches.isEmpty()) {
+        countLabel->setText("No results");
+    } else if (current >= 0) {
+        countLabel->setText(QString("%1 of %2").arg(current + 1).arg(count));
+    } else {
+        countLabel->setText(count + " matches");
+    }
+}
@@ -0,0 +1,151 @@
+/**
+ * @file FindBar.h
+ * @brief Find and replace bar for the Coda text editor.
+ *        Runs searches on a FindEngine and shows the matches as editor decorations while they stream in.
+ *        Any edit restarts the search on a new snapshot; replacing all matches is a single edit.
+ * @author Dario Romandini
+ */
+
+#pragma once
+
+#include <QTimer>
+#include <QVector>
+#include <QWidget>
+
+#include "FindEngine.h"
+
+class EditorWidget;
+class QLabel;
+class QLineEdit;
+class QPushButton;
+class QToolButton;
+
+/**
+ * @class FindBar
+ * @brief Bar shown under the editor with the search and replacement fields.
+ */
+class FindBar : public QWidget {
+    Q_OBJECT
+
+public:
+    /**
+     * @brief Constructor for FindBar. The bar starts hidden.
+     * @param editor The editor to search.
+     * @param parent Optional parent widget.
+     */
+    explicit FindBar(EditorWidget *editor, QWidget *parent = nullptr);
+
+    /**
+     * @brief Shows the bar and focuses the search field, filled with the selected text if any.
+     * @param replace True to also show the replacement field.
+     */
+    void open(bool replace);
+
+public slots:
+    /**
+     * @brief Selects the first match after the selection, wrapping around at the end.
+     */
+    void findNext();
+
+    /**
+     * @brief Selects the last match before the selection, wrapping around at the start.
+     */
+    void findPrevious();
+
+    /**
+     * @brief Replaces the selected match and selects the next one.
+     */
+    void replace();
+
+    /**
+     * @brief Replaces every match in one edit, including those past the match limit. Waits for a running
+     *        search to finish first.
+     */
+    void replaceAll();
+
+protected:
+    /**
+     * @brief Closes the bar on Escape.
+     * @param event The key event.
+     */
+    void keyPressEvent(QKeyEvent *event) override;
+
+    /**
+     * @brief Cancels the search and removes the match decorations.
+     * @param event The hide event.
+     */
+    void hideEvent(QHideEvent *event) override;
+
+private slots:
+    /**
+     * @brief Starts a new search for the current pattern and options over the current text.
+     */
+    void restart();
+
+    /**
+     * @brief Records and decorates a batch of matches.
+     * @param found Matches in document order.
+     * @param searched Position up to which the text has been searched.
+     */
+    void onMatchesFound(const QVector<FindMatch> &found, int searched);
+
+    /**
+     * @brief Completes the count and runs a pending step or replacement.
+     * @param count Number of matches.
+     * @param limited True if the search stopped at the match limit.
+     */
+    void onFinished(int count, bool limited);
+
+private:
+    static constexpr int RestartDelayMs = 150; ///< Quiet time after an edit before searching again.
+
+    /**
+     * @brief Returns the options set in the bar.
+     * @return The search options.
+     */
+    FindOptions options() const;
+
+    /**
+     * @brief Moves to the next or previous match, or defers the move until the results reach it.
+     * @param direction 1 for the next match, -1 for the previous one.
+     */
+    void step(int direction);
+
+    /**
+     * @brief Selects a match and scrolls to it.
+     * @param index Index of the match.
+     */
+    void select(int index);
+
+    /**
+     * @brief Returns whether the matches were found in the current text.
+     * @return False if the text changed since the search started.
+     */
+    bool isCurrent() const;
+
+    /**
+     * @brief Shows the number of matches and the selected one.
+     */
+    void updateCount();
+
+    EditorWidget *editor;         ///< The editor being searched.
+    FindEngine engine;            ///< Runs the searches.
+    QLineEdit *findField;         ///< Pattern.
+    QLineEdit *replaceField;      ///< Replacement.
+    QToolButton *caseButton;      ///< Match case.
+    QToolButton *wordButton;      ///< Match whole words.
+    QToolButton *regexButton;     ///< Pattern is a regular expression.
+    QPushButton *replaceButton;   ///< Replaces the selected match.
+    QPushButton *replaceAllButton; ///< Replaces all matches.
+    QLabel *countLabel;           ///< Match count or error.
+    QTimer restartTimer;          ///< Restarts the search after edits.
+    QVector<FindMatch> matches;   ///< Matches found so far, in document order.
+    quint64 searchedRevision = 0; ///< Text revision the matches belong to.
+    int searchedUpTo = 0;         ///< Position up to which the matches are complete.
+    bool complete = false;        ///< True once the search has finished.
+    bool limited = false;         ///< True if the search stopped at the match limit.
+    bool staleDecorations = false; ///< True until the first batch of a new search replaces the old decorations.
+    int current = -1;             ///< Index of the selected match, -1 if none.
+    int pendingStep = 0;          ///< Direction of a step waiting for results, 0 if none.
+    bool pendingReplaceAll = false; ///< True if replaceAll() waits for the search to finish.
+};
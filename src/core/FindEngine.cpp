@@ -0,0 +1,258 @@
+/**
+ * @file FindEngine.cpp
+ * @brief Implementation of the FindEngine class for Coda. The worker reads the snapshot one chunk at a
+ *        time, converts byte offsets to UTF-16 positions as it goes and posts every batch back to the
+ *        engine's thread, where it is dropped if the search it belongs to is no longer current.
+ * @author Dario Romandini
+ */
+
+#include "FindEngine.h"
+#include "LineIndex.h"
+#include <QElapsedTimer>
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CODA_FIND_SSE2 1
+#endif
+
+FindEngine::FindEngine(QObject *parent) : QObject(parent) {}
+
+FindEngine::~FindEngine() {
+    stopWorker();
+}
+
+bool FindEngine::find(const PieceTable &text, const FindOptions &options, QString *error) {
+    stopWorker();
+    if (options.pattern.isEmpty()) {
+        return false;
+    }
+    QRegularExpression check = expression(options);
+    if (!check.isValid()) {
+        if (error) {
+            *error = check.errorString();
+        }
+        return false;
+    }
+
+    current = std::make_shared<SearchState>();
+    current->text = text;
+    current->options = options;
+    worker = std::thread(&FindEngine::run, this, current);
+    return true;
+}
+
+void FindEngine::cancel() {
+    stopWorker();
+}
+
+bool FindEngine::isSearching() const {
+    return current != nullptr;
+}
+
+QRegularExpression FindEngine::expression(const FindOptions &options) {
+    QString pattern = options.regex ? options.pattern : QRegularExpression::escape(options.pattern);
+    if (options.wholeWords) {
+        pattern = QStringLiteral("\\b(?:%1)\\b").arg(pattern);
+    }
+    QRegularExpression::PatternOptions flags =
+        QRegularExpression::MultilineOption | QRegularExpression::UseUnicodePropertiesOption;
+    if (!options.caseSensitive) {
+        flags |= QRegularExpression::CaseInsensitiveOption;
+    }
+    return QRegularExpression(pattern, flags);
+}
+
+const char *FindEngine::findLiteral(const char *begin, const char *end, const char *needle, std::size_t size) {
+    if (size == 0 || static_cast<std::size_t>(end - begin) < size) {
+        return end;
+    }
+    const char *last = end - size;
+    // Compare the needle's first and last bytes at 16 positions at a time; check only where both match.
+    const char *p = begin;
+#ifdef CODA_FIND_SSE2
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i final = _mm_set1_epi8(needle[size - 1]);
+    for (; last - p >= 15; p += 16) {
+        __m128i head = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        __m128i tail = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + size - 1));
+        auto mask = static_cast<std::uint32_t>(
+            _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(head, first), _mm_cmpeq_epi8(tail, final))));
+        while (mask) {
+            const char *candidate = p + std::countr_zero(mask);
+            if (std::memcmp(candidate + 1, needle + 1, size - 1) == 0) {
+                return candidate;
+            }
+            mask &= mask - 1;
+        }
+    }
+#endif
+    while (p <= last) {
+        p = static_cast<const char *>(std::memchr(p, needle[0], static_cast<std::size_t>(last - p + 1)));
+        if (!p) {
+            return end;
+        }
+        if (std::memcmp(p, needle, size) == 0) {
+            return p;
+        }
+        ++p;
+    }
+    return end;
+}
+
+qint64 FindEngine::utf16Length(const char *begin, const char *end) {
+    // One unit per lead byte, plus one more for the four-byte sequences that become surrogate pairs.
+    qint64 units = 0;
+    const char *p = begin;
+#ifdef CODA_FIND_SSE2
+    // As signed bytes, continuation bytes are below -64 and four-byte leads are -16 to -1.
+    const __m128i continuation = _mm_set1_epi8(-64);
+    const __m128i fourByteLead = _mm_set1_epi8(-17);
+    const __m128i zero = _mm_setzero_si128();
+    for (; end - p >= 16; p += 16) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        auto trailing = static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_cmplt_epi8(bytes, continuation)));
+        auto surrogates = static_cast<std::uint32_t>(_mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpgt_epi8(bytes, fourByteLead), _mm_cmplt_epi8(bytes, zero))));
+        units += 16 - std::popcount(trailing) + std::popcount(surrogates);
+    }
+#endif
+    for (; p < end; ++p) {
+        auto byte = static_cast<unsigned char>(*p);
+        units += (byte & 0xC0) != 0x80;
+        units += byte >= 0xF0;
+    }
+    return units;
+}
+
+void FindEngine::stopWorker() {
+    if (current) {
+        current->cancelled = true;
+        current.reset();
+    }
+    if (worker.joinable()) {
+        worker.join();
+    }
+}
+
+void FindEngine::run(std::shared_ptr<SearchState> state) {
+    // Results are delivered on the engine's thread and ignored once a newer search has started.
+    auto post = [this, state](auto &&deliver) {
+        QMetaObject::invokeMethod(this, [this, state, deliver] {
+            if (state == current) {
+                deliver();
+            }
+        }, Qt::QueuedConnection);
+    };
+
+    QVector<FindMatch> batch;
+    int count = 0;
+    QElapsedTimer sinceBatch;
+    sinceBatch.start();
+    auto flush = [&](qint64 searched) {
+        if (!batch.isEmpty() || sinceBatch.elapsed() >= BatchIntervalMs) {
+            post([this, matches = batch, upTo = static_cast<int>(searched)] { emit matchesFound(matches, upTo); });
+            batch.clear();
+            sinceBatch.restart();
+        }
+    };
+    // Returns false once the search should stop.
+    auto report = [&](qint64 position, qint64 length, qint64 searched) {
+        batch.append(FindMatch{static_cast<int>(position), static_cast<int>(length)});
+        if (++count >= MaxMatches) {
+            return false;
+        }
+        if (batch.size() >= BatchSize || sinceBatch.elapsed() >= BatchIntervalMs) {
+            flush(searched);
+        }
+        return !state->cancelled;
+    };
+
+    const PieceTable &text = state->text;
+    const FindOptions &options = state->options;
+    qint64 size = text.byteSize();
+    qint64 offset = 0;
+    qint64 position = 0;
+    std::string window;
+    auto append = [&window](const char *data, qint64 length) {
+        window.append(data, static_cast<std::size_t>(length));
+        return true;
+    };
+    bool running = true;
+
+    if (!options.regex && options.caseSensitive && !options.wholeWords) {
+        QByteArray needle = options.pattern.toUtf8();
+        auto needleSize = static_cast<qint64>(needle.size());
+        qint64 needleLength = options.pattern.size();
+
+        // Each chunk is read with enough extra bytes to find a match starting at its last byte.
+        while (running && offset < size && !state->cancelled) {
+            qint64 chunkEnd = qMin(size, offset + ChunkSize);
+            window.clear();
+            text.readBytes(offset, qMin(size, chunkEnd + needleSize - 1) - offset, append);
+            const char *data = window.data();
+            const char *end = data + window.size();
+            const char *limit = data + (chunkEnd - offset);
+            const char *from = data;
+            const char *counted = data;
+            while (running) {
+                const char *hit = findLiteral(from, end, needle.constData(), static_cast<std::size_t>(needleSize));
+                if (hit >= limit) {
+                    break;
+                }
+                position += utf16Length(counted, hit);
+                counted = hit;
+                running = report(position, needleLength, position);
+                from = hit + needleSize;
+            }
+            const char *next = std::max(limit, from);
+            position += utf16Length(counted, next);
+            offset += next - data;
+            flush(position);
+        }
+    } else {
+        QRegularExpression pattern = expression(options);
+
+        // Chunks end after a line break so that ^, $ and \b see whole lines; matches cannot span chunks.
+        while (running && offset < size && !state->cancelled) {
+            qint64 chunkEnd = qMin(size, offset + ChunkSize);
+            window.clear();
+            text.readBytes(offset, chunkEnd - offset, append);
+            if (chunkEnd < size && window.back() != '\n') {
+                text.readBytes(chunkEnd, size - chunkEnd, [&window](const char *data, qint64 length) {
+                    const char *newline = LineIndex::findNewline(data, data + length);
+                    if (newline == data + length) {
+                        window.append(data, static_cast<std::size_t>(length));
+                        return true;
+                    }
+                    window.append(data, static_cast<std::size_t>(newline - data + 1));
+                    return false;
+                });
+            }
+
+            QString chunk = QString::fromUtf8(window.data(), static_cast<int>(window.size()));
+            QRegularExpressionMatchIterator matches = pattern.globalMatch(chunk);
+            while (running && matches.hasNext()) {
+                QRegularExpressionMatch match = matches.next();
+                if (match.capturedLength() > 0) {
+                    qint64 start = position + match.capturedStart();
+                    running = report(start, match.capturedLength(), start);
+                }
+            }
+            position += chunk.size();
+            offset += static_cast<qint64>(window.size());
+            flush(position);
+        }
+    }
+
+    if (state->cancelled) {
+        return;
+    }
+    flush(position);
+    post([this, count, limited = count >= MaxMatches] {
+        current.reset();
+        emit finished(count, limited);
+    });
+}
@@ -0,0 +1,155 @@
+/**
+ * @file FindEngine.h
+ * @brief Background text search for the Coda text editor.
+ *        Searches a PieceTable snapshot on a worker thread and streams the matches to the UI thread in
+ *        batches. Case-sensitive literal searches scan the UTF-8 bytes with SIMD comparisons; everything
+ *        else runs a QRegularExpression over the text one chunk of whole lines at a time.
+ * @author Dario Romandini
+ */
+
+#pragma once
+
+#include <QObject>
+#include <QRegularExpression>
+#include <QString>
+#include <QVector>
+#include <atomic>
+#include <memory>
+#include <thread>
+
+#include "PieceTable.h"
+
+/**
+ * @struct FindOptions
+ * @brief What to search for.
+ */
+struct FindOptions {
+    QString pattern;            ///< Text or regular expression to find.
+    bool regex = false;         ///< True if pattern is a regular expression.
+    bool caseSensitive = false; ///< True to match case.
+    bool wholeWords = false;    ///< True to match only whole words.
+};
+
+/**
+ * @struct FindMatch
+ * @brief A match, in document positions.
+ */
+struct FindMatch {
+    int position; ///< Position of the first character.
+    int length;   ///< Number of UTF-16 units.
+};
+
+/**
+ * @class FindEngine
+ * @brief Runs one search at a time. All signals are emitted on the thread the engine lives in.
+ *        Starting a new search or calling cancel() stops the previous one; batches it had already
+ *        queued are dropped.
+ */
+class FindEngine : public QObject {
+    Q_OBJECT
+
+public:
+    static constexpr int MaxMatches = 1000000; ///< The search stops after this many matches.
+
+    /**
+     * @brief Constructor for FindEngine.
+     * @param parent Optional parent object.
+     */
+    explicit FindEngine(QObject *parent = nullptr);
+
+    /**
+     * @brief Destructor. Cancels a running search and waits for the worker thread.
+     */
+    ~FindEngine() override;
+
+    /**
+     * @brief Starts a search, cancelling any search in progress.
+     * @param text Snapshot of the text to search.
+     * @param options What to search for.
+     * @param error Receives the reason if the pattern is not a valid regular expression.
+     * @return False if the pattern is empty or invalid; no search is started.
+     */
+    bool find(const PieceTable &text, const FindOptions &options, QString *error = nullptr);
+
+    /**
+     * @brief Cancels the current search.
+     */
+    void cancel();
+
+    /**
+     * @brief Returns whether a search is in progress.
+     * @return True between find() and finished().
+     */
+    bool isSearching() const;
+
+    /**
+     * @brief Returns the regular expression a search with the given options runs.
+     *        Literal patterns are escaped, and whole words are anchored at word boundaries.
+     * @param options The search options.
+     * @return The expression, with ^ and $ matching at line breaks.
+     */
+    static QRegularExpression expression(const FindOptions &options);
+
+    /**
+     * @brief Finds the first occurrence of a byte string, comparing 16 positions at a time with SIMD.
+     * @param begin Start of the bytes to search.
+     * @param end End of the bytes to search.
+     * @param needle Bytes to find.
+     * @param size Length of the needle.
+     * @return Start of the first occurrence, or end if there is none.
+     */
+    static const char *findLiteral(const char *begin, const char *end, const char *needle, std::size_t size);
+
+    /**
+     * @brief Counts the UTF-16 units that UTF-8 bytes decode to. Any split of a text gives counts adding
+     *        up to the count of the whole text.
+     * @param begin Start of the bytes.
+     * @param end End of the bytes.
+     * @return Number of UTF-16 units.
+     */
+    static qint64 utf16Length(const char *begin, const char *end);
+
+signals:
+    /**
+     * @brief Emitted with the matches found since the previous batch.
+     * @param matches Matches in document order.
+     * @param searched Position up to which the text has been searched.
+     */
+    void matchesFound(const QVector<FindMatch> &matches, int searched);
+
+    /**
+     * @brief Emitted when the whole text has been searched or the match limit is reached.
+     * @param count Number of matches.
+     * @param limited True if the search stopped at MaxMatches.
+     */
+    void finished(int count, bool limited);
+
+private:
+    static constexpr qint64 ChunkSize = 1024 * 1024; ///< Bytes searched between cancellation checks.
+    static constexpr int BatchSize = 4096;           ///< Matches collected before a batch is sent.
+    static constexpr int BatchIntervalMs = 30;       ///< Longest time a found match is held back.
+
+    /**
+     * @struct SearchState
+     * @brief State shared between the UI thread and the worker of one search.
+     */
+    struct SearchState {
+        PieceTable text;                   ///< Snapshot being searched.
+        FindOptions options;               ///< What to search for.
+        std::atomic_bool cancelled{false}; ///< Set by the UI thread to stop the worker.
+    };
+
+    /**
+     * @brief Worker thread body: searches the snapshot and posts the matches.
+     * @param state State of the search this worker belongs to.
+     */
+    void run(std::shared_ptr<SearchState> state);
+
+    /**
+     * @brief Stops the worker thread and waits for it.
+     */
+    void stopWorker();
+
+    std::thread worker;                   ///< Thread running the current search.
+    std::shared_ptr<SearchState> current; ///< State of the current search, null when idle.
+};
@@ -0,0 +1,73 @@
+/**
+ * @file FoldTree.cpp
+ * @brief Implementation of the FoldTree class for Coda.
+ * @author Dario Romandini
+ */
+
+#include "FoldTree.h"
+#include <algorithm>
+#include <climits>
+
+void FoldTree::assign(const std::vector<FoldRegion> &regions) {
+    tree.assign(regions);
+}
+
+void FoldTree::applyEdit(int first, int oldLast, int delta) {
+    // Regions starting after the edited lines only move. Those starting on an edited line, and those
+    // starting before the edit but reaching into it, change shape: take them out, map their lines and put
+    // them back.
+    std::vector<FoldRegion> changed = tree.extractForEdit(first, oldLast + 1, first - 1, delta);
+
+    // Of the regions clamped onto the same line, the one that started first is kept.
+    std::sort(changed.begin(), changed.end(),
+              [](const FoldRegion &a, const FoldRegion &b) { return a.start < b.start; });
+    int newLast = oldLast + delta;
+    auto map = [&](int line) { return line > oldLast ? line + delta : std::min(line, newLast); };
+    for (FoldRegion region : changed) {
+        region.start = region.start < first ? region.start : map(region.start);
+        region.end = map(region.end);
+        if (region.end > region.start) {
+            insert(region);
+        }
+    }
+}
+
+void FoldTree::insert(const FoldRegion &region) {
+    FoldRegion existing;
+    if (!tree.find(region.start, existing)) {
+        tree.insert(region);
+    }
+}
+
+std::vector<FoldRegion> FoldTree::take(int first, int last) {
+    // An edit that moves nothing and reaches no region starting before it takes out exactly the range.
+    std::vector<FoldRegion> taken = tree.extractForEdit(first, last + 1, INT_MAX, 0);
+    std::sort(taken.begin(), taken.end(),
+              [](const FoldRegion &a, const FoldRegion &b) { return a.start < b.start; });
+    return taken;
+}
+
+bool FoldTree::find(int line, FoldRegion &region) const {
+    return tree.find(line, region);
+}
+
+bool FoldTree::setCollapsed(int line, bool collapsed) {
+    FoldRegion *region = tree.at(line);
+    if (!region) {
+        return false;
+    }
+    region->collapsed = collapsed;
+    return true;
+}
+
+void FoldTree::setAllCollapsed(bool collapsed) {
+    tree.modifyAll([collapsed](FoldRegion &region) { region.collapsed = collapsed; });
+}
+
+void FoldTree::clear() {
+    tree.clear();
+}
+
+int FoldTree::size() const {
+    return tree.size();
+}
@@ -0,0 +1,108 @@
+/**
+ * @file FoldTree.h
+ * @brief Tree of foldable line ranges for the Coda text editor.
+ *        An IntervalTreap ordered by first line, like DecorationTree but in lines. Edits move every region
+ *        after them with one lazy offset, so an edit costs O(log n) plus the regions enclosing it, and the
+ *        region at a line is found in O(log n).
+ * @author Dario Romandini
+ */
+
+#pragma once
+
+#include "IntervalTreap.h"
+#include <QtGlobal>
+#include <vector>
+
+/**
+ * @struct FoldRegion
+ * @brief A foldable range of lines. Folding it hides the lines after its first one, up to its last one.
+ */
+struct FoldRegion {
+    int start;              ///< Line the region starts on; stays visible when folded.
+    int end;                ///< Last line of the region, after start.
+    bool collapsed = false; ///< True while the region is folded.
+};
+
+/**
+ * @class FoldTree
+ * @brief Stores fold regions, at most one per first line, and keeps them in step with line edits.
+ */
+class FoldTree {
+public:
+    /**
+     * @brief Replaces all regions.
+     * @param regions Regions sorted by start, with distinct starts.
+     */
+    void assign(const std::vector<FoldRegion> &regions);
+
+    /**
+     * @brief Moves the regions after an edit of lines first..oldLast, which became first..oldLast + delta.
+     *        Regions after the edit move by delta and regions enclosing it grow by delta; an edited start or
+     *        end line is clamped into the new lines, and regions left without lines to hide are removed.
+     * @param first First edited line.
+     * @param oldLast Last edited line, before the edit.
+     * @param delta Number of lines added, negative if removed.
+     */
+    void applyEdit(int first, int oldLast, int delta);
+
+    /**
+     * @brief Adds a region unless one already starts on its line.
+     * @param region The region.
+     */
+    void insert(const FoldRegion &region);
+
+    /**
+     * @brief Removes the regions starting on lines first..last. Costs O(log n) plus the regions removed.
+     * @param first First line of the range.
+     * @param last Last line of the range.
+     * @return The removed regions, sorted by start.
+     */
+    std::vector<FoldRegion> take(int first, int last);
+
+    /**
+     * @brief Finds the region starting on a line.
+     * @param line The line.
+     * @param region Receives the region if there is one.
+     * @return True if a region starts on the line.
+     */
+    bool find(int line, FoldRegion &region) const;
+
+    /**
+     * @brief Folds or unfolds the region starting on a line.
+     * @param line The region's start line.
+     * @param collapsed True to fold it.
+     * @return True if a region starts on the line.
+     */
+    bool setCollapsed(int line, bool collapsed);
+
+    /**
+     * @brief Folds or unfolds every region. Costs O(n) in the number of regions, not lines.
+     * @param collapsed True to fold them.
+     */
+    void setAllCollapsed(bool collapsed);
+
+    /**
+     * @brief Calls a function for every region overlapping a range of lines, in order of their start.
+     * @param from First line of the range.
+     * @param to Line after the range.
+     * @param visitor Called with each region.
+     */
+    template <typename Visitor>
+    void visit(int from, int to, Visitor &&visitor) const {
+        tree.visit(from, to, visitor);
+    }
+
+    /**
+     * @brief Removes all regions.
+     */
+    void clear();
+
+    /**
+     * @brief Returns the number of regions.
+     * @return The region count.
+     */
+    int size() const;
+
+private:
+    IntervalTreap<FoldRegion> tree; ///< Regions by first line.
+};
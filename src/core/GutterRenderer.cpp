@@ -0,0 +1,172 @@
+/**
+ * @file GutterRenderer.cpp
+ * @brief Implementation of the GutterRenderer class for Coda.
+ * @author Dario Romandini
+ */
+
+#include "GutterRenderer.h"
+#include <QFontMetrics>
+#include <QPainter>
+#include <iterator>
+
+bool GutterRenderer::Row::operator==(const Row &other) const {
+    return top == other.top && height == other.height && number == other.number && current == other.current &&
+           marker == other.marker && fold == other.fold;
+}
+
+void GutterRenderer::setFont(const QFont &newFont) {
+    font = newFont;
+    QFontMetrics metrics(font);
+    digitWidth = 0;
+    for (char digit = '0'; digit <= '9'; ++digit) {
+        digitWidth = qMax(digitWidth, metrics.horizontalAdvance(QLatin1Char(digit)));
+    }
+    digitHeight = metrics.height();
+    markerWidth = digitHeight / 2 + 4;
+    foldWidth = digitHeight / 2 + 4;
+    pixelRatio = 0;
+    invalidate();
+}
+
+int GutterRenderer::width(int digits) const {
+    return markerWidth + digitWidth * digits + RightPadding + foldWidth;
+}
+
+int GutterRenderer::foldColumnWidth() const {
+    return foldWidth;
+}
+
+void GutterRenderer::scroll(int dy) {
+    if (cache.isNull()) {
+        return;
+    }
+    cache.scroll(0, qRound(dy * pixelRatio), cache.rect());
+
+    // Rows keep their pixels; the strip scrolled in holds stale pixels and no rows.
+    std::map<int, Row> moved;
+    for (auto &[top, row] : cached) {
+        row.top += dy;
+        moved.emplace(row.top, row);
+    }
+    cached.swap(moved);
+}
+
+void GutterRenderer::invalidate() {
+    cache = QPixmap();
+    cached.clear();
+}
+
+void GutterRenderer::paint(QPainter &painter, const QRect &exposed, const QSize &size, qreal devicePixelRatio,
+                           const QVector<Row> &rows) {
+    if (devicePixelRatio != pixelRatio) {
+        pixelRatio = devicePixelRatio;
+        buildAtlas();
+        invalidate();
+    }
+    if (cache.isNull() || cache.size() != size * pixelRatio) {
+        cache = QPixmap(size * pixelRatio);
+        cache.setDevicePixelRatio(pixelRatio);
+        cache.fill(background);
+        cached.clear();
+    }
+
+    QPainter cachePainter(&cache);
+    int bottom = 0;
+    for (const Row &row : rows) {
+        bottom = row.top + row.height;
+        if (bottom <= exposed.top() || row.top > exposed.bottom()) {
+            continue;
+        }
+        auto same = cached.find(row.top);
+        if (same != cached.end() && same->second == row) {
+            continue;
+        }
+
+        // Forget cached rows this one paints over; cached rows never overlap, so only one may start above it.
+        auto overlap = cached.lower_bound(row.top);
+        if (overlap != cached.begin()) {
+            auto above = std::prev(overlap);
+            if (above->first + above->second.height > row.top) {
+                overlap = above;
+            }
+        }
+        while (overlap != cached.end() && overlap->first < bottom) {
+            overlap = cached.erase(overlap);
+        }
+        drawRow(cachePainter, row);
+        cached.emplace(row.top, row);
+    }
+
+    // Below the last line the gutter is empty.
+    if (bottom < size.height() && exposed.bottom() >= bottom) {
+        cachePainter.fillRect(QRect(0, bottom, size.width(), size.height() - bottom), background);
+        cached.erase(cached.lower_bound(bottom), cached.end());
+    }
+    cachePainter.end();
+
+    painter.drawPixmap(QRectF(exposed), cache, QRectF(QPointF(exposed.topLeft()) * pixelRatio,
+                                                      QSizeF(exposed.size()) * pixelRatio));
+}
+
+void GutterRenderer::buildAtlas() {
+    atlas = QPixmap(QSize(digitWidth * 10, digitHeight * 2) * pixelRatio);
+    atlas.setDevicePixelRatio(pixelRatio);
+    atlas.fill(background);
+
+    QPainter painter(&atlas);
+    painter.setFont(font);
+    for (int digit = 0; digit < 10; ++digit) {
+        painter.setPen(numberColor);
+        painter.drawText(QRect(digit * digitWidth, 0, digitWidth, digitHeight), Qt::AlignRight,
+                         QString(QChar('0' + digit)));
+        painter.setPen(currentColor);
+        painter.drawText(QRect(digit * digitWidth, digitHeight, digitWidth, digitHeight), Qt::AlignRight,
+                         QString(QChar('0' + digit)));
+    }
+}
+
+void GutterRenderer::drawRow(QPainter &painter, const Row &row) {
+    int width = qRound(cache.width() / pixelRatio);
+    painter.fillRect(QRect(0, row.top, width, row.height), background);
+
+    if (row.marker != NoMarker) {
+        static const QColor markerColors[] = {QColor(), QColor(0x3d, 0x8e, 0xd8), QColor(0xe0, 0xa0, 0x20),
+                                              QColor(0xd0, 0x30, 0x30)};
+        int diameter = markerWidth - 4;
+        painter.setRenderHint(QPainter::Antialiasing);
+        painter.setPen(Qt::NoPen);
+        painter.setBrush(markerColors[row.marker]);
+        painter.drawEllipse(QRectF(2, row.top + (digitHeight - diameter) / 2.0, diameter, diameter));
+        painter.setRenderHint(QPainter::Antialiasing, false);
+    }
+
+    if (row.fold != NoFold) {
+        // A triangle pointing down for an open region, right for a folded one.
+        qreal size = foldWidth - 6;
+        qreal left = width - foldWidth + 2;
+        qreal top = row.top + (digitHeight - size) / 2.0;
+        QPolygonF triangle;
+        if (row.fold == FoldOpen) {
+            triangle << QPointF(left, top) << QPointF(left + size, top) << QPointF(left + size / 2, top + size);
+        } else {
+            triangle << QPointF(left, top) << QPointF(left + size, top + size / 2) << QPointF(left, top + size);
+        }
+        painter.setRenderHint(QPainter::Antialiasing);
+        painter.setPen(Qt::NoPen);
+        painter.setBrush(foldColor);
+        painter.drawPolygon(triangle);
+        painter.setRenderHint(QPainter::Antialiasing, false);
+    }
+
+    // Digits are copied from the atlas right to left.
+    int x = width - RightPadding - foldWidth;
+    int sourceTop = row.current ? digitHeight : 0;
+    unsigned number = static_cast<unsigned>(qMax(0, row.number));
+    do {
+        x -= digitWidth;
+        QRectF source(QPointF((number % 10) * digitWidth, sourceTop) * pixelRatio,
+                      QSizeF(digitWidth, digitHeight) * pixelRatio);
+        painter.drawPixmap(QRectF(x, row.top, digitWidth, digitHeight), atlas, source);
+        number /= 10;
+    } while (number > 0 && x > markerWidth);
+}
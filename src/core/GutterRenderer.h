@@ -0,0 +1,133 @@
+/**
+ * @file GutterRenderer.h
+ * @brief Cached renderer for the line-number gutter of the Coda text editor.
+ *        Numbers are composed from a prebuilt digit atlas instead of laid-out text, and the gutter is kept in
+ *        a pixmap that scrolls with the view, so a paint only draws the rows that actually changed.
+ * @author Dario Romandini
+ */
+
+#pragma once
+
+#include <QColor>
+#include <QFont>
+#include <QPixmap>
+#include <QRect>
+#include <QVector>
+#include <map>
+
+class QPainter;
+
+/**
+ * @class GutterRenderer
+ * @brief Paints gutter rows into a cached pixmap and blits it onto the gutter widget.
+ *        The caller describes every visible row on each paint; rows whose number, marker, position or
+ *        current-line state match what the cache already holds are not drawn again.
+ */
+class GutterRenderer {
+public:
+    /// Diagnostic marker shown in front of a line number.
+    enum Marker : quint8 {
+        NoMarker,      ///< No marker.
+        InfoMarker,    ///< Informational diagnostic.
+        WarningMarker, ///< Warning.
+        ErrorMarker    ///< Error.
+    };
+
+    /// Fold handle shown after a line number.
+    enum Fold : quint8 {
+        NoFold,    ///< The line starts no fold region.
+        FoldOpen,  ///< The line starts an unfolded region.
+        FoldClosed ///< The line starts a folded region.
+    };
+
+    /**
+     * @struct Row
+     * @brief One visible row of the gutter.
+     */
+    struct Row {
+        int top;        ///< Top of the row in gutter coordinates.
+        int height;     ///< Height of the row.
+        int number;     ///< Number to show.
+        bool current;   ///< True for the cursor's line.
+        Marker marker;  ///< Marker of the line.
+        Fold fold;      ///< Fold handle of the line.
+
+        /**
+         * @brief Compares two rows.
+         * @param other The other row.
+         * @return True if both rows look the same.
+         */
+        bool operator==(const Row &other) const;
+    };
+
+    /**
+     * @brief Sets the font of the numbers; rebuilds the atlas and clears the cache.
+     * @param font The editor font.
+     */
+    void setFont(const QFont &font);
+
+    /**
+     * @brief Returns the gutter width needed for a number of digits.
+     * @param digits Digits of the largest number shown.
+     * @return Width in pixels, including the marker and fold columns.
+     */
+    int width(int digits) const;
+
+    /**
+     * @brief Returns the width of the fold column, at the right edge of the gutter.
+     * @return Width in pixels.
+     */
+    int foldColumnWidth() const;
+
+    /**
+     * @brief Shifts the cached contents after the view scrolled.
+     * @param dy Vertical scroll distance in pixels.
+     */
+    void scroll(int dy);
+
+    /**
+     * @brief Forgets the cached contents, e.g. after a resize.
+     */
+    void invalidate();
+
+    /**
+     * @brief Paints an exposed part of the gutter.
+     * @param painter Painter on the gutter widget.
+     * @param exposed Area to paint.
+     * @param size Size of the gutter widget.
+     * @param devicePixelRatio Device pixel ratio of the gutter widget.
+     * @param rows The visible rows, top to bottom.
+     */
+    void paint(QPainter &painter, const QRect &exposed, const QSize &size, qreal devicePixelRatio,
+               const QVector<Row> &rows);
+
+private:
+    static constexpr int RightPadding = 5; ///< Space between the numbers and the text.
+
+    /**
+     * @brief Renders the digits 0 to 9 in the normal and the current-line colour.
+     */
+    void buildAtlas();
+
+    /**
+     * @brief Draws one row into the cache.
+     * @param painter Painter on the cache.
+     * @param row The row.
+     */
+    void drawRow(QPainter &painter, const Row &row);
+
+    QFont font;                   ///< Font of the numbers.
+    int digitWidth = 0;           ///< Width of one digit cell.
+    int digitHeight = 0;          ///< Height of one digit cell.
+    int markerWidth = 0;          ///< Width of the marker column.
+    int foldWidth = 0;            ///< Width of the fold column.
+    qreal pixelRatio = 0;         ///< Device pixel ratio of the atlas and the cache.
+    QPixmap atlas;                ///< Digits 0 to 9; first row normal, second row current line.
+    QPixmap cache;                ///< Gutter contents.
+    std::map<int, Row> cached;    ///< Rows held by the cache, by top; they never overlap.
+
+    const QColor background = Qt::lightGray; ///< Gutter background.
+    const QColor numberColor = Qt::darkGray; ///< Colour of the line numbers.
+    const QColor currentColor = Qt::black;   ///< Colour of the cursor's line number.
+    const QColor foldColor = Qt::darkGray;   ///< Colour of the fold handles.
+};
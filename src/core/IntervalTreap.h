@@ -0,0 +1,405 @@
+/**
+ * @file IntervalTreap.h
+ * @brief Interval treap shared by DecorationTree and FoldTree in the Coda text editor.
+ *        A treap ordered by start and augmented with the largest end of each subtree. Edits move every range
+ *        after them with one lazy offset, so an edit costs O(log n) plus the ranges it reaches into.
+ * @author Dario Romandini
+ */
+
+#pragma once
+
+#include <QtGlobal>
+#include <algorithm>
+#include <climits>
+#include <functional>
+#include <vector>
+
+/**
+ * @class IntervalTreap
+ * @brief Stores ranges ordered by start and keeps their positions in step with edits.
+ * @tparam Value Stored type; must have int members start and end, with end not before start.
+ */
+template <typename Value>
+class IntervalTreap {
+public:
+    /**
+     * @brief Adds a value, before any value with the same start.
+     * @param value The value.
+     */
+    void insert(const Value &value) {
+        int node = newNode(value);
+        int left, right;
+        split(root, value.start, left, right);
+        root = merge(merge(left, node), right);
+        ++count;
+    }
+
+    /**
+     * @brief Replaces all values.
+     * @param sorted Values sorted by start.
+     */
+    void assign(const std::vector<Value> &sorted) {
+        clear();
+        nodes.reserve(sorted.size());
+        root = build(sorted, 0, static_cast<int>(sorted.size()), UINT_MAX);
+        count = static_cast<int>(sorted.size());
+    }
+
+    /**
+     * @brief Prepares an edit: moves the values starting at or after end by delta, and takes out the values
+     *        that start in begin..end - 1 or start before begin and end after reach. The caller maps those
+     *        and inserts them back.
+     * @param begin First position of the edit.
+     * @param end Position after the edited range, before the edit.
+     * @param reach Values starting before begin are taken out if they end after it.
+     * @param delta Distance the values after the edit move.
+     * @return The values taken out, with their positions before the edit.
+     */
+    std::vector<Value> extractForEdit(int begin, int end, int reach, int delta) {
+        std::vector<Value> changed;
+        if (root < 0) {
+            return changed;
+        }
+        int before, after;
+        split(root, end, before, after);
+        shift(after, delta);
+
+        int untouched, inside;
+        split(before, begin, untouched, inside);
+        untouched = extractEndingAfter(untouched, reach, changed);
+        extractEndingAfter(inside, INT_MIN, changed);
+        root = merge(untouched, after);
+        count -= static_cast<int>(changed.size());
+        return changed;
+    }
+
+    /**
+     * @brief Finds a value starting at a position.
+     * @param start The position.
+     * @param value Receives the value if there is one.
+     * @return True if a value starts at the position.
+     */
+    bool find(int start, Value &value) const {
+        int index = root;
+        int offset = 0;
+        while (index >= 0) {
+            const Node &node = nodes[index];
+            int nodeStart = node.value.start + offset;
+            if (nodeStart == start) {
+                value = node.value;
+                value.start = nodeStart;
+                value.end = node.value.end + offset;
+                return true;
+            }
+            offset += node.offset;
+            index = start < nodeStart ? node.left : node.right;
+        }
+        return false;
+    }
+
+    /**
+     * @brief Returns a value starting at a position, for changing anything but its start and end.
+     * @param start The position.
+     * @return The value with its exact positions, or nullptr.
+     */
+    Value *at(int start) {
+        // Offsets are pushed down on the way, so the node found holds its exact positions.
+        int index = root;
+        while (index >= 0) {
+            push(index);
+            Node &node = nodes[index];
+            if (node.value.start == start) {
+                return &node.value;
+            }
+            index = start < node.value.start ? node.left : node.right;
+        }
+        return nullptr;
+    }
+
+    /**
+     * @brief Calls a function on every value, which may change anything but its start and end.
+     *        Costs O(n) in the number of values.
+     * @param function Called with a reference to each value.
+     */
+    template <typename Function>
+    void modifyAll(Function &&function) {
+        // Free nodes are never read, so they need not be told apart.
+        for (Node &node : nodes) {
+            function(node.value);
+        }
+    }
+
+    /**
+     * @brief Calls a function for every value starting before a position and ending at or after another,
+     *        in order of their start.
+     * @param from Values ending before this position are skipped.
+     * @param to Values starting at or after this position are skipped.
+     * @param visitor Called with each value.
+     */
+    template <typename Visitor>
+    void visit(int from, int to, Visitor &&visitor) const {
+        visitNode(root, 0, from, to, visitor);
+    }
+
+    /**
+     * @brief Removes the values matching a predicate and rebalances the tree.
+     * @param predicate Returns true for the values to remove.
+     * @return Number of values removed.
+     */
+    int removeIf(const std::function<bool(const Value &)> &predicate) {
+        std::vector<Value> kept;
+        kept.reserve(count);
+        int removedCount = 0;
+        visit(INT_MIN, INT_MAX, [&](const Value &value) {
+            if (predicate(value)) {
+                ++removedCount;
+            } else {
+                kept.push_back(value);
+            }
+        });
+        if (removedCount > 0) {
+            assign(kept);
+        }
+        return removedCount;
+    }
+
+    /**
+     * @brief Removes all values.
+     */
+    void clear() {
+        nodes.clear();
+        freeList.clear();
+        root = -1;
+        count = 0;
+    }
+
+    /**
+     * @brief Returns the number of values.
+     * @return The value count.
+     */
+    int size() const {
+        return count;
+    }
+
+private:
+    /**
+     * @struct Node
+     * @brief Tree node. Its positions are exact once the offsets pending in its ancestors are added.
+     */
+    struct Node {
+        Value value;      ///< The value.
+        int maxEnd;       ///< Largest end in the subtree.
+        int offset;       ///< Shift not yet applied to the children.
+        quint32 priority; ///< Heap priority.
+        int left = -1;    ///< Left child, or -1.
+        int right = -1;   ///< Right child, or -1.
+    };
+
+    template <typename Visitor>
+    void visitNode(int index, int offset, int from, int to, Visitor &visitor) const {
+        if (index < 0) {
+            return;
+        }
+        const Node &node = nodes[index];
+        if (node.maxEnd + offset < from) {
+            return;
+        }
+        int childOffset = offset + node.offset;
+        visitNode(node.left, childOffset, from, to, visitor);
+
+        int start = node.value.start + offset;
+        if (start >= to) {
+            return;
+        }
+        int end = node.value.end + offset;
+        if (end >= from) {
+            Value value = node.value;
+            value.start = start;
+            value.end = end;
+            visitor(value);
+        }
+        visitNode(node.right, childOffset, from, to, visitor);
+    }
+
+    /**
+     * @brief Allocates a node.
+     * @param value The node's value.
+     * @return Index of the node.
+     */
+    int newNode(const Value &value) {
+        Node node;
+        node.value = value;
+        node.maxEnd = value.end;
+        node.offset = 0;
+        node.priority = nextPriority();
+        if (!freeList.empty()) {
+            int index = freeList.back();
+            freeList.pop_back();
+            nodes[index] = node;
+            return index;
+        }
+        nodes.push_back(node);
+        return static_cast<int>(nodes.size()) - 1;
+    }
+
+    /**
+     * @brief Shifts a whole subtree.
+     * @param index Root of the subtree, or -1.
+     * @param delta Distance to move.
+     */
+    void shift(int index, int delta) {
+        if (index < 0 || delta == 0) {
+            return;
+        }
+        Node &node = nodes[index];
+        node.value.start += delta;
+        node.value.end += delta;
+        node.maxEnd += delta;
+        node.offset += delta;
+    }
+
+    /**
+     * @brief Applies a node's pending offset to its children.
+     * @param index The node.
+     */
+    void push(int index) {
+        Node &node = nodes[index];
+        if (node.offset != 0) {
+            shift(node.left, node.offset);
+            shift(node.right, node.offset);
+            node.offset = 0;
+        }
+    }
+
+    /**
+     * @brief Recomputes a node's maxEnd from its children.
+     * @param index The node.
+     */
+    void pull(int index) {
+        Node &node = nodes[index];
+        node.maxEnd = node.value.end;
+        if (node.left >= 0) {
+            node.maxEnd = std::max(node.maxEnd, nodes[node.left].maxEnd + node.offset);
+        }
+        if (node.right >= 0) {
+            node.maxEnd = std::max(node.maxEnd, nodes[node.right].maxEnd + node.offset);
+        }
+    }
+
+    /**
+     * @brief Splits a subtree by start position.
+     * @param index Root of the subtree.
+     * @param key Split position.
+     * @param left Receives the values starting before key.
+     * @param right Receives the values starting at or after key.
+     */
+    void split(int index, int key, int &left, int &right) {
+        if (index < 0) {
+            left = right = -1;
+            return;
+        }
+        push(index);
+        Node &node = nodes[index];
+        if (node.value.start < key) {
+            split(node.right, key, node.right, right);
+            left = index;
+        } else {
+            split(node.left, key, left, node.left);
+            right = index;
+        }
+        pull(index);
+    }
+
+    /**
+     * @brief Joins two subtrees; every start in left must be at most every start in right.
+     * @param left Left subtree.
+     * @param right Right subtree.
+     * @return Root of the joined tree.
+     */
+    int merge(int left, int right) {
+        if (left < 0) {
+            return right;
+        }
+        if (right < 0) {
+            return left;
+        }
+        if (nodes[left].priority > nodes[right].priority) {
+            push(left);
+            int merged = merge(nodes[left].right, right);
+            nodes[left].right = merged;
+            pull(left);
+            return left;
+        }
+        push(right);
+        int merged = merge(left, nodes[right].left);
+        nodes[right].left = merged;
+        pull(right);
+        return right;
+    }
+
+    /**
+     * @brief Removes the values ending after a position from a subtree.
+     * @param index Root of the subtree.
+     * @param position The position.
+     * @param removed Receives the removed values.
+     * @return New root of the subtree.
+     */
+    int extractEndingAfter(int index, int position, std::vector<Value> &removed) {
+        if (index < 0 || nodes[index].maxEnd <= position) {
+            return index;
+        }
+        push(index);
+        int left = extractEndingAfter(nodes[index].left, position, removed);
+        int right = extractEndingAfter(nodes[index].right, position, removed);
+        if (nodes[index].value.end > position) {
+            removed.push_back(nodes[index].value);
+            freeList.push_back(index);
+            return merge(left, right);
+        }
+        nodes[index].left = left;
+        nodes[index].right = right;
+        pull(index);
+        return index;
+    }
+
+    /**
+     * @brief Builds a balanced subtree from sorted values.
+     * @param sorted Values sorted by start.
+     * @param first First index of the range.
+     * @param last Index after the range.
+     * @param priority Priority of the subtree's root; children get lower ones.
+     * @return Root of the subtree.
+     */
+    int build(const std::vector<Value> &sorted, int first, int last, quint32 priority) {
+        if (first >= last) {
+            return -1;
+        }
+        int middle = first + (last - first) / 2;
+        int index = newNode(sorted[middle]);
+        nodes[index].priority = priority;
+        int left = build(sorted, first, middle, priority - 1);
+        int right = build(sorted, middle + 1, last, priority - 1);
+        nodes[index].left = left;
+        nodes[index].right = right;
+        pull(index);
+        return index;
+    }
+
+    /**
+     * @brief Returns a pseudo-random priority.
+     * @return The priority.
+     */
+    quint32 nextPriority() {
+        // xorshift32: priorities only need to be unpredictable with respect to positions.
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        return seed;
+    }
+
+    std::vector<Node> nodes;   ///< Node storage.
+    std::vector<int> freeList; ///< Unused node indices.
+    int root = -1;             ///< Root node, or -1.
+    int count = 0;             ///< Number of values.
+    quint32 seed = 0x9e3779b9; ///< State of the priority generator.
+};
@@ -0,0 +1,169 @@
+/**
+ * @file LargeFileView.cpp
+ * @brief Implementation of the LargeFileView class for the Coda text editor.
+ *        Paints only the visible lines of a memory-mapped file, located through a sparse LineIndex.
+ * @author Dario Romandini
+ */
+
+#include "LargeFileView.h"
+#include <QPainter>
+#include <QPaintEvent>
+#include <QScrollBar>
+#include <climits>
+
+LargeFileGutter::LargeFileGutter(LargeFileView *view) : QWidget(view), view(view) {}
+
+void LargeFileGutter::paintEvent(QPaintEvent *event) {
+    view->gutterPaintEvent(event);
+}
+
+LargeFileView::LargeFileView(QWidget *parent) : QAbstractScrollArea(parent) {
+    gutter = new LargeFileGutter(this);
+
+    setFont(QFont("Courier", 12));
+    verticalScrollBar()->setSingleStep(1);
+    updateScrollBars();
+}
+
+bool LargeFileView::openFile(const QString &path) {
+    closeFile();
+    if (!file.open(path)) {
+        return false;
+    }
+
+    index.build(file.data(), static_cast<std::size_t>(file.size()), IndexStride);
+    lines = static_cast<qint64>(index.lineCount());
+    updateScrollBars();
+    viewport()->update();
+    gutter->update();
+    return true;
+}
+
+void LargeFileView::closeFile() {
+    file.close();
+    index = LineIndex();
+    lines = 0;
+    verticalScrollBar()->setValue(0);
+    horizontalScrollBar()->setValue(0);
+    updateScrollBars();
+    viewport()->update();
+}
+
+QString LargeFileView::currentFilePath() const {
+    return file.isOpen() ? file.path() : QString();
+}
+
+qint64 LargeFileView::lineCount() const {
+    return lines;
+}
+
+qint64 LargeFileView::lineEnd(qint64 start) const {
+    if (start >= file.size()) {
+        return file.size();
+    }
+    const char *begin = file.data();
+    return LineIndex::findNewline(begin + start, begin + file.size()) - begin;
+}
+
+QString LargeFileView::visibleText(qint64 start, qint64 end, int firstColumn, int columns) const {
+    // A column holds at least one UTF-8 byte and at most four, so this prefix always covers the window.
+    qint64 limit = qMin<qint64>(end - start, static_cast<qint64>(firstColumn + columns) * 4);
+    QString raw = QString::fromUtf8(file.data() + start, static_cast<int>(limit));
+
+    QString expanded;
+    expanded.reserve(qMin(raw.size(), firstColumn + columns));
+    for (QChar ch : raw) {
+        if (expanded.size() >= firstColumn + columns) {
+            break;
+        }
+        if (ch == QLatin1Char('\t')) {
+            expanded.append(QString(TabWidth - expanded.size() % TabWidth, QLatin1Char(' ')));
+        } else {
+            expanded.append(ch);
+        }
+    }
+    return expanded.mid(firstColumn, columns);
+}
+
+int LargeFileView::gutterWidth() const {
+    int digits = 1;
+    qint64 max = qMax<qint64>(1, lines);
+    while (max >= 10) {
+        max /= 10;
+        ++digits;
+    }
+    return 3 + fontMetrics().horizontalAdvance(QLatin1Char('9')) * digits;
+}
+
+void LargeFileView::updateScrollBars() {
+    int lineHeight = qMax(1, fontMetrics().height());
+    int charWidth = qMax(1, fontMetrics().horizontalAdvance(QLatin1Char('9')));
+    int visibleRows = qMax(1, viewport()->height() / lineHeight);
+    qint64 maxLine = qMax<qint64>(0, lines - visibleRows);
+
+    verticalScrollBar()->setRange(0, static_cast<int>(qMin<qint64>(maxLine, INT_MAX)));
+    verticalScrollBar()->setPageStep(visibleRows);
+
+    qint64 widest = qMin<qint64>(static_cast<qint64>(index.longestLine()), INT_MAX / charWidth);
+    horizontalScrollBar()->setRange(0, qMax(0, static_cast<int>(widest) * charWidth - viewport()->width()));
+    horizontalScrollBar()->setPageStep(viewport()->width());
+    horizontalScrollBar()->setSingleStep(charWidth);
+
+    setViewportMargins(gutterWidth(), 0, 0, 0);
+    QRect cr = contentsRect();
+    gutter->setGeometry(QRect(cr.left(), cr.top(), gutterWidth(), cr.height()));
+}
+
+void LargeFileView::resizeEvent(QResizeEvent *event) {
+    QAbstractScrollArea::resizeEvent(event);
+    updateScrollBars();
+}
+
+void LargeFileView::scrollContentsBy(int, int) {
+    viewport()->update();
+    gutter->update();
+}
+
+void LargeFileView::paintEvent(QPaintEvent *event) {
+    QPainter painter(viewport());
+    painter.fillRect(event->rect(), palette().base());
+    if (!file.isOpen() || lines == 0) {
+        return;
+    }
+
+    painter.setPen(palette().text().color());
+    QFontMetrics metrics = fontMetrics();
+    int lineHeight = metrics.height();
+    int charWidth = qMax(1, metrics.horizontalAdvance(QLatin1Char('9')));
+    int scrollX = horizontalScrollBar()->value();
+    int firstColumn = scrollX / charWidth;
+    int columns = viewport()->width() / charWidth + 2;
+    int x = -(scrollX % charWidth);
+
+    qint64 line = verticalScrollBar()->value();
+    qint64 offset = static_cast<qint64>(index.lineStart(static_cast<std::size_t>(line)));
+
+    for (int top = 0; top <= event->rect().bottom() && line < lines; top += lineHeight, ++line) {
+        qint64 end = lineEnd(offset);
+        qint64 textEnd = (end > offset && file.data()[end - 1] == '\r') ? end - 1 : end;
+
+        if (top + lineHeight >= event->rect().top()) {
+            painter.drawText(x, top + metrics.ascent(), visibleText(offset, textEnd, firstColumn, columns));
+        }
+        offset = end + 1;
+    }
+}
+
+void LargeFileView::gutterPaintEvent(QPaintEvent *event) {
+    QPainter painter(gutter);
+    painter.fillRect(event->rect(), Qt::lightGray);
+    painter.setPen(Qt::black);
+
+    int lineHeight = fontMetrics().height();
+    qint64 line = verticalScrollBar()->value();
+    for (int top = 0; top <= event->rect().bottom() && line < lines; top += lineHeight, ++line) {
+        if (top + lineHeight >= event->rect().top()) {
+            painter.drawText(0, top, gutter->width() - 5, lineHeight, Qt::AlignRight, QString::number(line + 1));
+        }
+    }
+}
@@ -0,0 +1,143 @@
+/**
+ * @file LargeFileView.h
+ * @brief Read-only viewer for very large files in the Coda text editor.
+ *        Memory-maps the file, keeps a sparse LineIndex and paints only the visible lines,
+ *        so no QTextDocument is ever built for the whole file.
+ * @author Dario Romandini
+ */
+
+#pragma once
+
+#include <QAbstractScrollArea>
+#include <QWidget>
+
+#include "LineIndex.h"
+#include "MappedFile.h"
+
+class LargeFileView;
+
+/**
+ * @class LargeFileGutter
+ * @brief Widget for displaying line numbers alongside the LargeFileView.
+ */
+class LargeFileGutter : public QWidget {
+public:
+    /**
+     * @brief Constructor for LargeFileGutter.
+     * @param view The viewer the gutter belongs to.
+     */
+    explicit LargeFileGutter(LargeFileView *view);
+
+protected:
+    /**
+     * @brief Paint event for the gutter.
+     * @param event The paint event.
+     */
+    void paintEvent(QPaintEvent *event) override;
+
+private:
+    LargeFileView *view; ///< The viewer whose line numbers are painted.
+};
+
+/**
+ * @class LargeFileView
+ * @brief Scroll area that displays a memory-mapped file line by line.
+ *        Open time and memory use stay roughly constant regardless of file size.
+ */
+class LargeFileView : public QAbstractScrollArea {
+    Q_OBJECT
+
+public:
+    /**
+     * @brief Constructor for LargeFileView.
+     * @param parent Optional parent widget.
+     */
+    explicit LargeFileView(QWidget *parent = nullptr);
+
+    /**
+     * @brief Maps a file and builds its line index.
+     * @param path Path of the file to display.
+     * @return True if the file could be mapped.
+     */
+    bool openFile(const QString &path);
+
+    /**
+     * @brief Unmaps the current file and clears the view.
+     */
+    void closeFile();
+
+    /**
+     * @brief Gets the path of the displayed file.
+     * @return File path as a QString, empty if no file is open.
+     */
+    QString currentFilePath() const;
+
+    /**
+     * @brief Returns the number of lines in the displayed file.
+     * @return Line count (a trailing newline starts a final empty line, as in the editor).
+     */
+    qint64 lineCount() const;
+
+    /**
+     * @brief Paints the line numbers in the gutter.
+     * @param event The paint event.
+     */
+    void gutterPaintEvent(QPaintEvent *event);
+
+protected:
+    /**
+     * @brief Paints the visible lines of the file into the viewport.
+     * @param event The paint event.
+     */
+    void paintEvent(QPaintEvent *event) override;
+
+    /**
+     * @brief Handles resizing of the viewer and adjusts the gutter and scroll bars.
+     * @param event The resize event.
+     */
+    void resizeEvent(QResizeEvent *event) override;
+
+    /**
+     * @brief Repaints the viewport and gutter after the scroll bars moved.
+     * @param dx Horizontal scroll offset.
+     * @param dy Vertical scroll offset.
+     */
+    void scrollContentsBy(int dx, int dy) override;
+
+private:
+    static constexpr std::size_t IndexStride = 1024; ///< Lines between two stored starts of the sparse index.
+    static constexpr int TabWidth = 4;                ///< Columns a tab character expands to.
+
+    /**
+     * @brief Returns the byte offset of the newline ending the line that starts at the given offset.
+     * @param start Byte offset of the line start.
+     * @return Offset of the '\n', or the file size for the last line.
+     */
+    qint64 lineEnd(qint64 start) const;
+
+    /**
+     * @brief Decodes the visible columns of a line, expanding tabs.
+     * @param start Byte offset of the line start.
+     * @param end Byte offset of the line end (exclusive, without line terminator).
+     * @param firstColumn First visible column.
+     * @param columns Number of visible columns.
+     * @return The visible part of the line.
+     */
+    QString visibleText(qint64 start, qint64 end, int firstColumn, int columns) const;
+
+    /**
+     * @brief Computes the width of the gutter.
+     * @return The width in pixels.
+     */
+    int gutterWidth() const;
+
+    /**
+     * @brief Updates scroll bar ranges from the line count and viewport size.
+     */
+    void updateScrollBars();
+
+    MappedFile file;         ///< The memory-mapped file being displayed.
+    LineIndex index;         ///< Sparse line-start index of the mapping.
+    qint64 lines = 0;        ///< Total number of lines.
+    LargeFileGutter *gutter; ///< Widget painting the line numbers.
+};
@@ -0,0 +1,204 @@
+/**
+ * @file LineIndex.cpp
+ * @brief Implementation of the LineIndex class for Coda. Splits the buffer into one chunk per core,
+ *        counts newlines per chunk in parallel, then fills the line-start table from the prefix sums.
+ * @author Dario Romandini
+ */
+
+#include "LineIndex.h"
+#include <algorithm>
+#include <bit>
+#include <thread>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CODA_LINEINDEX_SSE2 1
+#endif
+
+namespace {
+
+constexpr std::size_t MinChunkSize = 1 << 20; ///< Below this, spawning a thread costs more than scanning.
+
+/**
+ * @brief Calls f with a pointer to every newline in [begin, end), comparing 32 bytes at a time.
+ */
+template <typename Callback>
+void forEachNewline(const char *begin, const char *end, Callback &&f) {
+    const char *p = begin;
+#ifdef CODA_LINEINDEX_SSE2
+    const __m128i newline = _mm_set1_epi8('\n');
+    for (; end - p >= 32; p += 32) {
+        __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 16));
+        auto mask = static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(lo, newline))) |
+                    (static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(hi, newline))) << 16);
+        while (mask) {
+            f(p + std::countr_zero(mask));
+            mask &= mask - 1;
+        }
+    }
+#endif
+    for (; p < end; ++p) {
+        if (*p == '\n') {
+            f(p);
+        }
+    }
+}
+
+/**
+ * @brief Per-chunk results of the counting pass.
+ */
+struct ChunkStats {
+    std::uint64_t newlines = 0;   ///< Newlines in the chunk.
+    std::uint64_t crlf = 0;       ///< Newlines preceded by a carriage return.
+    std::int64_t first = -1;      ///< Offset of the first newline, -1 if none.
+    std::int64_t last = -1;       ///< Offset of the last newline, -1 if none.
+    std::uint64_t longest = 0;    ///< Longest line lying entirely between first and last.
+};
+
+/**
+ * @brief Length of the line content ending at a newline, without a preceding carriage return.
+ */
+std::uint64_t contentLength(const char *data, std::int64_t lineStart, std::int64_t newline) {
+    std::int64_t end = newline;
+    if (end > lineStart && data[end - 1] == '\r') {
+        --end;
+    }
+    return static_cast<std::uint64_t>(end - lineStart);
+}
+
+/**
+ * @brief Runs job(i) for every chunk, chunk 0 on the calling thread and the rest on workers.
+ */
+template <typename Job>
+void runChunks(std::size_t chunks, Job &&job) {
+    std::vector<std::thread> workers;
+    workers.reserve(chunks - 1);
+    for (std::size_t i = 1; i < chunks; ++i) {
+        workers.emplace_back(job, i);
+    }
+    job(0);
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+}
+
+} // namespace
+
+void LineIndex::build(const char *data, std::size_t size, std::size_t stride, unsigned threads) {
+    bytes = data;
+    length = size;
+    step = std::max<std::size_t>(1, stride);
+    starts.clear();
+    ending = LineEnding::None;
+    longest = 0;
+
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    std::size_t chunks = std::clamp<std::size_t>(size / MinChunkSize, 1, threads);
+    std::size_t chunkSize = size / chunks;
+    auto chunkBegin = [&](std::size_t i) { return i * chunkSize; };
+    auto chunkEnd = [&](std::size_t i) { return i + 1 == chunks ? size : (i + 1) * chunkSize; };
+
+    // Pass 1: count newlines, CRLF pairs and line lengths per chunk.
+    std::vector<ChunkStats> stats(chunks);
+    runChunks(chunks, [&](std::size_t i) {
+        ChunkStats &s = stats[i];
+        forEachNewline(data + chunkBegin(i), data + chunkEnd(i), [&](const char *hit) {
+            auto pos = static_cast<std::int64_t>(hit - data);
+            if (pos > 0 && data[pos - 1] == '\r') {
+                ++s.crlf;
+            }
+            if (s.last >= 0) {
+                s.longest = std::max(s.longest, contentLength(data, s.last + 1, pos));
+            } else {
+                s.first = pos;
+            }
+            s.last = pos;
+            ++s.newlines;
+        });
+    });
+
+    // Combine chunk results: prefix line numbers, CRLF totals and lines spanning chunk borders.
+    std::vector<std::uint64_t> firstLine(chunks, 0);
+    std::uint64_t newlines = 0;
+    std::uint64_t crlf = 0;
+    std::int64_t previous = -1;
+    for (std::size_t i = 0; i < chunks; ++i) {
+        firstLine[i] = newlines;
+        newlines += stats[i].newlines;
+        crlf += stats[i].crlf;
+        if (stats[i].first >= 0) {
+            longest = std::max({longest, stats[i].longest, contentLength(data, previous + 1, stats[i].first)});
+            previous = stats[i].last;
+        }
+    }
+    longest = std::max(longest, static_cast<std::uint64_t>(static_cast<std::int64_t>(size) - (previous + 1)));
+
+    lines = static_cast<std::size_t>(newlines) + 1;
+    if (newlines > 0) {
+        ending = crlf == 0 ? LineEnding::LF : (crlf == newlines ? LineEnding::CRLF : LineEnding::Mixed);
+    }
+
+    // Pass 2: every chunk knows its first line number and writes its own slots of the table.
+    starts.assign((lines - 1) / step + 1, 0);
+    runChunks(chunks, [&](std::size_t i) {
+        std::uint64_t line = firstLine[i];
+        forEachNewline(data + chunkBegin(i), data + chunkEnd(i), [&](const char *hit) {
+            ++line;
+            if (line % step == 0) {
+                starts[static_cast<std::size_t>(line / step)] = static_cast<std::uint64_t>(hit - data) + 1;
+            }
+        });
+    });
+}
+
+std::size_t LineIndex::lineCount() const {
+    return lines;
+}
+
+std::uint64_t LineIndex::lineStart(std::size_t line) const {
+    std::uint64_t offset = starts[line / step];
+    for (std::size_t skip = line % step; skip > 0; --skip) {
+        offset = static_cast<std::uint64_t>(findNewline(bytes + offset, bytes + length) - bytes) + 1;
+    }
+    return offset;
+}
+
+std::uint64_t LineIndex::lineEnd(std::size_t line) const {
+    std::uint64_t start = lineStart(line);
+    auto end = static_cast<std::uint64_t>(findNewline(bytes + start, bytes + length) - bytes);
+    if (end < length && end > start && bytes[end - 1] == '\r') {
+        --end;
+    }
+    return end;
+}
+
+LineEnding LineIndex::lineEnding() const {
+    return ending;
+}
+
+std::uint64_t LineIndex::longestLine() const {
+    return longest;
+}
+
+const char *LineIndex::findNewline(const char *begin, const char *end) {
+    const char *p = begin;
+#ifdef CODA_LINEINDEX_SSE2
+    const __m128i newline = _mm_set1_epi8('\n');
+    for (; end - p >= 16; p += 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        auto mask = static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, newline)));
+        if (mask) {
+            return p + std::countr_zero(mask);
+        }
+    }
+#endif
+    for (; p < end; ++p) {
+        if (*p == '\n') {
+            return p;
+        }
+    }
+    return end;
+}
@@ -0,0 +1,91 @@
+/**
+ * @file LineIndex.h
+ * @brief Line-start index over raw file bytes for the Coda text editor.
+ *        Scans for newlines with SIMD compares, splits the work across all cores and detects the
+ *        line-ending style in the same pass.
+ * @author Dario Romandini
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @enum LineEnding
+ * @brief Line terminator style detected in a file.
+ */
+enum class LineEnding {
+    None,  ///< The file contains no line terminator.
+    LF,    ///< Every line ends with "\n".
+    CRLF,  ///< Every line ends with "\r\n".
+    Mixed  ///< Both styles occur.
+};
+
+/**
+ * @class LineIndex
+ * @brief Records the byte offset of every stride-th line start of a byte buffer.
+ *        A stride of 1 stores every line; larger strides trade a short forward scan per lookup for memory.
+ *        The buffer is not copied and must outlive the index.
+ */
+class LineIndex {
+public:
+    /**
+     * @brief Scans a buffer and builds the index.
+     * @param data Pointer to the bytes to index.
+     * @param size Number of bytes.
+     * @param stride Lines between two stored line starts (at least 1).
+     * @param threads Number of worker threads, 0 to use every core.
+     */
+    void build(const char *data, std::size_t size, std::size_t stride = 1, unsigned threads = 0);
+
+    /**
+     * @brief Returns the number of lines (a trailing newline starts a final empty line, as in QTextDocument).
+     * @return Line count, 0 before build().
+     */
+    std::size_t lineCount() const;
+
+    /**
+     * @brief Returns the byte offset at which a line starts.
+     * @param line Zero-based line number, must be below lineCount().
+     * @return Byte offset into the indexed buffer.
+     */
+    std::uint64_t lineStart(std::size_t line) const;
+
+    /**
+     * @brief Returns the byte offset just past the content of a line, before its terminator.
+     * @param line Zero-based line number, must be below lineCount().
+     * @return Byte offset of the "\r\n" or "\n" ending the line, or the buffer size for the last line.
+     */
+    std::uint64_t lineEnd(std::size_t line) const;
+
+    /**
+     * @brief Returns the detected line-ending style.
+     * @return The LineEnding of the indexed buffer.
+     */
+    LineEnding lineEnding() const;
+
+    /**
+     * @brief Returns the length of the longest line in bytes, terminator excluded.
+     * @return Longest line length.
+     */
+    std::uint64_t longestLine() const;
+
+    /**
+     * @brief Finds the next newline at or after a position using SIMD compares.
+     * @param begin Start of the range to search.
+     * @param end End of the range to search.
+     * @return Pointer to the newline, or end if there is none.
+     */
+    static const char *findNewline(const char *begin, const char *end);
+
+private:
+    const char *bytes = nullptr;       ///< The indexed buffer (not owned).
+    std::size_t length = 0;            ///< Size of the indexed buffer.
+    std::size_t step = 1;              ///< Lines between two stored starts.
+    std::size_t lines = 0;             ///< Total number of lines.
+    std::vector<std::uint64_t> starts; ///< Byte offset of every step-th line start.
+    LineEnding ending = LineEnding::None; ///< Detected line-ending style.
+    std::uint64_t longest = 0;         ///< Longest line length in bytes.
+};
@@ -0,0 +1,118 @@
+/**
+ * @file LongLineLayout.cpp
+ * @brief Implementation of the LongLineLayout class for Coda. Long blocks keep a line count of one, as
+ *        QPlainTextDocumentLayout gives every unwrapped block, but never get QTextLine objects.
+ * @author Dario Romandini
+ */
+
+#include "LongLineLayout.h"
+#include <QFontMetricsF>
+#include <QTextDocument>
+#include <QtMath>
+
+LongLineLayout::LongLineLayout(QTextDocument *document) : QPlainTextDocumentLayout(document) {}
+
+bool LongLineLayout::isLongBlock(const QTextBlock &block) {
+    return block.isValid() && block.length() - 1 > Threshold;
+}
+
+qreal LongLineLayout::columnWidth() const {
+    return QFontMetricsF(document()->defaultFont()).horizontalAdvance(QLatin1Char(' '));
+}
+
+qreal LongLineLayout::rowHeight() const {
+    // Same as a QTextLine with its leading included, plus the negative leading layoutBlock() adds.
+    QFontMetricsF metrics(document()->defaultFont());
+    qreal height = qCeil(metrics.ascent() + metrics.descent() + qMax<qreal>(metrics.leading(), 0));
+    if (metrics.leading() < 0) {
+        height += qCeil(metrics.leading());
+    }
+    return height;
+}
+
+QRectF LongLineLayout::blockBoundingRect(const QTextBlock &block) const {
+    // QPlainTextDocumentLayout lays a hidden block out before finding it has no rectangle, and
+    // QPlainTextEdit asks for every hidden block it paints past.
+    if (!block.isVisible()) {
+        return QRectF();
+    }
+    if (!isLongBlock(block)) {
+        return QPlainTextDocumentLayout::blockBoundingRect(block);
+    }
+    qreal height = rowHeight();
+    if (!block.next().isValid()) {
+        height += document()->documentMargin();
+    }
+    return QRectF(0, 0, 0, height);
+}
+
+QSizeF LongLineLayout::documentSize() const {
+    QSizeF size = QPlainTextDocumentLayout::documentSize();
+    if (longest > 0) {
+        qreal width = longest * columnWidth() + 2 * document()->documentMargin();
+        size.setWidth(qMax(size.width(), qMin(width, MaximumWidth)));
+    }
+    return size;
+}
+
+void LongLineLayout::documentChanged(int from, int charsRemoved, int charsAdded) {
+    QTextDocument *doc = document();
+    int newBlockCount = doc->blockCount();
+    int delta = newBlockCount - knownBlockCount;
+    // The changed blocks, found the way QPlainTextDocumentLayout finds them.
+    QTextBlock first = doc->findBlock(from);
+    QTextBlock last = doc->findBlock(qMax(0, from + charsRemoved + charsAdded - 1));
+    int firstNumber = first.blockNumber();
+    int lastNumber = last.isValid() ? last.blockNumber() : newBlockCount - 1;
+
+    // Long blocks of the old changed range are dropped, later ones move by the change in block count.
+    int previousLongest = longest;
+    if (!longBlocks.isEmpty()) {
+        if (delta == 0) {
+            auto block = longBlocks.lowerBound(firstNumber);
+            while (block != longBlocks.end() && block.key() <= lastNumber) {
+                block = longBlocks.erase(block);
+            }
+        } else {
+            QMap<int, int> moved;
+            for (auto block = longBlocks.constBegin(); block != longBlocks.constEnd(); ++block) {
+                if (block.key() < firstNumber) {
+                    moved.insert(block.key(), block.value());
+                } else if (block.key() > lastNumber - delta) {
+                    moved.insert(block.key() + delta, block.value());
+                }
+            }
+            longBlocks.swap(moved);
+        }
+    }
+    for (QTextBlock block = first; block.isValid(); block = block.next()) {
+        if (isLongBlock(block)) {
+            longBlocks.insert(block.blockNumber(), block.length() - 1);
+        }
+        if (block == last) {
+            break;
+        }
+    }
+    longest = 0;
+    for (int length : qAsConst(longBlocks)) {
+        longest = qMax(longest, length);
+    }
+
+    bool inPlace = first == last && delta == 0 && isLongBlock(first);
+    knownBlockCount = newBlockCount;
+    if (inPlace) {
+        // What QPlainTextDocumentLayout does for an edit inside one block, minus laying the block out.
+        first.clearLayout();
+        first.setLineCount(first.isVisible() ? 1 : 0);
+        if (longest != previousLongest) {
+            emit documentSizeChanged(documentSize());
+        }
+        emit updateBlock(first);
+        return;
+    }
+
+    QPlainTextDocumentLayout::documentChanged(from, charsRemoved, charsAdded);
+    if (longest != previousLongest) {
+        emit documentSizeChanged(documentSize());
+    }
+}
@@ -0,0 +1,86 @@
+/**
+ * @file LongLineLayout.h
+ * @brief Document layout of the Coda text editor that never lays out very long lines.
+ *        QPlainTextDocumentLayout shapes a whole block whenever it is edited or first shown, which for a
+ *        single-line minified file means shaping megabytes of text on the UI thread. Blocks above a length
+ *        threshold are left without a QTextLayout instead; EditorWidget paints the visible columns of
+ *        them itself.
+ * @author Dario Romandini
+ */
+
+#pragma once
+
+#include <QMap>
+#include <QPlainTextDocumentLayout>
+#include <QTextBlock>
+
+/**
+ * @class LongLineLayout
+ * @brief QPlainTextDocumentLayout that gives long blocks a fixed one-row geometry without shaping them.
+ *        Long blocks are measured in columns of the advance of a space, which is exact for the
+ *        monospaced editor font. Their rows are as high as a laid-out line, so the vertical scroll bar
+ *        keeps counting lines.
+ */
+class LongLineLayout : public QPlainTextDocumentLayout {
+    Q_OBJECT
+
+public:
+    static constexpr int Threshold = 10000; ///< Lines longer than this, in UTF-16 units, are never laid out.
+
+    /**
+     * @brief Constructor.
+     * @param document The document to lay out.
+     */
+    explicit LongLineLayout(QTextDocument *document);
+
+    /**
+     * @brief Returns whether a block is too long to be laid out.
+     * @param block The block.
+     * @return True if the block's text is longer than Threshold.
+     */
+    static bool isLongBlock(const QTextBlock &block);
+
+    /**
+     * @brief Returns the width of one column of a long block.
+     * @return Advance of a space in the document's default font.
+     */
+    qreal columnWidth() const;
+
+    /**
+     * @brief Returns the height of the row of a long block.
+     * @return Height of one laid-out line in the document's default font.
+     */
+    qreal rowHeight() const;
+
+    /**
+     * @brief Returns the bounding rectangle of a block. Long blocks are not laid out; their rectangle is
+     *        one row high and has no width, which also keeps QPlainTextEdit from looking up their lines.
+     *        Hidden blocks, such as folded lines, are empty without being laid out first.
+     * @param block The block.
+     * @return The block's rectangle relative to its top.
+     */
+    QRectF blockBoundingRect(const QTextBlock &block) const override;
+
+    /**
+     * @brief Returns the size of the document, wide enough for the longest long block.
+     * @return The document size.
+     */
+    QSizeF documentSize() const override;
+
+protected:
+    /**
+     * @brief Handles an edit. An edit inside one long block only drops its layout and repaints it;
+     *        anything else is laid out by QPlainTextDocumentLayout.
+     * @param from Position of the change.
+     * @param charsRemoved Number of characters removed.
+     * @param charsAdded Number of characters added.
+     */
+    void documentChanged(int from, int charsRemoved, int charsAdded) override;
+
+private:
+    static constexpr qreal MaximumWidth = 1e9; ///< Keeps the horizontal scroll range within an int.
+
+    int knownBlockCount = 1;   ///< Block count after the last change, as QPlainTextDocumentLayout counts it.
+    QMap<int, int> longBlocks; ///< Lengths of the long blocks by block number.
+    int longest = 0;           ///< Length of the longest long block, 0 if there is none.
+};
@@ -0,0 +1,212 @@
+/**
+ * @file LuaAllocator.cpp
+ * @brief Implementation of the LuaAllocator class for Coda.
+ * @author Dario Romandini
+ */
+
+#include "LuaAllocator.h"
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+/**
+ * @struct BlockHeader
+ * @brief Stored in front of every block. Keeps the payload 8-byte aligned, as Lua requires.
+ */
+struct BlockHeader {
+    quint32 owner;     ///< Owner charged for the block.
+    quint32 sizeClass; ///< Size class of the block, or LargeClass.
+};
+static_assert(sizeof(BlockHeader) == 8, "Lua payloads must stay 8-byte aligned");
+
+constexpr size_t ClassSizes[] = {16,  32,  48,  64,  80,  96,  112, 128, 144,
+                                 160, 176, 192, 208, 224, 240, 256, 384, 512};
+
+BlockHeader *headerOf(void *payload) {
+    return static_cast<BlockHeader *>(payload) - 1;
+}
+
+void *payloadOf(void *header) {
+    return static_cast<BlockHeader *>(header) + 1;
+}
+
+} // namespace
+
+LuaAllocator::LuaAllocator() {
+    owners.emplace_back();
+}
+
+LuaAllocator::~LuaAllocator() {
+    for (void *slab : slabs) {
+        std::free(slab);
+    }
+}
+
+void *LuaAllocator::allocate(void *allocator, void *block, size_t oldSize, size_t newSize) {
+    auto *self = static_cast<LuaAllocator *>(allocator);
+    if (newSize == 0) {
+        if (block) {
+            BlockHeader *header = headerOf(block);
+            self->owners[header->owner].bytes.fetch_sub(oldSize, std::memory_order_relaxed);
+            self->releaseBlock(header);
+        }
+        return nullptr;
+    }
+    return self->resize(block, block ? oldSize : 0, newSize);
+}
+
+int LuaAllocator::owner(const std::string &plugin) {
+    for (size_t id = 1; id < owners.size(); ++id) {
+        if (owners[id].plugin == plugin) {
+            return static_cast<int>(id);
+        }
+    }
+    owners.emplace_back();
+    owners.back().plugin = plugin;
+    return static_cast<int>(owners.size() - 1);
+}
+
+void LuaAllocator::setOwner(int id) {
+    current = id;
+}
+
+int LuaAllocator::currentOwner() const {
+    return current;
+}
+
+void LuaAllocator::setCap(int id, quint64 bytes) {
+    owners[id].cap = bytes;
+}
+
+quint64 LuaAllocator::cap(int id) const {
+    return owners[id].cap;
+}
+
+quint64 LuaAllocator::totalAllocated() const {
+    return allocatedTotal;
+}
+
+int LuaAllocator::refusedOwner() const {
+    return refused;
+}
+
+void LuaAllocator::clearRefused() {
+    refused = -1;
+}
+
+QVector<MemoryUsage> LuaAllocator::usage() const {
+    QVector<MemoryUsage> result;
+    for (const Owner &entry : owners) {
+        result.append(MemoryUsage{entry.plugin, entry.bytes, entry.peak, entry.cap});
+    }
+    return result;
+}
+
+quint32 LuaAllocator::sizeClass(size_t total) {
+    if (total <= 256) {
+        return static_cast<quint32>((total + 15) / 16 - 1);
+    }
+    if (total <= 384) {
+        return 16;
+    }
+    if (total <= 512) {
+        return 17;
+    }
+    return LargeClass;
+}
+
+void *LuaAllocator::takeBlock(quint32 blockClass) {
+    if (!freeLists[blockClass]) {
+        void *slab = std::malloc(SlabSize);
+        if (!slab) {
+            return nullptr;
+        }
+        slabs.push_back(slab);
+
+        // Thread the new blocks onto the free list, lowest address first.
+        size_t size = ClassSizes[blockClass];
+        char *begin = static_cast<char *>(slab);
+        char *last = begin + (SlabSize / size - 1) * size;
+        for (char *block = last; block >= begin; block -= size) {
+            *reinterpret_cast<void **>(block) = freeLists[blockClass];
+            freeLists[blockClass] = block;
+        }
+    }
+
+    void *block = freeLists[blockClass];
+    freeLists[blockClass] = *static_cast<void **>(block);
+    return block;
+}
+
+void LuaAllocator::releaseBlock(void *header) {
+    quint32 blockClass = static_cast<BlockHeader *>(header)->sizeClass;
+    if (blockClass == LargeClass) {
+        std::free(header);
+        return;
+    }
+    *static_cast<void **>(header) = freeLists[blockClass];
+    freeLists[blockClass] = header;
+}
+
+void *LuaAllocator::resize(void *block, size_t oldSize, size_t newSize) {
+    BlockHeader *header = block ? headerOf(block) : nullptr;
+    quint32 previousOwner = header ? header->owner : current;
+
+    // Growing a block charges it to the current owner. Only growth is checked against the cap, since Lua
+    // must always be able to shrink, and a shrunk block stays with its owner.
+    quint32 newOwner = newSize > oldSize ? current : previousOwner;
+    Owner &charged = owners[newOwner];
+    quint64 cap = charged.cap;
+    if (cap > 0 && newSize > oldSize) {
+        quint64 held = charged.bytes - (previousOwner == newOwner ? oldSize : 0);
+        if (held + newSize > cap) {
+            refused = current;
+            return nullptr;
+        }
+    }
+
+    size_t total = newSize + sizeof(BlockHeader);
+    quint32 newClass = sizeClass(total);
+    void *result;
+    if (header && header->sizeClass == newClass && newClass != LargeClass) {
+        result = header;
+    } else if (header && header->sizeClass == LargeClass && newClass == LargeClass) {
+        result = std::realloc(header, total);
+    } else {
+        result = newClass == LargeClass ? std::malloc(total) : takeBlock(newClass);
+        if (result && header) {
+            std::memcpy(payloadOf(result), block, qMin(oldSize, newSize));
+            releaseBlock(header);
+        }
+    }
+    if (!result) {
+        if (newSize > oldSize) {
+            return nullptr;
+        }
+        // A shrink that cannot move keeps its block, which still records its real class.
+        owners[previousOwner].bytes.fetch_sub(oldSize - newSize, std::memory_order_relaxed);
+        return block;
+    }
+
+    if (header) {
+        owners[previousOwner].bytes.fetch_sub(oldSize, std::memory_order_relaxed);
+    }
+    charge(newOwner, newSize);
+    if (newSize > oldSize) {
+        allocatedTotal += newSize - oldSize;
+    }
+
+    auto *newHeader = static_cast<BlockHeader *>(result);
+    newHeader->owner = newOwner;
+    newHeader->sizeClass = newClass;
+    return payloadOf(result);
+}
+
+void LuaAllocator::charge(quint32 id, quint64 bytes) {
+    Owner &entry = owners[id];
+    quint64 held = entry.bytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+    if (held > entry.peak.load(std::memory_order_relaxed)) {
+        entry.peak.store(held, std::memory_order_relaxed);
+    }
+}
@@ -0,0 +1,179 @@
+/**
+ * @file LuaAllocator.h
+ * @brief Pooled allocator with per-plugin accounting for the Lua states of Coda.
+ *        Small blocks come from size-class free lists carved out of 64 KiB slabs, which avoids a malloc
+ *        call for most of Lua's strings, tables and closures. Every block records the plugin that owns it,
+ *        so the memory in use is known per plugin and each plugin can be held to a memory cap.
+ * @author Dario Romandini
+ */
+
+#pragma once
+
+#include <QVector>
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <string>
+#include <vector>
+
+/**
+ * @struct MemoryUsage
+ * @brief Memory held by one plugin in a Lua state.
+ */
+struct MemoryUsage {
+    std::string plugin; ///< Script path of the plugin; empty for the engine itself.
+    quint64 bytes;      ///< Bytes in use.
+    quint64 peakBytes;  ///< Highest number of bytes in use so far.
+    quint64 capBytes;   ///< Cap, or 0 if there is none.
+};
+
+/**
+ * @class LuaAllocator
+ * @brief lua_Alloc implementation for one Lua state.
+ *        Allocations are charged to the current owner, set with setOwner() around plugin calls. Growing a
+ *        block beyond the owner's cap fails, which Lua reports as a memory error after an emergency
+ *        collection. Slabs are kept until the allocator is destroyed, after the Lua state. Once every owner
+ *        exists, usage() may be called from any thread; everything else belongs to the state's thread.
+ */
+class LuaAllocator {
+public:
+    static constexpr int EngineOwner = 0; ///< Owner of allocations made outside plugin calls.
+
+    /**
+     * @brief Constructor.
+     */
+    LuaAllocator();
+
+    /**
+     * @brief Destructor. Releases the slabs; the Lua state must already be closed.
+     */
+    ~LuaAllocator();
+
+    LuaAllocator(const LuaAllocator &) = delete;
+    LuaAllocator &operator=(const LuaAllocator &) = delete;
+
+    /**
+     * @brief The lua_Alloc function; pass the allocator as its user data.
+     * @param allocator The LuaAllocator.
+     * @param block Block to resize or free, or nullptr to allocate.
+     * @param oldSize Current size of the block; for new blocks, the type of the object.
+     * @param newSize Requested size; 0 frees the block.
+     * @return The new block, or nullptr if the owner's cap or the system refused the memory.
+     */
+    static void *allocate(void *allocator, void *block, size_t oldSize, size_t newSize);
+
+    /**
+     * @brief Returns the owner id of a plugin, creating it on first use.
+     * @param plugin Script path of the plugin.
+     * @return The owner id.
+     */
+    int owner(const std::string &plugin);
+
+    /**
+     * @brief Sets the owner charged for the following allocations.
+     * @param id The owner id.
+     */
+    void setOwner(int id);
+
+    /**
+     * @brief Returns the owner charged for allocations.
+     * @return The owner id.
+     */
+    int currentOwner() const;
+
+    /**
+     * @brief Sets the cap of an owner.
+     * @param id The owner id.
+     * @param bytes Most bytes the owner may hold; 0 removes the cap.
+     */
+    void setCap(int id, quint64 bytes);
+
+    /**
+     * @brief Returns the cap of an owner.
+     * @param id The owner id.
+     * @return The cap, or 0 if there is none.
+     */
+    quint64 cap(int id) const;
+
+    /**
+     * @brief Returns the bytes allocated since the state was created, without subtracting frees.
+     * @return Cumulative allocated bytes.
+     */
+    quint64 totalAllocated() const;
+
+    /**
+     * @brief Returns the owner whose allocation was last refused for being over its cap.
+     * @return The owner id, or -1; reset with clearRefused().
+     */
+    int refusedOwner() const;
+
+    /**
+     * @brief Forgets the last refused allocation.
+     */
+    void clearRefused();
+
+    /**
+     * @brief Returns the memory held by every owner.
+     * @return One entry per owner, the engine first.
+     */
+    QVector<MemoryUsage> usage() const;
+
+private:
+    static constexpr size_t SlabSize = 64 * 1024; ///< Bytes carved into blocks at once.
+    static constexpr int ClassCount = 18;          ///< Size classes: 16 to 256 in steps of 16, 384, 512.
+    static constexpr quint32 LargeClass = 0xffffffff; ///< Marks blocks allocated with malloc.
+
+    /**
+     * @struct Owner
+     * @brief Accounting of one owner.
+     */
+    struct Owner {
+        std::string plugin;              ///< Script path of the plugin.
+        std::atomic<quint64> bytes{0};   ///< Bytes in use.
+        std::atomic<quint64> peak{0};    ///< Highest bytes in use.
+        std::atomic<quint64> cap{0};     ///< Cap, or 0.
+    };
+
+    /**
+     * @brief Returns the size class of a block.
+     * @param total Size of the block including its header.
+     * @return The class index, or LargeClass.
+     */
+    static quint32 sizeClass(size_t total);
+
+    /**
+     * @brief Allocates a block of a size class.
+     * @param sizeClass The class index.
+     * @return The block including its header, or nullptr.
+     */
+    void *takeBlock(quint32 sizeClass);
+
+    /**
+     * @brief Returns a block to its free list, or to the system if it is large.
+     * @param header The block including its header.
+     */
+    void releaseBlock(void *header);
+
+    /**
+     * @brief Allocates or resizes a block for the current owner.
+     * @param block Payload of the block, or nullptr.
+     * @param oldSize Payload size of the block.
+     * @param newSize Requested payload size.
+     * @return The new payload, or nullptr.
+     */
+    void *resize(void *block, size_t oldSize, size_t newSize);
+
+    /**
+     * @brief Adds bytes to an owner.
+     * @param id The owner id.
+     * @param bytes Bytes to add.
+     */
+    void charge(quint32 id, quint64 bytes);
+
+    void *freeLists[ClassCount] = {};  ///< First free block of each class, linked through their first word.
+    std::vector<void *> slabs;         ///< Slabs carved into blocks.
+    std::deque<Owner> owners;          ///< Owners by id; a deque so that entries never move.
+    int current = EngineOwner;         ///< Owner charged for allocations.
+    int refused = -1;                  ///< Owner whose last allocation was refused, or -1.
+    quint64 allocatedTotal = 0;        ///< Cumulative allocated bytes.
+};
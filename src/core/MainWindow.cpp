@@ -6,43 +6,156 @@
  * @author Dario Romandini
  */
 
-#include <QFile>
+#include <QAction>
 #include <QFileDialog>
 #include <QMessageBox>
-#include <QTextStream>
 #include <QMenuBar>
 #include <QStandardPaths>
-#include <KSyntaxHighlighting/Repository>
+#include <QStackedWidget>
+#include <QDir>
+#include <QFileInfo>
+#include <QProgressBar>
+#include <QPushButton>
+#include <QStatusBar>
+#include <QDialog>
+#include <QDialogButtonBox>
+#include <QDockWidget>
+#include <QTextBlock>
+#include <QHeaderView>
+#include <QInputDialog>
+#include <QTabWidget>
+#include <QTableWidget>
+#include <QVBoxLayout>
+#include <climits>
 
 #include "MainWindow.h"
 #include "EditorWidget.h"
+#include "LargeFileView.h"
+#include "FileFollower.h"
+#include "FileLoader.h"
+#include "FileSaver.h"
+#include "FindBar.h"
+#include "WorkspaceSearchPanel.h"
 #include "KSyntaxHighlightingAdapter.h"
+#include "HighlightScheduler.h"
+#include "SyntaxRepository.h"
 
 MainWindow::MainWindow(QWidget *parent)
-    : QMainWindow(parent), editor(new EditorWidget(this)), scriptingEngine(new ScriptingEngine(editor)),
-      pluginManager(new PluginManager(scriptingEngine)) {
-    setCentralWidget(editor);
+    : QMainWindow(parent), editor(new EditorWidget(this)), largeFileView(new LargeFileView(this)),
+      scriptingEngine(new ScriptingEngine(editor)), pluginManager(new PluginManager(scriptingEngine)) {
+    views = new QStackedWidget(this);
+    views->addWidget(editor);
+    views->addWidget(largeFileView);
+    findBar = new FindBar(editor, this);
+    auto *central = new QWidget(this);
+    auto *centralLayout = new QVBoxLayout(central);
+    centralLayout->setContentsMargins(0, 0, 0, 0);
+    centralLayout->setSpacing(0);
+    centralLayout->addWidget(views);
+    centralLayout->addWidget(findBar);
+    setCentralWidget(central);
     setWindowTitle("Coda");
 
+    workspaceSearch = new WorkspaceSearchPanel(this);
+    workspaceSearchDock = new QDockWidget("Find in Files", this);
+    workspaceSearchDock->setObjectName("FindInFiles");
+    workspaceSearchDock->setWidget(workspaceSearch);
+    addDockWidget(Qt::BottomDockWidgetArea, workspaceSearchDock);
+    workspaceSearchDock->hide();
+    connect(workspaceSearch, &WorkspaceSearchPanel::hitActivated, this, &MainWindow::openHit);
+
     auto *fileMenu = menuBar()->addMenu("&File");
     fileMenu->addAction("Open", this, &MainWindow::openFile);
+    fileMenu->addAction("Open in Viewer", this, &MainWindow::openFileInViewer);
+    fileMenu->addSeparator();
+    followAction = fileMenu->addAction("Follow");
+    followAction->setCheckable(true);
+    connect(followAction, &QAction::toggled, this, &MainWindow::setFollowing);
+    fileMenu->addAction("Follow Line Limit...", this, &MainWindow::setFollowLineLimit);
+    fileMenu->addSeparator();
     fileMenu->addAction("Save", this, &MainWindow::saveFile);
     fileMenu->addAction("Save As", this, &MainWindow::saveFileAs);
     fileMenu->addSeparator();
     fileMenu->addAction("Exit", this, &QWidget::close);
 
+    // Find Next and Find Previous open the bar first, so they never search with an invisible pattern.
+    auto *editMenu = menuBar()->addMenu("&Edit");
+    editMenu->addAction("Find", this, [this] { showFindBar(false); }, QKeySequence::Find);
+    editMenu->addAction("Replace", this, [this] { showFindBar(true); }, QKeySequence(Qt::CTRL + Qt::Key_H));
+    editMenu->addAction("Find Next", this, [this] {
+        if (findBar->isVisible()) {
+            findBar->findNext();
+        } else {
+            showFindBar(false);
+        }
+    }, QKeySequence::FindNext);
+    editMenu->addAction("Find Previous", this, [this] {
+        if (findBar->isVisible()) {
+            findBar->findPrevious();
+        } else {
+            showFindBar(false);
+        }
+    }, QKeySequence::FindPrevious);
+    editMenu->addSeparator();
+    editMenu->addAction("Find in Files", this, &MainWindow::showWorkspaceSearch,
+                        QKeySequence(Qt::CTRL + Qt::SHIFT + Qt::Key_F));
+
     auto *viewMenu = menuBar()->addMenu("&View");
     viewMenu->addAction("Light Theme", this, &MainWindow::setLightTheme);
     viewMenu->addAction("Dark Theme", this, &MainWindow::setDarkTheme);
+    viewMenu->addSeparator();
+    QAction *relativeNumbers = viewMenu->addAction("Relative Line Numbers");
+    relativeNumbers->setCheckable(true);
+    connect(relativeNumbers, &QAction::toggled, editor, &EditorWidget::setRelativeLineNumbers);
+    viewMenu->addSeparator();
+    viewMenu->addAction("Fold", this, [this] { editor->fold(editor->textCursor().blockNumber()); },
+                        QKeySequence(Qt::CTRL + Qt::SHIFT + Qt::Key_BracketLeft));
+    viewMenu->addAction("Unfold", this, [this] { editor->unfold(editor->textCursor().blockNumber()); },
+                        QKeySequence(Qt::CTRL + Qt::SHIFT + Qt::Key_BracketRight));
+    viewMenu->addAction("Fold All", editor, &EditorWidget::foldAll);
+    viewMenu->addAction("Unfold All", editor, &EditorWidget::unfoldAll);
 
     auto *toolsMenu = menuBar()->addMenu("&Tools");
     toolsMenu->addAction("Run Lua Script", this, &MainWindow::runLuaScript);
+    toolsMenu->addAction("Highlighting Metrics", this, &MainWindow::showHighlightingMetrics);
+    toolsMenu->addAction("Plugin Profile", this, &MainWindow::showPluginProfile);
+
+    fileLoader = new FileLoader(this);
+    connect(fileLoader, &FileLoader::started, this, &MainWindow::onLoadStarted);
+    connect(fileLoader, &FileLoader::chunkLoaded, this, &MainWindow::onChunkLoaded);
+    connect(fileLoader, &FileLoader::progress, this, &MainWindow::onLoadProgress);
+    connect(fileLoader, &FileLoader::finished, this, &MainWindow::onLoadFinished);
+    connect(fileLoader, &FileLoader::failed, this, &MainWindow::onLoadFailed);
+    connect(fileLoader, &FileLoader::cancelled, this, &MainWindow::onLoadCancelled);
+
+    fileFollower = new FileFollower(this);
+    connect(fileFollower, &FileFollower::appended, this, &MainWindow::onFollowAppended);
+    connect(fileFollower, &FileFollower::reset, this, &MainWindow::onFollowReset);
+
+    fileReloader = new FileReloader(this);
+    connect(fileReloader, &FileReloader::changed, this, &MainWindow::onFileChanged);
+    connect(fileReloader, &FileReloader::diffed, this, &MainWindow::onFileDiffed);
+
+    fileSaver = new FileSaver(this);
+    connect(fileSaver, &FileSaver::saved, this, &MainWindow::onSaveFinished);
+    connect(fileSaver, &FileSaver::failed, this, &MainWindow::onSaveFailed);
+
+    loadProgress = new QProgressBar(this);
+    loadProgress->setRange(0, 100);
+    loadProgress->setMaximumWidth(200);
+    cancelLoadButton = new QPushButton("Cancel", this);
+    connect(cancelLoadButton, &QPushButton::clicked, fileLoader, &FileLoader::cancel);
+    statusBar()->addPermanentWidget(loadProgress);
+    statusBar()->addPermanentWidget(cancelLoadButton);
+    hideLoadProgress();
 
     QString pluginConfigPath = QStandardPaths::locate(QStandardPaths::AppDataLocation, "plugins.json");
     pluginManager->loadPlugins(pluginConfigPath);
 }
 
 MainWindow::~MainWindow() {
+    delete fileLoader;
+    delete fileSaver;
     delete pluginManager;
     delete scriptingEngine;
 }
@@ -50,45 +163,329 @@ MainWindow::~MainWindow() {
 void MainWindow::openFile() {
     QString fileName = QFileDialog::getOpenFileName(this, "Open File");
     if (!fileName.isEmpty()) {
-        QFile file(fileName);
-        if (file.open(QIODevice::ReadOnly | QIODevice::Text)) {
-            QTextStream in(&file);
-            editor->setPlainText(in.readAll());
-            currentFilePath = fileName;
-            editor->setCurrentFilePath(currentFilePath);
-            setWindowTitle("Coda - " + currentFilePath);
-
-            auto *highlighter = new KSyntaxHighlightingAdapter(editor->document());
-            highlighter->setFilePath(currentFilePath);
-            editor->setSyntaxHighlighter(highlighter);
-
-            scriptingEngine->triggerEvent("onFileOpen", currentFilePath.toStdString());
-        } else {
-            QMessageBox::warning(this, "Error", "Failed to open file");
+        openPath(fileName);
+    }
+}
+
+void MainWindow::openPath(const QString &fileName) {
+    pendingHit = PendingHit();
+    if (QFileInfo(fileName).size() >= LargeFileThreshold) {
+        loadFileInViewer(fileName);
+    } else {
+        loadFile(fileName);
+    }
+}
+
+void MainWindow::openHit(const QString &path, int line, int column, int length) {
+    bool isOpen = views->currentWidget() == editor && !fileLoader->isLoading() &&
+                  QFileInfo(currentFilePath) == QFileInfo(path);
+    if (isOpen) {
+        selectInEditor(line, column, length);
+        return;
+    }
+    openPath(path);
+    // The viewer has no selection: a hit in a large file only opens the file.
+    if (fileLoader->isLoading()) {
+        pendingHit.path = path;
+        pendingHit.line = line;
+        pendingHit.column = column;
+        pendingHit.length = length;
+    }
+}
+
+void MainWindow::selectInEditor(int line, int column, int length) {
+    QTextBlock block = editor->document()->findBlockByNumber(line - 1);
+    if (!block.isValid()) {
+        return;
+    }
+    int start = block.position() + qMin(column - 1, block.length() - 1);
+    QTextCursor cursor(editor->document());
+    cursor.setPosition(start);
+    cursor.setPosition(qMin(start + length, editor->document()->characterCount() - 1), QTextCursor::KeepAnchor);
+    editor->setTextCursor(cursor);
+    editor->centerCursor();
+    editor->setFocus();
+}
+
+void MainWindow::openFileInViewer() {
+    QString fileName = QFileDialog::getOpenFileName(this, "Open File in Viewer");
+    if (!fileName.isEmpty()) {
+        loadFileInViewer(fileName);
+    }
+}
+
+void MainWindow::loadFile(const QString &fileName) {
+    // Cancelling a running load resets the window, so it has to happen before the new state is set.
+    followAction->setChecked(false);
+    fileReloader->stop();
+    fileLoader->cancel();
+    loadedFileSize = 0;
+    largeFileView->closeFile();
+    views->setCurrentWidget(editor);
+    currentFilePath = fileName;
+    editor->setCurrentFilePath(currentFilePath);
+    setWindowTitle("Coda - " + currentFilePath + " [loading]");
+
+    editor->beginLoad();
+    attachHighlighter(currentFilePath);
+
+    loadProgress->setValue(0);
+    loadProgress->show();
+    cancelLoadButton->show();
+    fileLoader->load(fileName);
+}
+
+void MainWindow::attachHighlighter(const QString &fileName) {
+    // Reuse the highlighter, its worker thread and the worker's repository for every file.
+    auto *current = dynamic_cast<KSyntaxHighlightingAdapter *>(editor->getSyntaxHighlighter());
+    if (current) {
+        current->setFilePath(fileName);
+        return;
+    }
+
+    ISyntaxHighlighter *previous = editor->getSyntaxHighlighter();
+    editor->setSyntaxHighlighter(nullptr);
+    delete previous;
+
+    auto *highlighter = new KSyntaxHighlightingAdapter(editor->document());
+    new HighlightScheduler(highlighter, editor);
+    highlighter->setFilePath(fileName);
+    editor->setSyntaxHighlighter(highlighter);
+}
+
+void MainWindow::onLoadStarted(const QString &, int lineCount) {
+    editor->setLineCountHint(lineCount);
+}
+
+void MainWindow::onChunkLoaded(const QString &text) {
+    editor->appendText(text);
+}
+
+void MainWindow::onLoadProgress(qint64 bytesRead, qint64 totalBytes) {
+    loadedFileSize = totalBytes;
+    loadProgress->setValue(totalBytes > 0 ? static_cast<int>(bytesRead * 100 / totalBytes) : 100);
+}
+
+void MainWindow::onLoadFinished(const QString &, const PieceTable &buffer, const TextFormat &format) {
+    editor->endLoad(buffer);
+    editor->setTextFormat(format);
+    hideLoadProgress();
+    setWindowTitle("Coda - " + currentFilePath);
+
+    if (!pendingHit.path.isEmpty() && pendingHit.path == currentFilePath) {
+        selectInEditor(pendingHit.line, pendingHit.column, pendingHit.length);
+    }
+    pendingHit = PendingHit();
+    cleanRevision = editor->textRevision();
+    fileReloader->watch(currentFilePath);
+
+    pluginManager->triggerEvent("onFileOpen", currentFilePath);
+}
+
+void MainWindow::onLoadFailed(const QString &) {
+    discardLoad();
+    QMessageBox::warning(this, "Error", "Failed to open file");
+}
+
+void MainWindow::onLoadCancelled(const QString &) {
+    discardLoad();
+}
+
+void MainWindow::discardLoad() {
+    editor->clear();
+    editor->endLoad();
+    hideLoadProgress();
+    currentFilePath.clear();
+    editor->setCurrentFilePath(currentFilePath);
+    setWindowTitle("Coda");
+}
+
+void MainWindow::hideLoadProgress() {
+    loadProgress->hide();
+    cancelLoadButton->hide();
+}
+
+void MainWindow::showFindBar(bool replace) {
+    // The large file viewer has no search.
+    if (views->currentWidget() == editor) {
+        findBar->open(replace);
+    }
+}
+
+void MainWindow::showWorkspaceSearch() {
+    workspaceSearchDock->show();
+    workspaceSearchDock->raise();
+    workspaceSearch->open(currentFilePath.isEmpty() ? QDir::currentPath() : QFileInfo(currentFilePath).absolutePath());
+}
+
+void MainWindow::setFollowing(bool follow) {
+    if (follow == fileFollower->isFollowing()) {
+        return;
+    }
+    if (!follow) {
+        loadedFileSize = fileFollower->position();
+        fileFollower->stop();
+        editor->setReadOnly(false);
+        editor->document()->setUndoRedoEnabled(true);
+        setWindowTitle("Coda - " + currentFilePath);
+        return;
+    }
+
+    if (views->currentWidget() != editor || currentFilePath.isEmpty() || fileLoader->isLoading()) {
+        QMessageBox::information(this, "Follow", "Only a file fully loaded in the editor can be followed.");
+        QSignalBlocker blocker(followAction);
+        followAction->setChecked(false);
+        return;
+    }
+    // The document mirrors the file while following: no edits and no undo history of the appends.
+    editor->setReadOnly(true);
+    editor->document()->setUndoRedoEnabled(false);
+    editor->setLineCountHint(0);
+    setWindowTitle("Coda - " + currentFilePath + " [following]");
+    fileFollower->follow(currentFilePath, loadedFileSize, editor->textFormat());
+}
+
+void MainWindow::setFollowLineLimit() {
+    bool ok = false;
+    int lines = QInputDialog::getInt(this, "Follow Line Limit", "Most lines kept while following (0 for no limit):",
+                                     followMaxLines, 0, INT_MAX, 1000, &ok);
+    if (ok) {
+        followMaxLines = lines;
+    }
+}
+
+void MainWindow::onFollowAppended(const QString &text) {
+    editor->appendTail(text, followMaxLines);
+}
+
+void MainWindow::onFollowReset() {
+    editor->clear();
+    statusBar()->showMessage(currentFilePath + " was truncated or replaced; following it from the start", 5000);
+}
+
+void MainWindow::loadFileInViewer(const QString &fileName) {
+    // The editor is emptied below, so its unsaved edits would be lost.
+    if (views->currentWidget() == editor && !fileLoader->isLoading() && !fileFollower->isFollowing() &&
+        editor->textRevision() != cleanRevision) {
+        auto answer = QMessageBox::question(this, "Unsaved Changes",
+                                            "The editor has unsaved changes. Discard them and open " + fileName +
+                                                " in the viewer?");
+        if (answer != QMessageBox::Yes) {
+            return;
+        }
+    }
+    followAction->setChecked(false);
+    fileReloader->stop();
+    fileLoader->cancel();
+    if (largeFileView->openFile(fileName)) {
+        findBar->hide();
+        views->setCurrentWidget(largeFileView);
+        currentFilePath = fileName;
+        setWindowTitle("Coda - " + currentFilePath + " [read-only]");
+
+        // Plugins see the editor only: detach it, so they do not act on the previous file while the
+        // viewer shows this one. The viewer does not fire onFileOpen.
+        editor->clear();
+        editor->setCurrentFilePath(QString());
+        cleanRevision = editor->textRevision();
+    } else {
+        QMessageBox::warning(this, "Error", "Failed to open file");
+    }
+}
+
+void MainWindow::onFileChanged(const QString &path) {
+    // Follow mode reads appends itself, and the viewer maps the file as it is.
+    if (path != currentFilePath || views->currentWidget() != editor || fileLoader->isLoading() ||
+        fileFollower->isFollowing() || fileSaver->isSaving()) {
+        return;
+    }
+    fileReloader->diff(editor->snapshot(), editor->textRevision(), editor->textFormat());
+}
+
+void MainWindow::onFileDiffed(const QString &path, quint64 revision, const QVector<LineHunk> &hunks) {
+    if (path != currentFilePath || views->currentWidget() != editor || fileLoader->isLoading() ||
+        fileFollower->isFollowing()) {
+        return;
+    }
+    // Edited while the diff ran: its line numbers no longer apply.
+    if (revision != editor->textRevision()) {
+        onFileChanged(path);
+        return;
+    }
+    if (hunks.isEmpty()) {
+        cleanRevision = revision;
+        return;
+    }
+    if (revision != cleanRevision) {
+        auto answer = QMessageBox::question(this, "File Changed",
+                                            path + " changed on disk and has unsaved changes here.\n"
+                                                   "Reload the changed lines? Undo brings your version back.");
+        if (answer != QMessageBox::Yes) {
+            return;
         }
+        if (revision != editor->textRevision()) {
+            onFileChanged(path);
+            return;
+        }
+    }
+
+    // Bottom up, so the line numbers of the hunks still to apply stay valid.
+    for (int i = hunks.size() - 1; i >= 0; --i) {
+        editor->replaceLines(hunks[i].line, hunks[i].removed, hunks[i].text);
     }
+    cleanRevision = editor->textRevision();
+    statusBar()->showMessage(QString("Reloaded %1: %2 changed regions").arg(path).arg(hunks.size()), 3000);
 }
 
 void MainWindow::saveFile() {
+    if (views->currentWidget() == largeFileView) {
+        QMessageBox::information(this, "Read-only", "Files opened in the viewer cannot be saved.");
+        return;
+    }
+
+    if (fileLoader->isLoading()) {
+        QMessageBox::information(this, "Loading", "Wait for the file to finish loading before saving.");
+        return;
+    }
+
+    if (fileFollower->isFollowing()) {
+        QMessageBox::information(this, "Following", "Stop following the file before saving it.");
+        return;
+    }
+
     if (currentFilePath.isEmpty()) {
         saveFileAs();
         return;
     }
 
-    QFile file(currentFilePath);
-    if (file.open(QIODevice::WriteOnly | QIODevice::Text)) {
-        QTextStream out(&file);
-        out << editor->toPlainText();
-        file.close();
-        setWindowTitle("Coda - " + currentFilePath);
+    statusBar()->showMessage("Saving " + currentFilePath + "...");
+    fileSaver->save(currentFilePath, editor->snapshot(), editor->textFormat(), editor->textRevision());
+}
 
-        scriptingEngine->triggerEvent("onFileSave", currentFilePath.toStdString());
-    } else {
-        QMessageBox::warning(this, "Error", "Failed to save file");
+void MainWindow::onSaveFinished(const QString &path, quint64 revision) {
+    statusBar()->showMessage("Saved " + path, 3000);
+    if (path == currentFilePath) {
+        loadedFileSize = QFileInfo(path).size();
+        // A save queued behind this one may hold a later revision; only this one is on disk yet.
+        cleanRevision = revision;
+        fileReloader->watch(path);
+        setWindowTitle("Coda - " + currentFilePath);
     }
+
+    pluginManager->triggerEvent("onFileSave", path);
+}
+
+void MainWindow::onSaveFailed(const QString &path, const QString &error) {
+    statusBar()->clearMessage();
+    QMessageBox::warning(this, "Error", "Failed to save file " + path + ": " + error);
 }
 
 void MainWindow::saveFileAs() {
+    if (views->currentWidget() == largeFileView) {
+        QMessageBox::information(this, "Read-only", "Files opened in the viewer cannot be saved.");
+        return;
+    }
+
     QString fileName = QFileDialog::getSaveFileName(this, "Save File As");
     if (!fileName.isEmpty()) {
         currentFilePath = fileName;
@@ -100,19 +497,114 @@ void MainWindow::saveFileAs() {
 void MainWindow::setLightTheme() {
     auto *highlighter = dynamic_cast<KSyntaxHighlightingAdapter *>(editor->getSyntaxHighlighter());
     if (highlighter) {
-        KSyntaxHighlighting::Repository repo;
-        highlighter->setTheme(repo.theme("Breeze Light"));
+        highlighter->setTheme(SyntaxRepository::instance().theme("Breeze Light"));
     }
 }
 
 void MainWindow::setDarkTheme() {
     auto *highlighter = dynamic_cast<KSyntaxHighlightingAdapter *>(editor->getSyntaxHighlighter());
     if (highlighter) {
-        KSyntaxHighlighting::Repository repo;
-        highlighter->setTheme(repo.theme("Breeze Dark"));
+        highlighter->setTheme(SyntaxRepository::instance().theme("Breeze Dark"));
     }
 }
 
+void MainWindow::showHighlightingMetrics() {
+    auto *highlighter = dynamic_cast<KSyntaxHighlightingAdapter *>(editor->getSyntaxHighlighter());
+    if (!highlighter || !highlighter->getScheduler()) {
+        QMessageBox::information(this, "Highlighting Metrics", "No syntax highlighting is active.");
+        return;
+    }
+
+    HighlightMetrics metrics = highlighter->getScheduler()->metrics();
+    QMessageBox::information(this, "Highlighting Metrics",
+                             QString("Lines tokenized: %1\n"
+                                     "Blocks highlighted: %2\n"
+                                     "Blocks per second: %3\n"
+                                     "Last frame: %4 ms\n"
+                                     "Longest frame: %5 ms\n"
+                                     "Waiting: %6 of %7 blocks")
+                                 .arg(metrics.linesTokenized)
+                                 .arg(metrics.blocksHighlighted)
+                                 .arg(metrics.blocksPerSecond, 0, 'f', 0)
+                                 .arg(metrics.lastFrameMs, 0, 'f', 2)
+                                 .arg(metrics.maxFrameMs, 0, 'f', 2)
+                                 .arg(metrics.pendingBlocks)
+                                 .arg(metrics.blockCount));
+}
+
+void MainWindow::showPluginProfile() {
+    QDialog dialog(this);
+    dialog.setWindowTitle("Plugin Profile");
+    dialog.resize(800, 400);
+
+    const QStringList headers = {"Plugin", "Event", "Calls", "Total (ms)", "Max (ms)", "Instructions",
+                                 "Allocated (KiB)", "Aborted"};
+    auto *table = new QTableWidget(&dialog);
+    table->setColumnCount(headers.size());
+    table->setHorizontalHeaderLabels(headers);
+    table->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    table->verticalHeader()->hide();
+
+    // Numbers are stored as numbers so that sorting by a column orders them by value.
+    auto number = [](double value) {
+        auto *item = new QTableWidgetItem;
+        item->setData(Qt::DisplayRole, value);
+        return item;
+    };
+
+    const QVector<ScriptStats> stats = scriptingEngine->profile();
+    table->setRowCount(stats.size());
+    for (int row = 0; row < stats.size(); ++row) {
+        const ScriptStats &entry = stats[row];
+        QString plugin = entry.plugin.empty() ? QString("(unknown)") : QString::fromStdString(entry.plugin);
+        table->setItem(row, 0, new QTableWidgetItem(plugin));
+        table->setItem(row, 1, new QTableWidgetItem(QString::fromStdString(entry.event)));
+        table->setItem(row, 2, number(entry.calls));
+        table->setItem(row, 3, number(qRound(entry.totalNs / 1e4) / 100.0));
+        table->setItem(row, 4, number(qRound(entry.maxNs / 1e4) / 100.0));
+        table->setItem(row, 5, number(entry.instructions));
+        table->setItem(row, 6, number(qRound(entry.allocatedBytes / 1024.0)));
+        table->setItem(row, 7, number(entry.aborted));
+    }
+    table->setSortingEnabled(true);
+    table->sortByColumn(3, Qt::DescendingOrder);
+    table->resizeColumnsToContents();
+
+    const QStringList memoryHeaders = {"Plugin", "In use (KiB)", "Peak (KiB)", "Cap (KiB)"};
+    auto *memoryTable = new QTableWidget(&dialog);
+    memoryTable->setColumnCount(memoryHeaders.size());
+    memoryTable->setHorizontalHeaderLabels(memoryHeaders);
+    memoryTable->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    memoryTable->verticalHeader()->hide();
+
+    const QVector<MemoryUsage> memory = scriptingEngine->memory();
+    memoryTable->setRowCount(memory.size());
+    for (int row = 0; row < memory.size(); ++row) {
+        const MemoryUsage &entry = memory[row];
+        QString plugin = entry.plugin.empty() ? QString("(shared)") : QString::fromStdString(entry.plugin);
+        memoryTable->setItem(row, 0, new QTableWidgetItem(plugin));
+        memoryTable->setItem(row, 1, number(qRound(entry.bytes / 1024.0)));
+        memoryTable->setItem(row, 2, number(qRound(entry.peakBytes / 1024.0)));
+        memoryTable->setItem(row, 3, entry.capBytes > 0 ? number(qRound(entry.capBytes / 1024.0))
+                                                        : new QTableWidgetItem("none"));
+    }
+    memoryTable->setSortingEnabled(true);
+    memoryTable->sortByColumn(1, Qt::DescendingOrder);
+    memoryTable->resizeColumnsToContents();
+
+    auto *tabs = new QTabWidget(&dialog);
+    tabs->addTab(table, "Calls");
+    tabs->addTab(memoryTable, "Memory");
+
+    auto *buttons = new QDialogButtonBox(QDialogButtonBox::Close, &dialog);
+    connect(buttons, &QDialogButtonBox::rejected, &dialog, &QDialog::reject);
+
+    auto *layout = new QVBoxLayout(&dialog);
+    layout->addWidget(tabs);
+    layout->addWidget(buttons);
+    dialog.exec();
+}
+
 void MainWindow::runLuaScript() {
     QString scriptPath = QFileDialog::getOpenFileName(this, "Select Lua Script");
     if (!scriptPath.isEmpty()) {
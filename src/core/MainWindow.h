@@ -11,8 +11,22 @@
 #include <QString>
 #include "ScriptingEngine.h"
 #include "PluginManager.h"
+#include "PieceTable.h"
+#include "TextFormat.h"
+#include "FileReloader.h"
 
 class EditorWidget;
+class FileFollower;
+class FileLoader;
+class FindBar;
+class FileSaver;
+class LargeFileView;
+class QAction;
+class QDockWidget;
+class QProgressBar;
+class QPushButton;
+class QStackedWidget;
+class WorkspaceSearchPanel;
 
 /**
  * @class MainWindow
@@ -40,6 +54,56 @@ private slots:
      */
     void openFile();
 
+    /**
+     * @brief Opens a file read-only in the memory-mapped large file viewer.
+     */
+    void openFileInViewer();
+
+    /**
+     * @brief Opens a file found by Find in Files and selects the hit once it is loaded.
+     * @param path Absolute path of the file.
+     * @param line 1-based line of the hit.
+     * @param column 1-based column of the hit.
+     * @param length Length of the hit.
+     */
+    void openHit(const QString &path, int line, int column, int length);
+
+    /**
+     * @brief Starts or stops following the current file as it grows.
+     * @param follow True to follow.
+     */
+    void setFollowing(bool follow);
+
+    /**
+     * @brief Asks for the most lines kept while following.
+     */
+    void setFollowLineLimit();
+
+    /**
+     * @brief Appends text written to the followed file.
+     * @param text The new text.
+     */
+    void onFollowAppended(const QString &text);
+
+    /**
+     * @brief Clears the editor after the followed file was truncated or replaced.
+     */
+    void onFollowReset();
+
+    /**
+     * @brief Diffs the current file against the editor text after it changed on disk.
+     * @param path The file that changed.
+     */
+    void onFileChanged(const QString &path);
+
+    /**
+     * @brief Applies the lines that changed on disk, asking first if the editor has unsaved changes.
+     * @param path The file that was diffed.
+     * @param revision Editor revision the diff was made against.
+     * @param hunks Changed lines in ascending order.
+     */
+    void onFileDiffed(const QString &path, quint64 revision, const QVector<LineHunk> &hunks);
+
     /**
      * @brief Saves the current file.
      */
@@ -65,9 +129,158 @@ private slots:
      */
     void runLuaScript();
 
+    /**
+     * @brief Shows the throughput and frame timing of the syntax highlighting scheduler.
+     */
+    void showHighlightingMetrics();
+
+    /**
+     * @brief Shows the call counts, timings, instructions and allocations of every plugin and event,
+     *        and the memory each plugin holds.
+     */
+    void showPluginProfile();
+
+    /**
+     * @brief Sizes the line number gutter once the loading file has been indexed.
+     * @param path The file being loaded.
+     * @param lineCount Total number of lines in the file.
+     */
+    void onLoadStarted(const QString &path, int lineCount);
+
+    /**
+     * @brief Appends a decoded chunk of the loading file to the editor.
+     * @param text The decoded chunk.
+     */
+    void onChunkLoaded(const QString &text);
+
+    /**
+     * @brief Updates the loading progress indicator.
+     * @param bytesRead Bytes decoded so far.
+     * @param totalBytes Size of the file.
+     */
+    void onLoadProgress(qint64 bytesRead, qint64 totalBytes);
+
+    /**
+     * @brief Makes the editor writable again and fires the onFileOpen event.
+     * @param path The file that was loaded.
+     * @param buffer Piece table over the loaded file.
+     * @param format Detected on-disk format of the file.
+     */
+    void onLoadFinished(const QString &path, const PieceTable &buffer, const TextFormat &format);
+
+    /**
+     * @brief Fires the onFileSave event once the saved data is durable on disk.
+     * @param path The file that was saved.
+     * @param revision Editor revision that was written.
+     */
+    void onSaveFinished(const QString &path, quint64 revision);
+
+    /**
+     * @brief Reports a file that could not be saved.
+     * @param path The file that failed to save.
+     * @param error Description of the error.
+     */
+    void onSaveFailed(const QString &path, const QString &error);
+
+    /**
+     * @brief Reports a file that could not be opened.
+     * @param path The file that failed to load.
+     */
+    void onLoadFailed(const QString &path);
+
+    /**
+     * @brief Discards the partially loaded document after the user cancelled.
+     * @param path The file whose load was cancelled.
+     */
+    void onLoadCancelled(const QString &path);
+
 private:
+    static constexpr qint64 LargeFileThreshold = 64 * 1024 * 1024; ///< Files at least this large open in the viewer.
+    static constexpr int DefaultFollowMaxLines = 100000;            ///< Lines kept while following, by default.
+
+    /**
+     * @brief Opens a file in the editor, or in the viewer if it is too large for the editor.
+     * @param fileName Path of the file to open.
+     */
+    void openPath(const QString &fileName);
+
+    /**
+     * @brief Selects a range of the editor text given by line and column, and scrolls to it.
+     * @param line 1-based line.
+     * @param column 1-based column.
+     * @param length Length of the range.
+     */
+    void selectInEditor(int line, int column, int length);
+
+    /**
+     * @brief Starts loading a file into the editor in the background and applies syntax highlighting.
+     * @param fileName Path of the file to load.
+     */
+    void loadFile(const QString &fileName);
+
+    /**
+     * @brief Replaces the editor's syntax highlighter with one detected from a file name.
+     * @param fileName Path used for language detection.
+     */
+    void attachHighlighter(const QString &fileName);
+
+    /**
+     * @brief Clears the editor and the current file after a load failed or was cancelled.
+     */
+    void discardLoad();
+
+    /**
+     * @brief Hides the loading progress indicator and its cancel button.
+     */
+    void hideLoadProgress();
+
+    /**
+     * @brief Maps a file into the read-only large file viewer. Asks before discarding unsaved edits, then
+     *        empties the editor and detaches it from any file, so plugins no longer see the previous one.
+     * @param fileName Path of the file to display.
+     */
+    void loadFileInViewer(const QString &fileName);
+
+    /**
+     * @brief Opens the find bar on the editor.
+     * @param replace True to show the replacement field too.
+     */
+    void showFindBar(bool replace);
+
+    /**
+     * @brief Shows the Find in Files panel, searching the current file's folder by default.
+     */
+    void showWorkspaceSearch();
+
+    /**
+     * @struct PendingHit
+     * @brief A hit to select once its file has loaded.
+     */
+    struct PendingHit {
+        QString path;   ///< File of the hit; empty if there is none.
+        int line = 0;   ///< 1-based line.
+        int column = 0; ///< 1-based column.
+        int length = 0; ///< Length of the hit.
+    };
+
     EditorWidget *editor;             ///< The text editor widget.
+    LargeFileView *largeFileView;     ///< Read-only viewer for files too large for the editor.
+    QStackedWidget *views;            ///< Switches between the editor and the large file viewer.
+    FindBar *findBar;                 ///< Find and replace bar under the editor.
+    WorkspaceSearchPanel *workspaceSearch; ///< Find in Files panel.
+    QDockWidget *workspaceSearchDock; ///< Dock holding the Find in Files panel.
+    PendingHit pendingHit;            ///< Hit to select when the loading file finishes.
     QString currentFilePath;          ///< The current file's path.
     ScriptingEngine *scriptingEngine; ///< The Lua scripting engine.
     PluginManager *pluginManager;     ///< The plugin manager for loading and executing Lua plugins.
+    FileLoader *fileLoader;           ///< Loads files into the editor on a worker thread.
+    FileSaver *fileSaver;             ///< Saves snapshots of the editor text on a worker thread.
+    FileFollower *fileFollower;       ///< Reads what is appended to the current file in follow mode.
+    FileReloader *fileReloader;       ///< Reloads the lines of the current file that change on disk.
+    quint64 cleanRevision = 0;        ///< Editor revision that matches the file on disk.
+    QAction *followAction;            ///< Checked while the current file is followed.
+    qint64 loadedFileSize = 0;        ///< Size of the current file when it was loaded or saved.
+    int followMaxLines = DefaultFollowMaxLines; ///< Most lines kept while following, 0 for no limit.
+    QProgressBar *loadProgress;       ///< Status bar progress of the file being loaded.
+    QPushButton *cancelLoadButton;    ///< Cancels the file being loaded.
 };
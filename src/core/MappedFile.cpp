@@ -0,0 +1,60 @@
+/**
+ * @file MappedFile.cpp
+ * @brief Implementation of the MappedFile class for Coda. Wraps QFile::map for read-only access to large files.
+ * @author Dario Romandini
+ */
+
+#include "MappedFile.h"
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+bool MappedFile::open(const QString &path) {
+    close();
+
+    file.setFileName(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    length = file.size();
+    if (length == 0) {
+        return true;
+    }
+
+    mapping = file.map(0, length);
+    if (!mapping) {
+        file.close();
+        length = 0;
+        return false;
+    }
+    return true;
+}
+
+void MappedFile::close() {
+    if (mapping) {
+        file.unmap(mapping);
+        mapping = nullptr;
+    }
+    if (file.isOpen()) {
+        file.close();
+    }
+    length = 0;
+}
+
+bool MappedFile::isOpen() const {
+    return file.isOpen();
+}
+
+const char *MappedFile::data() const {
+    return reinterpret_cast<const char *>(mapping);
+}
+
+qint64 MappedFile::size() const {
+    return length;
+}
+
+QString MappedFile::path() const {
+    return file.fileName();
+}
@@ -0,0 +1,70 @@
+/**
+ * @file MappedFile.h
+ * @brief Read-only memory mapping of a file on disk for the Coda text editor.
+ *        Lets large files be accessed by byte offset without reading them into memory.
+ * @author Dario Romandini
+ */
+
+#pragma once
+
+#include <QFile>
+#include <QString>
+
+/**
+ * @class MappedFile
+ * @brief Maps a whole file read-only into the address space.
+ *        Pages are loaded lazily by the operating system, so opening costs the same for any file size.
+ */
+class MappedFile {
+public:
+    MappedFile() = default;
+
+    /**
+     * @brief Destructor. Unmaps the file if it is still open.
+     */
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    /**
+     * @brief Opens and maps a file. Any previously mapped file is closed first.
+     * @param path Path of the file to map.
+     * @return True on success (an empty file is a valid, zero-length mapping).
+     */
+    bool open(const QString &path);
+
+    /**
+     * @brief Unmaps and closes the file.
+     */
+    void close();
+
+    /**
+     * @brief Returns whether a file is currently mapped.
+     * @return True if open() succeeded and close() has not been called.
+     */
+    bool isOpen() const;
+
+    /**
+     * @brief Returns a pointer to the first byte of the mapping.
+     * @return Pointer to the mapped bytes, or nullptr for an empty or closed file.
+     */
+    const char *data() const;
+
+    /**
+     * @brief Returns the size of the mapping in bytes.
+     * @return Mapped size.
+     */
+    qint64 size() const;
+
+    /**
+     * @brief Returns the path of the mapped file.
+     * @return File path as a QString.
+     */
+    QString path() const;
+
+private:
+    QFile file;               ///< The underlying file handle, kept open while mapped.
+    uchar *mapping = nullptr; ///< Start of the mapped region.
+    qint64 length = 0;        ///< Size of the mapped region in bytes.
+};
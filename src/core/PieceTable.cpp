@@ -0,0 +1,460 @@
+/**
+ * @file PieceTable.cpp
+ * @brief Implementation of the PieceTable class for Coda. Every node of the treap carries the byte,
+ *        UTF-16 unit and newline totals of its subtree, so positions, byte offsets and line starts are all
+ *        found in O(log n). Nodes are never modified after creation; edits copy the path they touch.
+ * @author Dario Romandini
+ */
+
+#include "PieceTable.h"
+#include <cstring>
+#include <random>
+#include <utility>
+#include <vector>
+
+namespace PieceTableDetail {
+
+/**
+ * @struct Piece
+ * @brief A run of UTF-8 bytes in the original or append storage, with its UTF-16 length and newlines.
+ */
+struct Piece {
+    const char *data = nullptr;
+    qint64 bytes = 0;
+    qint64 units = 0;
+    qint64 newlines = 0;
+};
+
+/**
+ * @struct Node
+ * @brief Immutable treap node holding one piece and the totals of its subtree.
+ */
+struct Node {
+    Piece piece;
+    std::shared_ptr<const Node> left;
+    std::shared_ptr<const Node> right;
+    quint32 priority = 0;
+    qint64 bytes = 0;
+    qint64 units = 0;
+    qint64 newlines = 0;
+};
+
+/**
+ * @struct Storage
+ * @brief Owns the original text and the append buffer. Append blocks are never moved or freed while
+ *        the storage lives, so pieces can point straight into them.
+ */
+struct Storage {
+    static constexpr qint64 BlockSize = 64 * 1024;
+
+    QByteArray original;                         ///< Original text.
+    std::vector<std::unique_ptr<char[]>> blocks; ///< Append buffer.
+    qint64 used = BlockSize;                     ///< Bytes used in the last block.
+
+    /**
+     * @brief Returns the first free byte of the append buffer.
+     */
+    const char *tail() const {
+        return blocks.empty() ? nullptr : blocks.back().get() + used;
+    }
+
+    /**
+     * @brief Copies UTF-8 text into the append buffer.
+     * @return Pieces covering the copy, split only at character boundaries.
+     */
+    std::vector<Piece> append(const QByteArray &utf8);
+};
+
+} // namespace PieceTableDetail
+
+using PieceTableDetail::Node;
+using PieceTableDetail::Piece;
+using PieceTableDetail::Storage;
+
+namespace {
+
+using NodePtr = std::shared_ptr<const Node>;
+
+constexpr qint64 MaxOriginalPiece = 64 * 1024; ///< Original text is cut into pieces of at most this size.
+
+quint32 nextPriority() {
+    thread_local std::mt19937 generator(std::random_device{}());
+    return generator();
+}
+
+bool isContinuation(char c) {
+    return (static_cast<unsigned char>(c) & 0xC0) == 0x80;
+}
+
+Piece measure(const char *data, qint64 bytes) {
+    Piece piece{data, bytes, 0, 0};
+    for (qint64 i = 0; i < bytes; ++i) {
+        auto c = static_cast<unsigned char>(data[i]);
+        if ((c & 0xC0) != 0x80) {
+            piece.units += c >= 0xF0 ? 2 : 1;
+        }
+        if (c == '\n') {
+            ++piece.newlines;
+        }
+    }
+    return piece;
+}
+
+qint64 bytesOf(const NodePtr &node) {
+    return node ? node->bytes : 0;
+}
+
+qint64 unitsOf(const NodePtr &node) {
+    return node ? node->units : 0;
+}
+
+qint64 newlinesOf(const NodePtr &node) {
+    return node ? node->newlines : 0;
+}
+
+NodePtr makeNode(const Piece &piece, NodePtr left, NodePtr right, quint32 priority) {
+    auto node = std::make_shared<Node>();
+    node->bytes = piece.bytes + bytesOf(left) + bytesOf(right);
+    node->units = piece.units + unitsOf(left) + unitsOf(right);
+    node->newlines = piece.newlines + newlinesOf(left) + newlinesOf(right);
+    node->piece = piece;
+    node->left = std::move(left);
+    node->right = std::move(right);
+    node->priority = priority;
+    return node;
+}
+
+NodePtr merge(const NodePtr &a, const NodePtr &b) {
+    if (!a) {
+        return b;
+    }
+    if (!b) {
+        return a;
+    }
+    if (a->priority > b->priority) {
+        return makeNode(a->piece, a->left, merge(a->right, b), a->priority);
+    }
+    return makeNode(b->piece, merge(a, b->left), b->right, b->priority);
+}
+
+/**
+ * @brief Byte offset inside a piece of the given UTF-16 offset, rounded up to a character boundary.
+ */
+qint64 byteForUnits(const Piece &piece, qint64 units) {
+    qint64 i = 0;
+    qint64 seen = 0;
+    while (i < piece.bytes && seen < units) {
+        seen += static_cast<unsigned char>(piece.data[i]) >= 0xF0 ? 2 : 1;
+        ++i;
+        while (i < piece.bytes && isContinuation(piece.data[i])) {
+            ++i;
+        }
+    }
+    return i;
+}
+
+/**
+ * @brief Splits a tree so that the left part holds the first `units` UTF-16 units.
+ */
+std::pair<NodePtr, NodePtr> split(const NodePtr &node, qint64 units) {
+    if (!node) {
+        return {};
+    }
+    qint64 leftUnits = unitsOf(node->left);
+    if (units <= leftUnits) {
+        auto [left, right] = split(node->left, units);
+        return {left, makeNode(node->piece, right, node->right, node->priority)};
+    }
+    qint64 inPiece = units - leftUnits;
+    if (inPiece >= node->piece.units) {
+        auto [left, right] = split(node->right, inPiece - node->piece.units);
+        return {makeNode(node->piece, node->left, left, node->priority), right};
+    }
+
+    qint64 at = byteForUnits(node->piece, inPiece);
+    Piece head = measure(node->piece.data, at);
+    Piece tail{node->piece.data + at, node->piece.bytes - at, node->piece.units - head.units,
+               node->piece.newlines - head.newlines};
+    NodePtr left = head.bytes ? makeNode(head, node->left, nullptr, node->priority) : node->left;
+    NodePtr right = tail.bytes ? makeNode(tail, nullptr, node->right, node->priority) : node->right;
+    return {left, right};
+}
+
+/**
+ * @brief Returns the rightmost piece of a non-empty tree.
+ */
+const Piece &lastPiece(const NodePtr &node) {
+    const Node *n = node.get();
+    while (n->right) {
+        n = n->right.get();
+    }
+    return n->piece;
+}
+
+/**
+ * @brief Copies the right spine of a tree, growing its last piece by a directly following run of bytes.
+ */
+NodePtr extendLast(const NodePtr &node, const Piece &extra) {
+    if (node->right) {
+        return makeNode(node->piece, node->left, extendLast(node->right, extra), node->priority);
+    }
+    Piece grown{node->piece.data, node->piece.bytes + extra.bytes, node->piece.units + extra.units,
+                node->piece.newlines + extra.newlines};
+    return makeNode(grown, node->left, nullptr, node->priority);
+}
+
+/**
+ * @brief Builds a treap over pieces in order, with random priorities, in linear time.
+ */
+NodePtr build(const std::vector<Piece> &pieces) {
+    struct Draft {
+        quint32 priority;
+        int left = -1;
+        int right = -1;
+    };
+    std::vector<Draft> drafts;
+    std::vector<int> spine;
+    drafts.reserve(pieces.size());
+    for (int i = 0; i < static_cast<int>(pieces.size()); ++i) {
+        drafts.push_back({nextPriority()});
+        int last = -1;
+        while (!spine.empty() && drafts[spine.back()].priority < drafts[i].priority) {
+            last = spine.back();
+            spine.pop_back();
+        }
+        drafts[i].left = last;
+        if (!spine.empty()) {
+            drafts[spine.back()].right = i;
+        }
+        spine.push_back(i);
+    }
+
+    std::function<NodePtr(int)> finish = [&](int i) -> NodePtr {
+        if (i < 0) {
+            return nullptr;
+        }
+        return makeNode(pieces[i], finish(drafts[i].left), finish(drafts[i].right), drafts[i].priority);
+    };
+    return spine.empty() ? nullptr : finish(spine.front());
+}
+
+/**
+ * @brief Cuts original text into pieces of bounded size at character boundaries.
+ */
+std::vector<Piece> cutOriginal(const char *data, qint64 size) {
+    std::vector<Piece> pieces;
+    qint64 offset = 0;
+    while (offset < size) {
+        qint64 length = qMin(MaxOriginalPiece, size - offset);
+        while (offset + length < size && length > 1 && isContinuation(data[offset + length])) {
+            --length;
+        }
+        pieces.push_back(measure(data + offset, length));
+        offset += length;
+    }
+    return pieces;
+}
+
+/**
+ * @brief In-order walk over the bytes in [offset, offset + count); returns false once the sink stops.
+ */
+bool visit(const NodePtr &node, qint64 offset, qint64 count,
+           const std::function<bool(const char *, qint64)> &sink) {
+    if (!node || count <= 0 || offset >= node->bytes) {
+        return true;
+    }
+    qint64 leftBytes = bytesOf(node->left);
+    if (offset < leftBytes && !visit(node->left, offset, count, sink)) {
+        return false;
+    }
+
+    qint64 begin = qMax<qint64>(offset, leftBytes);
+    qint64 end = qMin(offset + count, leftBytes + node->piece.bytes);
+    if (begin < end && !sink(node->piece.data + (begin - leftBytes), end - begin)) {
+        return false;
+    }
+
+    qint64 rightStart = leftBytes + node->piece.bytes;
+    if (offset + count > rightStart) {
+        qint64 from = qMax<qint64>(offset, rightStart);
+        return visit(node->right, from - rightStart, offset + count - from, sink);
+    }
+    return true;
+}
+
+} // namespace
+
+std::vector<Piece> Storage::append(const QByteArray &utf8) {
+    std::vector<Piece> pieces;
+    const char *src = utf8.constData();
+    qint64 remaining = utf8.size();
+    while (remaining > 0) {
+        if (used == BlockSize) {
+            blocks.push_back(std::make_unique<char[]>(BlockSize));
+            used = 0;
+        }
+        qint64 length = qMin(remaining, BlockSize - used);
+        while (length < remaining && length > 0 && isContinuation(src[length])) {
+            --length;
+        }
+        if (length == 0) {
+            used = BlockSize;
+            continue;
+        }
+        char *dst = blocks.back().get() + used;
+        std::memcpy(dst, src, static_cast<size_t>(length));
+        used += length;
+        pieces.push_back(measure(dst, length));
+        src += length;
+        remaining -= length;
+    }
+    return pieces;
+}
+
+PieceTable::PieceTable() : storage(std::make_shared<Storage>()) {}
+
+PieceTable::PieceTable(std::shared_ptr<Storage> storage, const char *data, qint64 size)
+    : root(build(cutOriginal(data, size))), storage(std::move(storage)) {}
+
+PieceTable PieceTable::fromUtf8(const QByteArray &bytes, qint64 offset) {
+    auto storage = std::make_shared<Storage>();
+    storage->original = bytes;
+    const char *data = storage->original.constData() + offset;
+    return PieceTable(std::move(storage), data, bytes.size() - offset);
+}
+
+void PieceTable::insert(qint64 position, const QString &text) {
+    if (text.isEmpty()) {
+        return;
+    }
+    auto [left, right] = split(root, position);
+
+    const char *tail = storage->tail();
+    std::vector<Piece> pieces = storage->append(text.toUtf8());
+
+    // Typing appends right after the previous insertion; grow that piece instead of adding one per key.
+    size_t first = 0;
+    if (left && tail && pieces.front().data == tail) {
+        const Piece &last = lastPiece(left);
+        if (last.data + last.bytes == tail) {
+            left = extendLast(left, pieces.front());
+            first = 1;
+        }
+    }
+
+    NodePtr middle;
+    for (size_t i = first; i < pieces.size(); ++i) {
+        middle = merge(middle, makeNode(pieces[i], nullptr, nullptr, nextPriority()));
+    }
+    root = merge(merge(left, middle), right);
+}
+
+void PieceTable::remove(qint64 position, qint64 count) {
+    if (count <= 0) {
+        return;
+    }
+    auto [left, rest] = split(root, position);
+    auto [removed, right] = split(rest, count);
+    root = merge(left, right);
+}
+
+qint64 PieceTable::length() const {
+    return unitsOf(root);
+}
+
+qint64 PieceTable::byteSize() const {
+    return bytesOf(root);
+}
+
+qint64 PieceTable::lineCount() const {
+    return newlinesOf(root) + 1;
+}
+
+QString PieceTable::text() const {
+    return QString::fromUtf8(bytes(0, byteSize()));
+}
+
+QString PieceTable::text(qint64 position, qint64 count) const {
+    qint64 begin = byteOffset(position);
+    qint64 end = byteOffset(position + count);
+    return QString::fromUtf8(bytes(begin, end - begin));
+}
+
+std::string PieceTable::toStdString() const {
+    std::string result;
+    result.reserve(static_cast<size_t>(byteSize()));
+    readBytes(0, byteSize(), [&result](const char *data, qint64 size) {
+        result.append(data, static_cast<size_t>(size));
+        return true;
+    });
+    return result;
+}
+
+qint64 PieceTable::byteOffset(qint64 position) const {
+    qint64 base = 0;
+    const Node *node = root.get();
+    while (node) {
+        qint64 leftUnits = unitsOf(node->left);
+        if (position <= leftUnits) {
+            if (position == leftUnits) {
+                return base + bytesOf(node->left);
+            }
+            node = node->left.get();
+            continue;
+        }
+        position -= leftUnits;
+        base += bytesOf(node->left);
+        if (position <= node->piece.units) {
+            return base + byteForUnits(node->piece, position);
+        }
+        position -= node->piece.units;
+        base += node->piece.bytes;
+        node = node->right.get();
+    }
+    return base;
+}
+
+qint64 PieceTable::lineStartByte(qint64 line) const {
+    if (line <= 0) {
+        return 0;
+    }
+    qint64 base = 0;
+    const Node *node = root.get();
+    while (node) {
+        qint64 leftNewlines = newlinesOf(node->left);
+        if (line <= leftNewlines) {
+            node = node->left.get();
+            continue;
+        }
+        line -= leftNewlines;
+        base += bytesOf(node->left);
+        if (line <= node->piece.newlines) {
+            const char *p = node->piece.data;
+            const char *end = p + node->piece.bytes;
+            for (;;) {
+                p = static_cast<const char *>(std::memchr(p, '\n', static_cast<size_t>(end - p))) + 1;
+                if (--line == 0) {
+                    return base + (p - node->piece.data);
+                }
+            }
+        }
+        line -= node->piece.newlines;
+        base += node->piece.bytes;
+        node = node->right.get();
+    }
+    return byteSize();
+}
+
+QByteArray PieceTable::bytes(qint64 offset, qint64 count) const {
+    QByteArray result;
+    result.reserve(static_cast<int>(qMax<qint64>(0, qMin(count, byteSize() - offset))));
+    readBytes(offset, count, [&result](const char *data, qint64 size) {
+        result.append(data, static_cast<int>(size));
+        return true;
+    });
+    return result;
+}
+
+void PieceTable::readBytes(qint64 offset, qint64 count, const std::function<bool(const char *, qint64)> &sink) const {
+    visit(root, qMax<qint64>(0, offset), count, sink);
+}
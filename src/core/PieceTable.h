@@ -0,0 +1,140 @@
+/**
+ * @file PieceTable.h
+ * @brief Piece-table text buffer for the Coda text editor.
+ *        Keeps the original file bytes untouched and stores edits in an append-only buffer. Pieces
+ *        live in a persistent treap, so edits are O(log n) and copies are O(1) snapshots that can be
+ *        read from other threads.
+ * @author Dario Romandini
+ */
+
+#pragma once
+
+#include <QByteArray>
+#include <QString>
+#include <functional>
+#include <memory>
+#include <string>
+
+namespace PieceTableDetail {
+struct Node;
+struct Storage;
+} // namespace PieceTableDetail
+
+/**
+ * @class PieceTable
+ * @brief UTF-8 text buffer addressed by UTF-16 positions, matching QTextDocument positions.
+ *        Line breaks are stored as a single '\n'. Copies share the append storage: any copy may be read
+ *        on any thread, but only one copy, on one thread, may be edited.
+ */
+class PieceTable {
+public:
+    /**
+     * @brief Constructs an empty buffer.
+     */
+    PieceTable();
+
+    /**
+     * @brief Creates a buffer whose original text is the given UTF-8 bytes. The bytes are shared, not
+     *        copied.
+     * @param bytes UTF-8 text with '\n' line breaks.
+     * @param offset Number of leading bytes to skip (e.g. a byte order mark).
+     * @return The new buffer.
+     */
+    static PieceTable fromUtf8(const QByteArray &bytes, qint64 offset = 0);
+
+    /**
+     * @brief Inserts text.
+     * @param position UTF-16 position to insert at.
+     * @param text The text to insert.
+     */
+    void insert(qint64 position, const QString &text);
+
+    /**
+     * @brief Removes text.
+     * @param position UTF-16 position of the first removed character.
+     * @param count Number of UTF-16 units to remove.
+     */
+    void remove(qint64 position, qint64 count);
+
+    /**
+     * @brief Returns the length of the text in UTF-16 units.
+     * @return Length as QTextDocument counts it, without the final paragraph separator.
+     */
+    qint64 length() const;
+
+    /**
+     * @brief Returns the size of the text in UTF-8 bytes.
+     * @return Byte size.
+     */
+    qint64 byteSize() const;
+
+    /**
+     * @brief Returns the number of lines (the number of '\n' plus one).
+     * @return Line count.
+     */
+    qint64 lineCount() const;
+
+    /**
+     * @brief Returns the whole text.
+     * @return The text as a QString.
+     */
+    QString text() const;
+
+    /**
+     * @brief Returns part of the text.
+     * @param position UTF-16 position of the first character.
+     * @param count Number of UTF-16 units.
+     * @return The text as a QString.
+     */
+    QString text(qint64 position, qint64 count) const;
+
+    /**
+     * @brief Returns the whole text as UTF-8 without any UTF-16 conversion.
+     * @return The text as a std::string.
+     */
+    std::string toStdString() const;
+
+    /**
+     * @brief Converts a UTF-16 position to a UTF-8 byte offset.
+     * @param position UTF-16 position.
+     * @return Byte offset of the same character.
+     */
+    qint64 byteOffset(qint64 position) const;
+
+    /**
+     * @brief Returns the byte offset at which a line starts.
+     * @param line Zero-based line number.
+     * @return Byte offset, or byteSize() if the line does not exist.
+     */
+    qint64 lineStartByte(qint64 line) const;
+
+    /**
+     * @brief Copies a byte range.
+     * @param offset Byte offset of the first byte.
+     * @param count Number of bytes.
+     * @return The bytes, clipped to the buffer.
+     */
+    QByteArray bytes(qint64 offset, qint64 count) const;
+
+    /**
+     * @brief Visits a byte range piece by piece without copying.
+     * @param offset Byte offset of the first byte.
+     * @param count Number of bytes.
+     * @param sink Called with each contiguous run of bytes in order; returning false stops the walk.
+     */
+    void readBytes(qint64 offset, qint64 count, const std::function<bool(const char *, qint64)> &sink) const;
+
+private:
+    using NodePtr = std::shared_ptr<const PieceTableDetail::Node>;
+
+    /**
+     * @brief Creates a buffer over original bytes held by the given storage.
+     * @param storage Storage owning the original bytes.
+     * @param data First byte of the original text.
+     * @param size Size of the original text.
+     */
+    PieceTable(std::shared_ptr<PieceTableDetail::Storage> storage, const char *data, qint64 size);
+
+    NodePtr root;                                        ///< Root of the piece treap.
+    std::shared_ptr<PieceTableDetail::Storage> storage;  ///< Original bytes and append buffer.
+};
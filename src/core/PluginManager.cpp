@@ -6,10 +6,22 @@
 
 #include "PluginManager.h"
 #include <QFile>
+#include <QFileInfo>
 #include <QDebug>
+#include <QRegularExpression>
+#include <algorithm>
 
 PluginManager::PluginManager(ScriptingEngine *engine)
-    : scriptingEngine(engine) {}
+    : scriptingEngine(engine) {
+    // The debounced editor events are dispatched by the engine itself, so it asks for activation first.
+    scriptingEngine->setActivationHook([this](const std::string &eventName, const std::string &filePath) {
+        activatePending(QString::fromStdString(eventName), QString::fromStdString(filePath));
+    });
+}
+
+PluginManager::~PluginManager() {
+    scriptingEngine->setActivationHook(nullptr);
+}
 
 void PluginManager::loadPlugins(const QString &jsonPath) {
     QFile file(jsonPath);
@@ -37,10 +49,74 @@ void PluginManager::loadPlugins(const QString &jsonPath) {
         QJsonObject pluginObj = pluginVal.toObject();
         QString file = pluginObj.value("file").toString();
         bool enabled = pluginObj.value("enabled").toBool();
+        QString mode = pluginObj.value("mode").toString("sync");
+        if (mode != "sync" && mode != "async") {
+            qWarning() << "Unknown mode" << mode << "for plugin" << file << "- running it synchronously";
+            mode = "sync";
+        }
+
+        QStringList activationEvents;
+        for (const QJsonValue &event : pluginObj.value("activationEvents").toArray()) {
+            activationEvents.append(event.toString());
+        }
+
+        if (enabled && (pluginObj.contains("timeBudgetMs") || pluginObj.contains("instructionBudget") ||
+                        pluginObj.contains("memoryCapKB"))) {
+            ScriptBudget budget;
+            budget.timeMs = pluginObj.value("timeBudgetMs").toInt(budget.timeMs);
+            budget.instructions = static_cast<quint64>(pluginObj.value("instructionBudget").toDouble(0));
+            budget.memoryBytes = static_cast<quint64>(pluginObj.value("memoryCapKB").toDouble(0)) * 1024;
+            scriptingEngine->setBudget(file.toStdString(), budget);
+        }
+
+        if (!enabled) {
+            qInfo() << "Skipping disabled plugin:" << file;
+        } else if (activationEvents.isEmpty() || activationEvents.contains("*")) {
+            qInfo() << "Loading plugin:" << file << "Mode:" << mode;
+            activate(file, mode == "async");
+        } else {
+            pending.append(PendingPlugin{file, mode == "async", activationEvents});
+        }
+    }
+}
+
+void PluginManager::triggerEvent(const QString &eventName, const QString &filePath) {
+    activatePending(eventName, filePath);
+    scriptingEngine->triggerEvent(eventName.toStdString(), filePath.toStdString());
+}
 
-        qInfo() << "Loading plugin:" << file << "Enabled:" << enabled;
-        if (enabled) {
-            scriptingEngine->runScript(file.toStdString());
+void PluginManager::activatePending(const QString &eventName, const QString &filePath) {
+    for (int i = 0; i < pending.size();) {
+        const PendingPlugin &plugin = pending[i];
+        bool activated = std::any_of(plugin.activationEvents.begin(), plugin.activationEvents.end(),
+                                     [&](const QString &event) { return matches(event, eventName, filePath); });
+        if (activated) {
+            qInfo() << "Activating plugin:" << plugin.file << "on" << eventName;
+            PendingPlugin ready = pending.takeAt(i);
+            activate(ready.file, ready.async);
+        } else {
+            ++i;
         }
     }
 }
+
+void PluginManager::activate(const QString &file, bool async) {
+    if (async) {
+        scriptingEngine->loadAsyncScript(file.toStdString());
+    } else {
+        scriptingEngine->runScript(file.toStdString());
+    }
+}
+
+bool PluginManager::matches(const QString &activationEvent, const QString &eventName, const QString &filePath) {
+    int separator = activationEvent.indexOf(':');
+    if (separator < 0) {
+        return activationEvent == eventName;
+    }
+    if (activationEvent.left(separator) != eventName) {
+        return false;
+    }
+
+    QString pattern = QRegularExpression::wildcardToRegularExpression(activationEvent.mid(separator + 1));
+    return QRegularExpression(pattern).match(QFileInfo(filePath).fileName()).hasMatch();
+}
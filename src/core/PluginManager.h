@@ -7,15 +7,18 @@
 #pragma once
 
 #include <QString>
+#include <QStringList>
 #include <QJsonDocument>
 #include <QJsonArray>
 #include <QJsonObject>
+#include <QVector>
 
 #include "ScriptingEngine.h"
 
 /**
  * @class PluginManager
  * @brief Loads Lua plugin definitions from a JSON config and executes enabled plugins.
+ *        Plugins that declare activationEvents are loaded only when one of those events first fires.
  */
 class PluginManager {
 public:
@@ -25,12 +28,58 @@ public:
      */
     explicit PluginManager(ScriptingEngine *engine);
 
+    /**
+     * @brief Destructor. Detaches from the scripting engine's debounced editor events.
+     */
+    ~PluginManager();
+
     /**
      * @brief Loads plugins from a JSON configuration file.
      * @param jsonPath Path to the JSON config file.
      */
     void loadPlugins(const QString &jsonPath);
 
+    /**
+     * @brief Loads the plugins activated by an event, then triggers the event in the scripting engine.
+     * @param eventName The name of the event (e.g., "onFileOpen").
+     * @param filePath The file path passed to the handlers.
+     */
+    void triggerEvent(const QString &eventName, const QString &filePath = QString());
+
 private:
+    /**
+     * @struct PendingPlugin
+     * @brief An enabled plugin waiting for one of its activation events.
+     */
+    struct PendingPlugin {
+        QString file;                ///< Path of the Lua script.
+        bool async;                  ///< True to run the plugin on a worker thread.
+        QStringList activationEvents; ///< Events that load the plugin, as "event" or "event:pattern".
+    };
+
+    /**
+     * @brief Loads the pending plugins that an event activates.
+     * @param eventName The name of the event.
+     * @param filePath The file path of the event.
+     */
+    void activatePending(const QString &eventName, const QString &filePath);
+
+    /**
+     * @brief Runs a plugin script in the scripting engine.
+     * @param file Path of the Lua script.
+     * @param async True to run the plugin on a worker thread.
+     */
+    void activate(const QString &file, bool async);
+
+    /**
+     * @brief Checks whether an event matches an activation event.
+     * @param activationEvent "event", or "event:pattern" with a wildcard pattern for the file name.
+     * @param eventName The name of the event that fired.
+     * @param filePath The file path of the event.
+     * @return True if the event activates the plugin.
+     */
+    static bool matches(const QString &activationEvent, const QString &eventName, const QString &filePath);
+
     ScriptingEngine *scriptingEngine; ///< The Lua scripting engine used for running plugins.
+    QVector<PendingPlugin> pending;   ///< Plugins not loaded yet.
 };
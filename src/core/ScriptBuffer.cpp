@@ -0,0 +1,101 @@
+/**
+ * @file ScriptBuffer.cpp
+ * @brief Implementation of the ScriptBuffer class for Coda.
+ * @author Dario Romandini
+ */
+
+#include "ScriptBuffer.h"
+#include "LineIndex.h"
+#include <QString>
+
+ScriptBuffer::ScriptBuffer(const PieceTable &text) : text(text) {}
+
+qint64 ScriptBuffer::lineCount() const {
+    return text.lineCount();
+}
+
+qint64 ScriptBuffer::byteSize() const {
+    return text.byteSize();
+}
+
+std::optional<std::string> ScriptBuffer::line(qint64 line) const {
+    if (line < 1 || line > text.lineCount()) {
+        return std::nullopt;
+    }
+    std::string result;
+    readLine(text.lineStartByte(line - 1), result);
+    return result;
+}
+
+std::string ScriptBuffer::range(qint64 firstLine, qint64 firstColumn, qint64 lastLine, qint64 lastColumn) const {
+    qint64 begin = positionToByte(firstLine, firstColumn);
+    qint64 end = positionToByte(lastLine, lastColumn);
+    std::string result;
+    if (end > begin) {
+        text.readBytes(begin, end - begin, [&result](const char *data, qint64 size) {
+            result.append(data, static_cast<size_t>(size));
+            return true;
+        });
+    }
+    return result;
+}
+
+std::optional<qint64> ScriptBuffer::lineOffset(qint64 line) const {
+    if (line < 1 || line > text.lineCount()) {
+        return std::nullopt;
+    }
+    return text.lineStartByte(line - 1) + 1;
+}
+
+std::string ScriptBuffer::sub(qint64 first, qint64 last) const {
+    qint64 size = text.byteSize();
+    if (first < 0) {
+        first = qMax<qint64>(size + first + 1, 1);
+    } else if (first == 0) {
+        first = 1;
+    }
+    if (last < 0) {
+        last = size + last + 1;
+    } else if (last > size) {
+        last = size;
+    }
+
+    std::string result;
+    if (first <= last) {
+        text.readBytes(first - 1, last - first + 1, [&result](const char *data, qint64 count) {
+            result.append(data, static_cast<size_t>(count));
+            return true;
+        });
+    }
+    return result;
+}
+
+qint64 ScriptBuffer::readLine(qint64 offset, std::string &line) const {
+    line.clear();
+    qint64 next = text.byteSize();
+    text.readBytes(offset, text.byteSize() - offset, [&](const char *data, qint64 size) {
+        const char *newline = LineIndex::findNewline(data, data + size);
+        line.append(data, static_cast<size_t>(newline - data));
+        if (newline == data + size) {
+            offset += size;
+            return true;
+        }
+        next = offset + (newline - data) + 1;
+        return false;
+    });
+    return next;
+}
+
+qint64 ScriptBuffer::positionToByte(qint64 line, qint64 column) const {
+    line = qBound<qint64>(1, line, text.lineCount());
+    qint64 start = text.lineStartByte(line - 1);
+    if (column <= 1) {
+        return start;
+    }
+
+    // Columns count UTF-16 units: decode the line to find the column's byte offset.
+    std::string lineText;
+    readLine(start, lineText);
+    QString decoded = QString::fromUtf8(lineText.data(), static_cast<int>(lineText.size()));
+    return start + decoded.left(static_cast<int>(column - 1)).toUtf8().size();
+}
@@ -0,0 +1,92 @@
+/**
+ * @file ScriptBuffer.h
+ * @brief Read-only view of the editor text for Lua plugins in Coda.
+ *        Wraps an O(1) PieceTable snapshot and copies out only the lines, ranges or bytes a plugin asks for,
+ *        so plugins never pay for converting the whole document.
+ * @author Dario Romandini
+ */
+
+#pragma once
+
+#include <optional>
+#include <string>
+
+#include "PieceTable.h"
+
+/**
+ * @class ScriptBuffer
+ * @brief Snapshot of the text exposed to Lua as a userdata.
+ *        Follows Lua conventions: lines, columns and byte positions are 1-based; columns count UTF-16
+ *        units like editor.getCursorPosition(); strings are UTF-8 without line breaks.
+ */
+class ScriptBuffer {
+public:
+    /**
+     * @brief Constructor.
+     * @param text Snapshot of the text. Later edits do not affect the buffer.
+     */
+    explicit ScriptBuffer(const PieceTable &text);
+
+    /**
+     * @brief Returns the number of lines.
+     * @return Line count, at least 1.
+     */
+    qint64 lineCount() const;
+
+    /**
+     * @brief Returns the size of the text in UTF-8 bytes.
+     * @return Byte count.
+     */
+    qint64 byteSize() const;
+
+    /**
+     * @brief Returns one line.
+     * @param line 1-based line number.
+     * @return The line without its line break, or nothing if the line does not exist.
+     */
+    std::optional<std::string> line(qint64 line) const;
+
+    /**
+     * @brief Returns the text between two positions; columns past the end of a line are clamped.
+     * @param firstLine 1-based line of the first character.
+     * @param firstColumn 1-based column of the first character.
+     * @param lastLine 1-based line of the end position.
+     * @param lastColumn 1-based column of the end position, which is not included.
+     * @return The text, with '\n' between lines.
+     */
+    std::string range(qint64 firstLine, qint64 firstColumn, qint64 lastLine, qint64 lastColumn) const;
+
+    /**
+     * @brief Returns the byte position at which a line starts.
+     * @param line 1-based line number.
+     * @return 1-based byte position, or nothing if the line does not exist.
+     */
+    std::optional<qint64> lineOffset(qint64 line) const;
+
+    /**
+     * @brief Returns bytes i to j, inclusive, with the index rules of Lua's string.sub.
+     * @param first 1-based position of the first byte; negative values count from the end.
+     * @param last 1-based position of the last byte; negative values count from the end.
+     * @return The bytes.
+     */
+    std::string sub(qint64 first, qint64 last) const;
+
+    /**
+     * @brief Reads the line starting at a byte offset.
+     * @param offset 0-based byte offset of the start of a line.
+     * @param line Receives the line without its line break.
+     * @return 0-based byte offset of the next line.
+     */
+    qint64 readLine(qint64 offset, std::string &line) const;
+
+private:
+    /**
+     * @brief Converts a position to a byte offset.
+     * @param line 1-based line number, clamped to the text.
+     * @param column 1-based column, clamped to the line.
+     * @return 0-based byte offset.
+     */
+    qint64 positionToByte(qint64 line, qint64 column) const;
+
+    PieceTable text; ///< The snapshot.
+};
@@ -0,0 +1,75 @@
+/**
+ * @file ScriptCache.cpp
+ * @brief Implementation of the ScriptCache class for Coda.
+ * @author Dario Romandini
+ */
+
+#include "ScriptCache.h"
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+namespace {
+
+constexpr quint32 CacheMagic = 0x434c5543; ///< "CLUC", start of every cache file.
+
+} // namespace
+
+sol::protected_function ScriptCache::load(sol::state &lua, const std::string &path) {
+    QFileInfo info(QString::fromStdString(path));
+    QString cachePath = cacheFile(info.absoluteFilePath());
+    qint64 modified = info.lastModified().toMSecsSinceEpoch();
+    std::string chunkName = "@" + path;
+
+    QFile cached(cachePath);
+    if (cached.open(QIODevice::ReadOnly)) {
+        QDataStream header(&cached);
+        quint32 magic = 0;
+        qint32 version = 0;
+        qint64 cachedModified = 0;
+        qint64 cachedSize = -1;
+        header >> magic >> version >> cachedModified >> cachedSize;
+        if (header.status() == QDataStream::Ok && magic == CacheMagic && version == LUA_VERSION_NUM &&
+            cachedModified == modified && cachedSize == info.size()) {
+            QByteArray bytecode = cached.readAll();
+            sol::load_result chunk = lua.load(std::string_view(bytecode.constData(), bytecode.size()), chunkName,
+                                              sol::load_mode::binary);
+            if (chunk.valid()) {
+                return chunk;
+            }
+        }
+        cached.close();
+    }
+
+    sol::load_result chunk = lua.load_file(path, sol::load_mode::text);
+    if (!chunk.valid()) {
+        sol::error error = chunk;
+        throw error;
+    }
+    sol::protected_function script = chunk;
+
+    // Debug information is kept so that errors still report lines.
+    sol::bytecode bytecode = script.dump();
+    QDir().mkpath(QFileInfo(cachePath).absolutePath());
+    QSaveFile out(cachePath);
+    if (out.open(QIODevice::WriteOnly)) {
+        QDataStream header(&out);
+        header << CacheMagic << qint32(LUA_VERSION_NUM) << modified << info.size();
+        out.write(reinterpret_cast<const char *>(bytecode.data()), static_cast<qint64>(bytecode.size()));
+        if (!out.commit()) {
+            qWarning() << "Could not write script cache:" << cachePath;
+        }
+    }
+    return script;
+}
+
+QString ScriptCache::cacheFile(const QString &path) {
+    QByteArray key = QCryptographicHash::hash(path.toUtf8(), QCryptographicHash::Sha1).toHex();
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/lua/" + QString::fromLatin1(key) +
+           ".luac";
+}
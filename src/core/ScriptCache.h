@@ -0,0 +1,38 @@
+/**
+ * @file ScriptCache.h
+ * @brief On-disk cache of compiled Lua plugins for Coda.
+ *        Scripts are compiled once and their bytecode is stored under the cache location, keyed by the
+ *        script path and checked against its modification time and size, so later startups skip parsing.
+ * @author Dario Romandini
+ */
+
+#pragma once
+
+#include <QString>
+#include <sol/sol.hpp>
+#include <string>
+
+/**
+ * @class ScriptCache
+ * @brief Loads Lua scripts from cached bytecode, compiling and caching them when needed.
+ *        Safe to use from several threads, each with its own Lua state.
+ */
+class ScriptCache {
+public:
+    /**
+     * @brief Loads a script without running it.
+     * @param lua Lua state to load the script into.
+     * @param path Path of the Lua script.
+     * @return The script's main chunk.
+     * @throws sol::error If the script cannot be read or does not compile.
+     */
+    static sol::protected_function load(sol::state &lua, const std::string &path);
+
+private:
+    /**
+     * @brief Returns the cache file for a script.
+     * @param path Absolute path of the script.
+     * @return Path of the bytecode file.
+     */
+    static QString cacheFile(const QString &path);
+};
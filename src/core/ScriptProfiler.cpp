@@ -0,0 +1,133 @@
+/**
+ * @file ScriptProfiler.cpp
+ * @brief Implementation of the ScriptProfiler class for Coda.
+ * @author Dario Romandini
+ */
+
+#include "ScriptProfiler.h"
+
+namespace {
+
+constexpr const char *RegistryKey = "coda.profiler"; ///< Registry field holding the profiler.
+
+} // namespace
+
+LuaAllocator &ScriptProfiler::allocator() {
+    return luaAllocator;
+}
+
+void ScriptProfiler::attach(lua_State *state, const std::atomic_bool *stop) {
+    stopFlag = stop;
+    lua_pushlightuserdata(state, this);
+    lua_setfield(state, LUA_REGISTRYINDEX, RegistryKey);
+    lua_sethook(state, &ScriptProfiler::hook, LUA_MASKCOUNT, HookInterval);
+}
+
+void ScriptProfiler::setBudget(const std::string &plugin, const ScriptBudget &budget) {
+    budgets[plugin] = budget;
+    luaAllocator.setCap(luaAllocator.owner(plugin), budget.memoryBytes);
+}
+
+void ScriptProfiler::setDefaultTimeMs(int timeMs) {
+    defaultTimeMs = timeMs;
+}
+
+ScriptBudget ScriptProfiler::budget(const std::string &plugin) const {
+    auto found = budgets.find(plugin);
+    return found != budgets.end() ? found->second : ScriptBudget();
+}
+
+void ScriptProfiler::begin(const std::string &plugin, const std::string &event) {
+    if (depth++ > 0) {
+        return;
+    }
+    call = ScriptStats();
+    call.plugin = plugin;
+    call.event = event;
+    call.allocatedBytes = luaAllocator.totalAllocated();
+    callBudget = budget(plugin);
+    if (callBudget.timeMs < 0) {
+        callBudget.timeMs = event == "load" ? 0 : defaultTimeMs;
+    }
+    callAborted = false;
+    callerOwner = luaAllocator.currentOwner();
+    luaAllocator.setOwner(luaAllocator.owner(plugin));
+    luaAllocator.clearRefused();
+    callTimer.start();
+}
+
+void ScriptProfiler::end() {
+    if (depth == 0 || --depth > 0) {
+        return;
+    }
+    qint64 elapsed = callTimer.nsecsElapsed();
+    luaAllocator.setOwner(callerOwner);
+
+    QMutexLocker locker(&mutex);
+    ScriptStats &total = counters[{call.plugin, call.event}];
+    total.plugin = call.plugin;
+    total.event = call.event;
+    ++total.calls;
+    total.totalNs += elapsed;
+    total.maxNs = qMax(total.maxNs, elapsed);
+    total.instructions += call.instructions;
+    total.allocatedBytes += luaAllocator.totalAllocated() - call.allocatedBytes;
+    total.aborted += callAborted ? 1 : 0;
+}
+
+QVector<ScriptStats> ScriptProfiler::stats() const {
+    QMutexLocker locker(&mutex);
+    QVector<ScriptStats> result;
+    result.reserve(static_cast<int>(counters.size()));
+    for (const auto &entry : counters) {
+        result.append(entry.second);
+    }
+    return result;
+}
+
+QVector<MemoryUsage> ScriptProfiler::memory() const {
+    return luaAllocator.usage();
+}
+
+std::string ScriptProfiler::errorMessage(const sol::protected_function_result &result) {
+    if (result.status() == sol::call_status::memory && luaAllocator.refusedOwner() >= 0) {
+        QMutexLocker locker(&mutex);
+        ++counters[{call.plugin, call.event}].aborted;
+        return call.plugin + ": " + call.event + " exceeded the memory cap of " +
+               std::to_string(luaAllocator.cap(luaAllocator.refusedOwner()) / 1024) + " KiB";
+    }
+    sol::error error = result;
+    return error.what();
+}
+
+void ScriptProfiler::hook(lua_State *state, lua_Debug *) {
+    lua_getfield(state, LUA_REGISTRYINDEX, RegistryKey);
+    auto *profiler = static_cast<ScriptProfiler *>(lua_touserdata(state, -1));
+    lua_pop(state, 1);
+    if (profiler && profiler->overBudget()) {
+        luaL_error(state, "%s", profiler->abortMessage.c_str());
+    }
+}
+
+bool ScriptProfiler::overBudget() {
+    if (stopFlag && *stopFlag) {
+        abortMessage = "plugin stopped";
+        return true;
+    }
+    if (depth == 0) {
+        return false;
+    }
+
+    call.instructions += HookInterval;
+    if (callBudget.instructions > 0 && call.instructions > callBudget.instructions) {
+        abortMessage = call.plugin + ": " + call.event + " exceeded its budget of " +
+                       std::to_string(callBudget.instructions) + " instructions";
+    } else if (callBudget.timeMs > 0 && callTimer.hasExpired(callBudget.timeMs)) {
+        abortMessage = call.plugin + ": " + call.event + " exceeded its budget of " +
+                       std::to_string(callBudget.timeMs) + " ms";
+    } else {
+        return false;
+    }
+    callAborted = true;
+    return true;
+}
@@ -0,0 +1,156 @@
+/**
+ * @file ScriptProfiler.h
+ * @brief Per-plugin profiling and run-time budgets for Lua plugins in Coda.
+ *        Counts calls, wall time, executed Lua instructions and allocated bytes per plugin and event, and
+ *        aborts a handler with a Lua error once it exceeds its plugin's time, instruction or memory budget.
+ * @author Dario Romandini
+ */
+
+#pragma once
+
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QVector>
+#include <atomic>
+#include <map>
+#include <sol/sol.hpp>
+#include <string>
+#include <unordered_map>
+
+#include "LuaAllocator.h"
+
+/**
+ * @struct ScriptStats
+ * @brief Counters of one plugin for one event.
+ */
+struct ScriptStats {
+    std::string plugin;          ///< Script path of the plugin.
+    std::string event;           ///< Event name, or "load" for running the script itself.
+    quint64 calls = 0;           ///< Number of calls.
+    qint64 totalNs = 0;          ///< Total wall time, in nanoseconds.
+    qint64 maxNs = 0;            ///< Longest call, in nanoseconds.
+    quint64 instructions = 0;    ///< Lua instructions executed, counted in steps of HookInterval.
+    quint64 allocatedBytes = 0;  ///< Bytes allocated by the Lua state during the calls.
+    quint64 aborted = 0;         ///< Calls stopped for exceeding the budget.
+};
+
+/**
+ * @struct ScriptBudget
+ * @brief Limits of a single call of a plugin; 0 disables a limit.
+ */
+struct ScriptBudget {
+    static constexpr int DefaultTimeMs = 1000;  ///< Time limit of synchronous handlers that set none.
+
+    int timeMs = -1;               ///< Longest wall time of one call, in milliseconds; -1 for the profiler's default.
+    quint64 instructions = 0;      ///< Most Lua instructions one call may execute.
+    quint64 memoryBytes = 0;       ///< Most bytes the plugin may hold in its Lua state, across calls.
+};
+
+/**
+ * @class ScriptProfiler
+ * @brief Profiles the calls made into one Lua state.
+ *        The state must be created with LuaAllocator::allocate() and allocator() as allocator data, then
+ *        passed to attach(). begin() and end() bracket each call, and charge its allocations to the plugin;
+ *        calls nested inside another are counted in the outer one. stats() and memory() may be called from
+ *        any thread.
+ */
+class ScriptProfiler {
+public:
+    static constexpr int HookInterval = 1000; ///< Instructions between two budget checks.
+
+    /**
+     * @brief Returns the allocator to create the profiled Lua state with.
+     * @return The allocator; it must outlive the state.
+     */
+    LuaAllocator &allocator();
+
+    /**
+     * @brief Installs the instruction counting hook in a Lua state.
+     * @param state The Lua state, created with allocator().
+     * @param stop Optional flag that aborts the running call as soon as it is set.
+     */
+    void attach(lua_State *state, const std::atomic_bool *stop = nullptr);
+
+    /**
+     * @brief Sets the budget of a plugin's calls.
+     * @param plugin Script path of the plugin.
+     * @param budget The budget.
+     */
+    void setBudget(const std::string &plugin, const ScriptBudget &budget);
+
+    /**
+     * @brief Sets the time limit of handler calls whose plugin configures none.
+     *
+     * Loading a script has no default limit, since its first run may legitimately build large tables.
+     * @param timeMs The limit in milliseconds; 0 for none.
+     */
+    void setDefaultTimeMs(int timeMs);
+
+    /**
+     * @brief Returns the budget of a plugin's calls.
+     * @param plugin Script path of the plugin.
+     * @return The plugin's budget, or the default budget.
+     */
+    ScriptBudget budget(const std::string &plugin) const;
+
+    /**
+     * @brief Starts measuring a call.
+     * @param plugin Script path of the plugin being called.
+     * @param event Name of the event.
+     */
+    void begin(const std::string &plugin, const std::string &event);
+
+    /**
+     * @brief Stops measuring the current call and adds it to the counters.
+     */
+    void end();
+
+    /**
+     * @brief Returns the counters of every plugin and event called so far.
+     * @return The counters, sorted by plugin and event.
+     */
+    QVector<ScriptStats> stats() const;
+
+    /**
+     * @brief Returns the memory held by every plugin in the Lua state.
+     * @return One entry per plugin; the entry with an empty plugin holds the memory of no plugin.
+     */
+    QVector<MemoryUsage> memory() const;
+
+    /**
+     * @brief Returns the error message of a failed call, naming the memory cap if the call ran out of it.
+     *        A call stopped by its memory cap is counted as aborted.
+     * @param result Result of the last call.
+     * @return The error message.
+     */
+    std::string errorMessage(const sol::protected_function_result &result);
+
+private:
+    /**
+     * @brief Count hook: counts instructions and aborts the call when it is over budget.
+     * @param state The Lua state.
+     */
+    static void hook(lua_State *state, lua_Debug *);
+
+    /**
+     * @brief Checks the running call against its budget.
+     * @return True if the call must be aborted; abortMessage holds the reason.
+     */
+    bool overBudget();
+
+    LuaAllocator luaAllocator;                                 ///< Allocator of the profiled state.
+    const std::atomic_bool *stopFlag = nullptr;                ///< Aborts the running call when set.
+    std::unordered_map<std::string, ScriptBudget> budgets;     ///< Budget per plugin.
+    std::map<std::pair<std::string, std::string>, ScriptStats> counters; ///< Counters per plugin and event.
+    mutable QMutex mutex;                                      ///< Guards counters.
+
+    // State of the running call.
+    int depth = 0;                ///< Nesting depth of begin() calls.
+    ScriptStats call;             ///< Plugin, event and counts of the outermost call.
+    ScriptBudget callBudget;      ///< Budget of the outermost call.
+    int defaultTimeMs = 0;        ///< Time limit of handler calls whose plugin configures none.
+    QElapsedTimer callTimer;      ///< Wall time of the outermost call.
+    bool callAborted = false;     ///< True once the call was aborted.
+    int callerOwner = 0;          ///< Allocation owner to restore after the call.
+    std::string abortMessage;     ///< Error raised when aborting; kept alive while Lua unwinds.
+};
@@ -6,34 +6,184 @@
  */
 
 #include "ScriptingEngine.h"
+#include "AsyncPlugin.h"
+#include "EditorEvents.h"
 #include "EditorWidget.h"
+#include "ScriptBuffer.h"
+#include "ScriptCache.h"
+#include <QDebug>
 #include <iostream>
 
 ScriptingEngine::ScriptingEngine(EditorWidget *editor)
-    : editor(editor) {
+    : lua(sol::default_at_panic, &LuaAllocator::allocate, &profiler.allocator()), editor(editor),
+      editorEvents(std::make_unique<EditorEvents>(editor)) {
     lua.open_libraries(sol::lib::base, sol::lib::package, sol::lib::string);
+    profiler.attach(lua.lua_state());
+    profiler.setDefaultTimeMs(ScriptBudget::DefaultTimeMs);
     registerCodaAPI();
+
+    QObject::connect(editorEvents.get(), &EditorEvents::textChanged, [this](const QVector<TextChange> &changes) {
+        activatePlugins("onTextChanged");
+        dispatchTextChanged(changes);
+    });
+    QObject::connect(editorEvents.get(), &EditorEvents::cursorMoved, [this](int line, int column) {
+        activatePlugins("onCursorMoved");
+        dispatch("onCursorMoved", line + 1, column + 1);
+    });
+    QObject::connect(editorEvents.get(), &EditorEvents::idle, [this]() {
+        activatePlugins("onIdle");
+        dispatch("onIdle");
+    });
 }
 
+ScriptingEngine::~ScriptingEngine() = default;
+
 void ScriptingEngine::runScript(const std::string &path) {
+    std::unordered_map<std::string, const void *> before = globalHandlers();
+    std::string caller = currentPlugin;
+    currentPlugin = path;
+    profiler.begin(path, "load");
     try {
-        lua.script_file(path);
+        sol::protected_function_result result = ScriptCache::load(lua, path)();
+        if (!result.valid()) {
+            throw sol::error(profiler.errorMessage(result));
+        }
     } catch (const sol::error &e) {
         std::cerr << "Lua error: " << e.what() << std::endl;
     }
+    profiler.end();
+    currentPlugin = caller;
+
+    // Global handlers defined or replaced by the script are attributed to it.
+    for (const auto &[name, function] : globalHandlers()) {
+        auto previous = before.find(name);
+        if (previous == before.end() || previous->second != function) {
+            globalOwners[name] = path;
+        }
+    }
+}
+
+void ScriptingEngine::loadAsyncScript(const std::string &path) {
+    auto plugin = std::make_unique<AsyncPlugin>(path, profiler.budget(path));
+    QObject::connect(plugin.get(), &AsyncPlugin::editsProposed,
+                     [this, path](quint64 revision, const QVector<EditProposal> &edits) {
+                         applyProposals(revision, edits, path);
+                     });
+    asyncPlugins.push_back(std::move(plugin));
+}
+
+void ScriptingEngine::setBudget(const std::string &path, const ScriptBudget &budget) {
+    profiler.setBudget(path, budget);
+}
+
+QVector<ScriptStats> ScriptingEngine::profile() const {
+    QVector<ScriptStats> result = profiler.stats();
+    for (const auto &plugin : asyncPlugins) {
+        result += plugin->stats();
+    }
+    return result;
+}
+
+QVector<MemoryUsage> ScriptingEngine::memory() const {
+    QVector<MemoryUsage> result = profiler.memory();
+    for (const auto &plugin : asyncPlugins) {
+        result += plugin->memory();
+    }
+    return result;
+}
+
+template <typename... Args>
+void ScriptingEngine::call(const std::string &plugin, const std::string &eventName,
+                           const sol::protected_function &handler, Args &&...args) {
+    std::string caller = currentPlugin;
+    currentPlugin = plugin;
+    profiler.begin(plugin, eventName);
+    sol::protected_function_result result = handler(args...);
+    profiler.end();
+    currentPlugin = caller;
+
+    if (!result.valid()) {
+        std::cerr << "Lua error in " << eventName << " (" << plugin << "): " << profiler.errorMessage(result)
+                  << std::endl;
+    }
+}
+
+template <typename... Args>
+void ScriptingEngine::dispatch(const std::string &eventName, Args &&...args) {
+    sol::object global = lua[eventName];
+    if (global.get_type() == sol::type::function) {
+        auto owner = globalOwners.find(eventName);
+        call(owner != globalOwners.end() ? owner->second : std::string(), eventName,
+             global.as<sol::protected_function>(), args...);
+    }
+
+    auto subscribed = handlers.find(eventName);
+    if (subscribed != handlers.end()) {
+        // Handlers may subscribe further functions; those are called from the next event on.
+        std::vector<EventHandler> subscribers = subscribed->second;
+        for (const EventHandler &handler : subscribers) {
+            call(handler.plugin, eventName, handler.function, args...);
+        }
+    }
 }
 
 void ScriptingEngine::triggerEvent(const std::string &eventName, const std::string &filePath) {
-    sol::function handler = lua[eventName];
-    if (handler.valid()) {
-        try {
-            handler(filePath);
-        } catch (const sol::error &e) {
-            std::cerr << "Lua error in " << eventName << ": " << e.what() << std::endl;
+    dispatch(eventName, filePath);
+
+    if (!asyncPlugins.empty()) {
+        PieceTable text = editor->snapshot();
+        for (const auto &plugin : asyncPlugins) {
+            plugin->post(eventName, filePath, text, editor->textRevision());
+        }
+    }
+}
+
+void ScriptingEngine::applyProposals(quint64 revision, const QVector<EditProposal> &edits, const std::string &path) {
+    if (revision != editor->textRevision()) {
+        qWarning() << "Dropped edits from" << QString::fromStdString(path) << "because the text changed";
+        return;
+    }
+
+    editor->beginBatch();
+    for (const EditProposal &edit : edits) {
+        QTextCursor cursor(editor->document());
+        if (edit.wholeText) {
+            cursor.select(QTextCursor::Document);
+        } else {
+            cursor.setPosition(documentPosition(edit.firstLine, edit.firstColumn));
+            cursor.setPosition(documentPosition(edit.lastLine, edit.lastColumn), QTextCursor::KeepAnchor);
         }
+        cursor.insertText(QString::fromStdString(edit.text));
+    }
+    editor->endBatch();
+}
+
+int ScriptingEngine::documentPosition(int line, int column) const {
+    QTextDocument *document = editor->document();
+    QTextBlock block = document->findBlockByNumber(qBound(1, line, document->blockCount()) - 1);
+    return block.position() + qBound(0, column - 1, block.length() - 1);
+}
+
+void ScriptingEngine::setActivationHook(std::function<void(const std::string &, const std::string &)> hook) {
+    activationHook = std::move(hook);
+}
+
+void ScriptingEngine::activatePlugins(const std::string &eventName) {
+    if (activationHook) {
+        activationHook(eventName, editor->currentFilePath().toStdString());
     }
 }
 
+void ScriptingEngine::dispatchTextChanged(const QVector<TextChange> &changes) {
+    sol::table list = lua.create_table(changes.size(), 0);
+    for (int i = 0; i < changes.size(); ++i) {
+        const TextChange &change = changes[i];
+        list[i + 1] = lua.create_table_with("position", change.position + 1, "line", change.line + 1, "column",
+                                            change.column + 1, "removed", change.removed, "added", change.added);
+    }
+    dispatch("onTextChanged", list);
+}
+
 void ScriptingEngine::registerCodaAPI() {
     lua["Coda"] = lua.create_table();
 
@@ -41,10 +191,27 @@ void ScriptingEngine::registerCodaAPI() {
         std::cout << "[Coda] " << msg << std::endl;
     };
 
+    registerEventBus(lua, handlers, currentPlugin);
+    registerProfileQuery(lua, [this]() { return profile(); }, [this]() { return memory(); });
+
+    lua["Coda"]["setDebounce"] = [this](const std::string &event, int milliseconds) {
+        EditorEvents::Event debounced = EditorEvents::eventForName(event);
+        if (debounced == EditorEvents::EventCount) {
+            throw sol::error("Coda.setDebounce: " + event + " is not a debounced event");
+        }
+        editorEvents->setDelay(debounced, milliseconds);
+    };
+
+    registerBufferType(lua);
+
     lua["editor"] = lua.create_table();
 
     lua["editor"]["getText"] = [this]() {
-        return editor->toPlainText().toStdString();
+        return editor->textBuffer().toStdString();
+    };
+
+    lua["editor"]["getBuffer"] = [this]() {
+        return ScriptBuffer(editor->snapshot());
     };
 
     lua["editor"]["setText"] = [this](const std::string &text) {
@@ -74,6 +241,16 @@ void ScriptingEngine::registerCodaAPI() {
         cursor.insertText(QString::fromStdString(text));
     };
 
+    lua["editor"]["batch"] = [this](sol::protected_function edits) {
+        editor->beginBatch();
+        sol::protected_function_result result = edits();
+        editor->endBatch();
+        if (!result.valid()) {
+            sol::error error = result;
+            throw error;
+        }
+    };
+
     lua["editor"]["insertTextAt"] = [this](int line, int column, const std::string &text) {
         QTextBlock block = editor->document()->findBlockByNumber(line - 1);
         if (block.isValid()) {
@@ -82,8 +259,132 @@ void ScriptingEngine::registerCodaAPI() {
             cursor.insertText(QString::fromStdString(text));
         }
     };
+
+    lua["editor"]["setLineMarker"] = [this](int line, sol::optional<std::string> kind) {
+        std::string name = kind.value_or("");
+        GutterRenderer::Marker marker = GutterRenderer::NoMarker;
+        if (name == "info") {
+            marker = GutterRenderer::InfoMarker;
+        } else if (name == "warning") {
+            marker = GutterRenderer::WarningMarker;
+        } else if (name == "error") {
+            marker = GutterRenderer::ErrorMarker;
+        } else if (kind) {
+            throw sol::error("editor.setLineMarker: unknown marker " + name);
+        }
+        editor->setLineMarker(line - 1, marker);
+    };
+
+    lua["editor"]["clearLineMarkers"] = [this]() {
+        editor->clearLineMarkers();
+    };
+
+    // Groups belong to the plugin that names them, so plugins cannot remove each other's decorations.
+    lua["editor"]["addDecoration"] = [this](int firstLine, int firstColumn, int lastLine, int lastColumn,
+                                            sol::optional<sol::table> options) {
+        auto color = [&options](const char *key) {
+            std::string name = options ? options->get_or<std::string>(key, "") : "";
+            QColor value(QString::fromStdString(name));
+            if (!name.empty() && !value.isValid()) {
+                throw sol::error("editor.addDecoration: invalid color " + name);
+            }
+            return value;
+        };
+        DecorationStyle style;
+        style.background = color("background");
+        style.underline = color("underline");
+        style.border = color("border");
+        style.squiggle = options && options->get_or("squiggle", false);
+        if (!style.background.isValid() && !style.underline.isValid() && !style.border.isValid()) {
+            style.background = QColor(255, 200, 0, 96);
+        }
+        std::string group = options ? options->get_or<std::string>("group", "default") : "default";
+
+        return editor->addDecoration(documentPosition(firstLine, firstColumn), documentPosition(lastLine, lastColumn),
+                                     style, QString::fromStdString(currentPlugin + ':' + group));
+    };
+
+    lua["editor"]["removeDecorations"] = [this](sol::object target) {
+        if (target.get_type() == sol::type::number) {
+            // Identifiers are global; only the plugin's own groups may lose one.
+            return editor->removeDecoration(target.as<quint32>(), QString::fromStdString(currentPlugin + ':')) ? 1 : 0;
+        }
+        std::string group = target.get_type() == sol::type::string ? target.as<std::string>() : "default";
+        return editor->removeDecorations(QString::fromStdString(currentPlugin + ':' + group));
+    };
 }
 
 sol::state &ScriptingEngine::getLua() {
     return lua;
 }
+
+void ScriptingEngine::registerBufferType(sol::state &target) {
+    target.new_usertype<ScriptBuffer>("Buffer", sol::no_constructor,
+        "lineCount", &ScriptBuffer::lineCount,
+        "byteSize", &ScriptBuffer::byteSize,
+        "getLine", &ScriptBuffer::line,
+        "getRange", &ScriptBuffer::range,
+        "lineOffset", &ScriptBuffer::lineOffset,
+        "sub", &ScriptBuffer::sub,
+        "lines", [](const ScriptBuffer &buffer, sol::optional<qint64> first, sol::optional<qint64> last) {
+            qint64 line = qMax<qint64>(first.value_or(1), 1);
+            qint64 end = qMin(last.value_or(buffer.lineCount()), buffer.lineCount());
+            qint64 offset = buffer.lineOffset(line).value_or(buffer.byteSize() + 1) - 1;
+            // Each call reads one more line; the iterator holds its own snapshot.
+            return sol::as_function([buffer, line, end, offset](sol::this_state state) mutable {
+                if (line > end) {
+                    return std::make_tuple(sol::make_object(state, sol::lua_nil), sol::make_object(state, sol::lua_nil));
+                }
+                std::string text;
+                offset = buffer.readLine(offset, text);
+                return std::make_tuple(sol::make_object(state, line++), sol::make_object(state, std::move(text)));
+            });
+        });
+}
+
+std::unordered_map<std::string, const void *> ScriptingEngine::globalHandlers() {
+    std::unordered_map<std::string, const void *> result;
+    for (const auto &[key, value] : lua.globals()) {
+        if (key.get_type() == sol::type::string && value.get_type() == sol::type::function) {
+            std::string name = key.as<std::string>();
+            if (name.rfind("on", 0) == 0) {
+                result[name] = value.pointer();
+            }
+        }
+    }
+    return result;
+}
+
+void ScriptingEngine::registerEventBus(sol::state &target, EventHandlers &handlers, const std::string &owner) {
+    target["Coda"]["on"] = [&handlers, &owner](const std::string &event, sol::protected_function handler) {
+        handlers[event].push_back(EventHandler{owner, std::move(handler)});
+    };
+}
+
+void ScriptingEngine::registerProfileQuery(sol::state &target, std::function<QVector<ScriptStats>()> statsSource,
+                                           std::function<QVector<MemoryUsage>()> memorySource) {
+    target["Coda"]["profile"] = [source = std::move(statsSource)](sol::this_state state) {
+        sol::state_view view(state);
+        QVector<ScriptStats> stats = source();
+        sol::table list = view.create_table(stats.size(), 0);
+        for (int i = 0; i < stats.size(); ++i) {
+            const ScriptStats &entry = stats[i];
+            list[i + 1] = view.create_table_with("plugin", entry.plugin, "event", entry.event, "calls", entry.calls,
+                                                 "totalMs", entry.totalNs / 1e6, "maxMs", entry.maxNs / 1e6,
+                                                 "instructions", entry.instructions, "allocatedBytes",
+                                                 entry.allocatedBytes, "aborted", entry.aborted);
+        }
+        return list;
+    };
+    target["Coda"]["memory"] = [source = std::move(memorySource)](sol::this_state state) {
+        sol::state_view view(state);
+        QVector<MemoryUsage> usage = source();
+        sol::table list = view.create_table(usage.size(), 0);
+        for (int i = 0; i < usage.size(); ++i) {
+            const MemoryUsage &entry = usage[i];
+            list[i + 1] = view.create_table_with("plugin", entry.plugin, "bytes", entry.bytes, "peakBytes",
+                                                 entry.peakBytes, "capBytes", entry.capBytes);
+        }
+        return list;
+    };
+}
@@ -8,10 +8,33 @@
 
 #pragma once
 
+#include <QVector>
+#include <functional>
+#include <memory>
 #include <sol/sol.hpp>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
+#include "ScriptProfiler.h"
+
+class AsyncPlugin;
+class EditorEvents;
 class EditorWidget;
+struct EditProposal;
+struct TextChange;
+
+/**
+ * @struct EventHandler
+ * @brief A Lua function subscribed to an event, with the plugin that subscribed it.
+ */
+struct EventHandler {
+    std::string plugin;               ///< Script path of the subscribing plugin.
+    sol::protected_function function; ///< The handler.
+};
+
+/// Lua functions subscribed with Coda.on(), per event name.
+using EventHandlers = std::unordered_map<std::string, std::vector<EventHandler>>;
 
 /**
  * @class ScriptingEngine
@@ -26,6 +49,11 @@ public:
      */
     explicit ScriptingEngine(EditorWidget *editor);
 
+    /**
+     * @brief Destructor. Stops the async plugins.
+     */
+    ~ScriptingEngine();
+
     /**
      * @brief Executes a Lua script file.
      * @param path Path to the Lua script.
@@ -33,24 +61,143 @@ public:
     void runScript(const std::string &path);
 
     /**
-     * @brief Triggers a Lua event handler by name (e.g., "onFileOpen").
+     * @brief Loads a Lua script as an async plugin, whose handlers run on a worker thread.
+     * @param path Path to the Lua script.
+     */
+    void loadAsyncScript(const std::string &path);
+
+    /**
+     * @brief Sets the time, instruction and memory budget of a plugin's handlers.
+     *        Set it before the plugin is loaded; a handler over budget is aborted with a Lua error.
+     * @param path Path to the plugin's Lua script.
+     * @param budget The budget.
+     */
+    void setBudget(const std::string &path, const ScriptBudget &budget);
+
+    /**
+     * @brief Returns the profiling counters of every plugin, including async ones.
+     * @return The counters per plugin and event.
+     */
+    QVector<ScriptStats> profile() const;
+
+    /**
+     * @brief Returns the memory held by every plugin, including async ones.
+     * @return One entry per plugin; the entry with an empty plugin is shared by the synchronous plugins.
+     */
+    QVector<MemoryUsage> memory() const;
+
+    /**
+     * @brief Triggers a Lua event by name (e.g., "onFileOpen"): calls the global handler of that name, then
+     *        every function subscribed with Coda.on(). Async plugins receive the event with a snapshot of the
+     *        current text.
      * @param eventName The name of the event (Lua function name).
      * @param filePath The file path to pass as an argument (optional).
      */
     void triggerEvent(const std::string &eventName, const std::string &filePath = "");
 
+    /**
+     * @brief Sets the function called before a debounced editor event (onTextChanged, onCursorMoved,
+     *        onIdle) is dispatched, so that the plugins it activates are loaded first.
+     * @param hook Receives the event name and the current file path; empty to remove it.
+     */
+    void setActivationHook(std::function<void(const std::string &, const std::string &)> hook);
+
     /**
      * @brief Access the Lua state for custom extensions.
      * @return Reference to the Lua state.
      */
     sol::state &getLua();
 
+    /**
+     * @brief Registers the read-only Buffer usertype returned by editor.getBuffer().
+     * @param target Lua state to register the type in.
+     */
+    static void registerBufferType(sol::state &target);
+
+    /**
+     * @brief Registers Coda.on(event, function), which subscribes a function to an event.
+     * @param target Lua state to register the function in.
+     * @param handlers Map receiving the subscriptions; must be destroyed before the Lua state.
+     * @param owner Script path of the plugin running when Coda.on() is called.
+     */
+    static void registerEventBus(sol::state &target, EventHandlers &handlers, const std::string &owner);
+
+    /**
+     * @brief Registers Coda.profile() and Coda.memory(), which return profiling counters and memory use
+     *        as lists of tables.
+     * @param target Lua state to register the functions in.
+     * @param statsSource Returns the counters to report.
+     * @param memorySource Returns the memory use to report.
+     */
+    static void registerProfileQuery(sol::state &target, std::function<QVector<ScriptStats>()> statsSource,
+                                     std::function<QVector<MemoryUsage>()> memorySource);
+
 private:
     /**
      * @brief Registers the Coda API functions and editor methods into the Lua state.
      */
     void registerCodaAPI();
 
+    /**
+     * @brief Calls the global handler and the subscribers of an event.
+     * @param eventName The name of the event.
+     * @param args Arguments passed to every handler.
+     */
+    template <typename... Args>
+    void dispatch(const std::string &eventName, Args &&...args);
+
+    /**
+     * @brief Lets the activation hook load the plugins waiting for a debounced editor event.
+     * @param eventName The name of the event about to be dispatched.
+     */
+    void activatePlugins(const std::string &eventName);
+
+    /**
+     * @brief Converts coalesced text changes to Lua and dispatches onTextChanged.
+     * @param changes The changes, in the order they were made.
+     */
+    void dispatchTextChanged(const QVector<TextChange> &changes);
+
+    /**
+     * @brief Applies the edits proposed by an async plugin as one undo step.
+     * @param revision Text revision the plugin read; the edits are dropped if the text changed since.
+     * @param edits The edits, applied in order.
+     * @param path Script path, for the warning when edits are dropped.
+     */
+    void applyProposals(quint64 revision, const QVector<EditProposal> &edits, const std::string &path);
+
+    /**
+     * @brief Converts a 1-based line and column to a document position, clamped to the text.
+     * @param line 1-based line.
+     * @param column 1-based column.
+     * @return The document position.
+     */
+    int documentPosition(int line, int column) const;
+
+    /**
+     * @brief Calls one handler, profiled and attributed to its plugin.
+     * @param plugin Script path of the handler's plugin.
+     * @param eventName The name of the event.
+     * @param handler The handler.
+     * @param args Arguments passed to the handler.
+     */
+    template <typename... Args>
+    void call(const std::string &plugin, const std::string &eventName, const sol::protected_function &handler,
+              Args &&...args);
+
+    /**
+     * @brief Returns the global functions that look like event handlers, i.e. whose names start with "on".
+     * @return The functions' identities per name.
+     */
+    std::unordered_map<std::string, const void *> globalHandlers();
+
+    ScriptProfiler profiler; ///< Counters and budgets; allocator of the Lua state, so declared before it.
     sol::state lua;          ///< Lua interpreter state.
     EditorWidget *editor;    ///< Editor widget for text manipulation.
+    std::string currentPlugin; ///< Script path of the plugin being loaded or called.
+    std::unordered_map<std::string, std::string> globalOwners; ///< Plugin that defined each global handler.
+    EventHandlers handlers;  ///< Subscribers per event; destroyed before the Lua state.
+    std::unique_ptr<EditorEvents> editorEvents; ///< Source of the debounced high-frequency events.
+    std::function<void(const std::string &, const std::string &)> activationHook; ///< Loads pending plugins.
+    std::vector<std::unique_ptr<AsyncPlugin>> asyncPlugins; ///< Plugins running on worker threads.
 };
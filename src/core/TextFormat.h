@@ -0,0 +1,22 @@
+/**
+ * @file TextFormat.h
+ * @brief On-disk format of a text file in the Coda text editor: encoding, byte order mark and line endings.
+ *        Recorded when a file is loaded so it can be written back unchanged.
+ * @author Dario Romandini
+ */
+
+#pragma once
+
+#include <QByteArray>
+
+#include "LineIndex.h"
+
+/**
+ * @struct TextFormat
+ * @brief Describes how a document's text is encoded on disk.
+ */
+struct TextFormat {
+    QByteArray codec = "UTF-8";             ///< Name of the QTextCodec used to encode the file.
+    bool byteOrderMark = false;             ///< True if the file starts with a byte order mark.
+    LineEnding lineEnding = LineEnding::LF; ///< Line terminator written between lines.
+};
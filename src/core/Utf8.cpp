@@ -0,0 +1,165 @@
+/**
+ * @file Utf8.cpp
+ * @brief Implementation of the Utf8 class for Coda.
+ * @author Dario Romandini
+ */
+
+#include "Utf8.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CODA_UTF8_SSE2 1
+#endif
+
+namespace {
+
+/**
+ * @brief Returns the length of the sequence starting with a lead byte, or 0 if it cannot start one.
+ */
+int sequenceLength(unsigned char lead) {
+    if (lead < 0x80) {
+        return 1;
+    }
+    if (lead >= 0xC2 && lead <= 0xDF) {
+        return 2;
+    }
+    if (lead >= 0xE0 && lead <= 0xEF) {
+        return 3;
+    }
+    if (lead >= 0xF0 && lead <= 0xF4) {
+        return 4;
+    }
+    return 0;
+}
+
+/**
+ * @brief Returns the length of the well-formed sequence at p, or 0 if the bytes there do not start one.
+ */
+int validLength(const unsigned char *p, const unsigned char *end) {
+    int length = sequenceLength(*p);
+    if (length == 0 || end - p < length) {
+        return 0;
+    }
+    // The second byte carries the range limits that rule out overlong forms, surrogates and
+    // code points above U+10FFFF (Unicode table 3-7); the others are plain continuation bytes.
+    unsigned char low = 0x80;
+    unsigned char high = 0xBF;
+    if (*p == 0xE0) {
+        low = 0xA0;
+    } else if (*p == 0xED) {
+        high = 0x9F;
+    } else if (*p == 0xF0) {
+        low = 0x90;
+    } else if (*p == 0xF4) {
+        high = 0x8F;
+    }
+    if (length > 1 && (p[1] < low || p[1] > high)) {
+        return 0;
+    }
+    for (int i = 2; i < length; ++i) {
+        if ((p[i] & 0xC0) != 0x80) {
+            return 0;
+        }
+    }
+    return length;
+}
+
+/**
+ * @brief Returns whether 16 bytes are all ASCII.
+ */
+inline bool isAscii16(const char *p) {
+#ifdef CODA_UTF8_SSE2
+    return _mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p))) == 0;
+#else
+    Q_UNUSED(p);
+    return false;
+#endif
+}
+
+} // namespace
+
+bool Utf8::isValid(const char *data, qint64 size) {
+    const auto *p = reinterpret_cast<const unsigned char *>(data);
+    const auto *end = p + size;
+    while (p < end) {
+        if (end - p >= 16 && isAscii16(reinterpret_cast<const char *>(p))) {
+            p += 16;
+            continue;
+        }
+        unsigned char lead = *p;
+        if (lead < 0x80) {
+            ++p;
+            continue;
+        }
+        int length = validLength(p, end);
+        if (length == 0) {
+            return false;
+        }
+        p += length;
+    }
+    return true;
+}
+
+qint64 Utf8::completeLength(const char *data, qint64 size) {
+    // A cut-off sequence has its lead byte among the last three bytes.
+    for (qint64 back = 1; back <= 3 && back <= size; ++back) {
+        auto byte = static_cast<unsigned char>(data[size - back]);
+        if ((byte & 0xC0) != 0x80) {
+            int length = sequenceLength(byte);
+            return length > back ? size - back : size;
+        }
+    }
+    return size;
+}
+
+int Utf8::characterLength(const char *data, qint64 size) {
+    const auto *p = reinterpret_cast<const unsigned char *>(data);
+    return qMax(1, validLength(p, p + size));
+}
+
+qint64 Utf8::toUtf16(const char *data, qint64 size, QChar *out) {
+    const auto *p = reinterpret_cast<const unsigned char *>(data);
+    const auto *end = p + size;
+    QChar *start = out;
+    while (p < end) {
+#ifdef CODA_UTF8_SSE2
+        if (end - p >= 16) {
+            __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+            if (_mm_movemask_epi8(bytes) == 0) {
+                // Widen 16 ASCII bytes to 16 UTF-16 units by interleaving them with zeros.
+                const __m128i zero = _mm_setzero_si128();
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(out), _mm_unpacklo_epi8(bytes, zero));
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 8), _mm_unpackhi_epi8(bytes, zero));
+                p += 16;
+                out += 16;
+                continue;
+            }
+        }
+#endif
+        unsigned char lead = *p;
+        if (lead < 0x80) {
+            *out++ = QChar(lead);
+            ++p;
+            continue;
+        }
+        int length = validLength(p, end);
+        if (length == 0) {
+            // A byte outside any well-formed sequence becomes one U+FFFD, so decoding always moves on.
+            *out++ = QChar(QChar::ReplacementCharacter);
+            ++p;
+            continue;
+        }
+        char32_t code = lead & (0x7F >> length);
+        for (int i = 1; i < length; ++i) {
+            code = (code << 6) | (p[i] & 0x3F);
+        }
+        p += length;
+        if (code >= 0x10000) {
+            *out++ = QChar(QChar::highSurrogate(code));
+            *out++ = QChar(QChar::lowSurrogate(code));
+        } else {
+            *out++ = QChar(static_cast<char16_t>(code));
+        }
+    }
+    return out - start;
+}
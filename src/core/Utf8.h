@@ -0,0 +1,55 @@
+/**
+ * @file Utf8.h
+ * @brief UTF-8 validation and transcoding for the Coda text editor.
+ *        Both skip runs of ASCII sixteen bytes at a time with SSE2, which covers most of a typical source
+ *        file or log; only multi-byte sequences take the scalar path.
+ * @author Dario Romandini
+ */
+
+#pragma once
+
+#include <QChar>
+#include <QtGlobal>
+
+/**
+ * @class Utf8
+ * @brief Stateless UTF-8 helpers.
+ */
+class Utf8 {
+public:
+    /**
+     * @brief Checks that bytes are well-formed UTF-8: no overlong forms, surrogates or code points
+     *        above U+10FFFF, and no sequence cut off at the end.
+     * @param data Start of the bytes.
+     * @param size Number of bytes.
+     * @return True if the bytes are valid UTF-8.
+     */
+    static bool isValid(const char *data, qint64 size);
+
+    /**
+     * @brief Returns how many leading bytes end on a sequence boundary, so that a buffer can be
+     *        transcoded in slices without splitting a character.
+     * @param data Start of the bytes.
+     * @param size Number of bytes.
+     * @return size, less the bytes of a sequence cut off at the end.
+     */
+    static qint64 completeLength(const char *data, qint64 size);
+
+    /**
+     * @brief Returns how many bytes toUtf16() decodes into the character at a position.
+     * @param data Start of the character; size must be at least 1.
+     * @param size Number of bytes from data to the end of the text.
+     * @return Length of the well-formed sequence at data, or 1 for a byte that becomes U+FFFD.
+     */
+    static int characterLength(const char *data, qint64 size);
+
+    /**
+     * @brief Transcodes UTF-8 to UTF-16. Each byte that is not part of a well-formed sequence, including
+     *        one cut off at the end, becomes U+FFFD.
+     * @param data Start of the bytes.
+     * @param size Number of bytes.
+     * @param out Receives the UTF-16 units; must have room for size units.
+     * @return Number of units written.
+     */
+    static qint64 toUtf16(const char *data, qint64 size, QChar *out);
+};
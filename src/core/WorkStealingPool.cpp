@@ -0,0 +1,115 @@
+/**
+ * @file WorkStealingPool.cpp
+ * @brief Implementation of the WorkStealingPool class for Coda.
+ * @author Dario Romandini
+ */
+
+#include "WorkStealingPool.h"
+#include <algorithm>
+
+namespace {
+
+thread_local const WorkStealingPool *currentPool = nullptr; ///< Pool the calling thread works for.
+thread_local int currentIndex = -1;                         ///< Index of the calling worker.
+
+} // namespace
+
+WorkStealingPool::WorkStealingPool(unsigned threads) {
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (unsigned i = 0; i < threads; ++i) {
+        queues.push_back(std::make_unique<Queue>());
+    }
+    for (unsigned i = 0; i < threads; ++i) {
+        workers.emplace_back(&WorkStealingPool::run, this, i);
+    }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+}
+
+void WorkStealingPool::push(Task task) {
+    unsigned index = currentPool == this ? static_cast<unsigned>(currentIndex)
+                                         : nextQueue++ % static_cast<unsigned>(queues.size());
+    ++pending;
+    {
+        std::lock_guard<std::mutex> lock(queues[index]->mutex);
+        queues[index]->tasks.push_back(std::move(task));
+    }
+    {
+        // Counted under the sleep lock so that a worker about to sleep cannot miss the task.
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        ++queued;
+    }
+    wake.notify_one();
+}
+
+void WorkStealingPool::wait() {
+    std::unique_lock<std::mutex> lock(sleepMutex);
+    idle.wait(lock, [this] { return pending == 0; });
+}
+
+unsigned WorkStealingPool::threadCount() const {
+    return static_cast<unsigned>(workers.size());
+}
+
+int WorkStealingPool::currentWorker() {
+    return currentIndex;
+}
+
+void WorkStealingPool::run(unsigned index) {
+    currentPool = this;
+    currentIndex = static_cast<int>(index);
+
+    Task task;
+    while (true) {
+        if (!take(index, task)) {
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            wake.wait(lock, [this] { return stopping || queued > 0; });
+            if (stopping && queued == 0) {
+                return;
+            }
+            continue;
+        }
+
+        task();
+        task = nullptr;
+        if (--pending == 0) {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            idle.notify_all();
+        }
+    }
+}
+
+bool WorkStealingPool::take(unsigned index, Task &task) {
+    {
+        Queue &own = *queues[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            --queued;
+            return true;
+        }
+    }
+    for (std::size_t i = 1; i < queues.size(); ++i) {
+        Queue &victim = *queues[(index + i) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            --queued;
+            return true;
+        }
+    }
+    return false;
+}
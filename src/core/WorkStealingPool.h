@@ -0,0 +1,99 @@
+/**
+ * @file WorkStealingPool.h
+ * @brief Work-stealing thread pool for the Coda text editor.
+ *        Every worker owns a deque: tasks it spawns go to the back of its own deque and are run newest
+ *        first, while idle workers steal the oldest tasks from the front of the others. Tasks that fan
+ *        out, like walking a directory tree, spread over all cores without a central queue.
+ * @author Dario Romandini
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @class WorkStealingPool
+ * @brief Runs tasks, and the tasks they push, on a fixed set of threads.
+ */
+class WorkStealingPool {
+public:
+    using Task = std::function<void()>; ///< A unit of work.
+
+    /**
+     * @brief Constructor. Starts the worker threads.
+     * @param threads Number of workers; 0 for one per core.
+     */
+    explicit WorkStealingPool(unsigned threads = 0);
+
+    /**
+     * @brief Destructor. Runs the remaining tasks, then stops the workers.
+     */
+    ~WorkStealingPool();
+
+    WorkStealingPool(const WorkStealingPool &) = delete;
+    WorkStealingPool &operator=(const WorkStealingPool &) = delete;
+
+    /**
+     * @brief Queues a task. Called from a worker, the task goes to that worker's own deque.
+     * @param task The task.
+     */
+    void push(Task task);
+
+    /**
+     * @brief Blocks until every task, including those pushed by other tasks, has run.
+     */
+    void wait();
+
+    /**
+     * @brief Returns the number of workers.
+     * @return The thread count.
+     */
+    unsigned threadCount() const;
+
+    /**
+     * @brief Returns the index of the calling worker.
+     * @return Index in [0, threadCount()), or -1 if the caller is not a worker of any pool.
+     */
+    static int currentWorker();
+
+private:
+    /**
+     * @struct Queue
+     * @brief A worker's deque.
+     */
+    struct Queue {
+        std::mutex mutex;       ///< Guards tasks.
+        std::deque<Task> tasks; ///< Owner pops at the back, thieves at the front.
+    };
+
+    /**
+     * @brief Worker thread body.
+     * @param index Index of the worker.
+     */
+    void run(unsigned index);
+
+    /**
+     * @brief Takes a task from the worker's own deque, or steals one from another.
+     * @param index Index of the worker.
+     * @param task Receives the task.
+     * @return False if every deque is empty.
+     */
+    bool take(unsigned index, Task &task);
+
+    std::vector<std::unique_ptr<Queue>> queues; ///< One deque per worker.
+    std::vector<std::thread> workers;           ///< The worker threads.
+    std::mutex sleepMutex;                      ///< Guards sleeping, waking and stopping.
+    std::condition_variable wake;               ///< Signals queued tasks or shutdown.
+    std::condition_variable idle;               ///< Signals that no task is left.
+    std::atomic<int> queued{0};                 ///< Tasks waiting in the deques.
+    std::atomic<int> pending{0};                ///< Tasks queued or running.
+    std::atomic<unsigned> nextQueue{0};         ///< Deque receiving the next task pushed from outside.
+    bool stopping = false;                      ///< Set to stop the workers once the deques are empty.
+};
@@ -0,0 +1,469 @@
+/**
+ * @file WorkspaceSearch.cpp
+ * @brief Implementation of the WorkspaceSearch class for Coda. A coordinator thread owns the pool for
+ *        the duration of a search; pool workers post batches of results back to the search object's
+ *        thread, where they are dropped if the search they belong to is no longer current.
+ * @author Dario Romandini
+ */
+
+#include "WorkspaceSearch.h"
+#include "LineIndex.h"
+#include "MappedFile.h"
+#include "Utf8.h"
+#include "WorkStealingPool.h"
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+/**
+ * @struct IgnoreRules
+ * @brief Patterns of the ignore files of one directory, chained to those of its parents.
+ *        Like git, the last matching pattern decides and deeper directories take precedence.
+ */
+struct IgnoreRules {
+    /**
+     * @struct Pattern
+     * @brief One line of an ignore file.
+     */
+    struct Pattern {
+        QByteArray glob;            ///< Glob without the markers below.
+        bool negated = false;       ///< "!pattern": re-includes what an earlier pattern ignored.
+        bool directoryOnly = false; ///< "pattern/": matches only directories.
+        bool anchored = false;      ///< Contains a "/": matched against the path from the directory.
+    };
+
+    std::shared_ptr<const IgnoreRules> parent; ///< Rules of the parent directories.
+    QString directory;                         ///< Directory of the ignore files, ending with '/'.
+    std::vector<Pattern> patterns;             ///< Patterns in file order.
+};
+
+namespace {
+
+/**
+ * @brief Matches a glob: * and ? do not match '/', ** matches anything and "**" followed by '/' also
+ *        matches no directory at all; [abc] and [!a-z] match character classes.
+ */
+bool globMatch(const char *glob, const char *text) {
+    while (*glob) {
+        if (glob[0] == '*' && glob[1] == '*') {
+            const char *rest = glob + 2;
+            if (*rest == '/' && globMatch(rest + 1, text)) {
+                return true;
+            }
+            for (const char *t = text;; ++t) {
+                if (globMatch(rest, t)) {
+                    return true;
+                }
+                if (!*t) {
+                    return false;
+                }
+            }
+        }
+        if (*glob == '*') {
+            for (const char *t = text;; ++t) {
+                if (globMatch(glob + 1, t)) {
+                    return true;
+                }
+                if (!*t || *t == '/') {
+                    return false;
+                }
+            }
+        }
+        if (!*text) {
+            return false;
+        }
+        if (*glob == '[') {
+            const char *p = glob + 1;
+            bool negate = *p == '!' || *p == '^';
+            if (negate) {
+                ++p;
+            }
+            bool matched = false;
+            for (bool first = true; *p && (first || *p != ']'); first = false, ++p) {
+                if (p[1] == '-' && p[2] && p[2] != ']') {
+                    matched |= *text >= p[0] && *text <= p[2];
+                    p += 2;
+                } else {
+                    matched |= *text == *p;
+                }
+            }
+            if (!*p || matched == negate || *text == '/') {
+                return false;
+            }
+            glob = p + 1;
+            ++text;
+            continue;
+        }
+        if (*glob == '\\' && glob[1]) {
+            ++glob;
+        }
+        if (*glob == '?' ? *text == '/' : *glob != *text) {
+            return false;
+        }
+        ++glob;
+        ++text;
+    }
+    return !*text;
+}
+
+/**
+ * @brief Reads the patterns of an ignore file into a list.
+ */
+void readIgnoreFile(const QString &path, std::vector<IgnoreRules::Pattern> &patterns) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return;
+    }
+    while (!file.atEnd()) {
+        QByteArray line = file.readLine();
+        while (line.endsWith('\n') || line.endsWith('\r')) {
+            line.chop(1);
+        }
+        // Trailing spaces are ignored unless escaped.
+        while (line.endsWith(' ') && !line.endsWith("\\ ")) {
+            line.chop(1);
+        }
+        if (line.isEmpty() || line.startsWith('#')) {
+            continue;
+        }
+
+        IgnoreRules::Pattern pattern;
+        if (line.startsWith('!')) {
+            pattern.negated = true;
+            line.remove(0, 1);
+        }
+        if (line.endsWith('/')) {
+            pattern.directoryOnly = true;
+            line.chop(1);
+        }
+        pattern.anchored = line.contains('/');
+        if (line.startsWith('/')) {
+            line.remove(0, 1);
+        }
+        if (!line.isEmpty()) {
+            pattern.glob = line;
+            patterns.push_back(pattern);
+        }
+    }
+}
+
+/**
+ * @brief Returns whether the rules ignore an entry.
+ */
+bool isIgnored(const IgnoreRules *rules, const QString &path, bool directory) {
+    for (; rules; rules = rules->parent.get()) {
+        QByteArray relative = path.mid(rules->directory.size()).toUtf8();
+        QByteArray name = relative.mid(relative.lastIndexOf('/') + 1);
+        for (auto pattern = rules->patterns.rbegin(); pattern != rules->patterns.rend(); ++pattern) {
+            if (pattern->directoryOnly && !directory) {
+                continue;
+            }
+            if (globMatch(pattern->glob.constData(), (pattern->anchored ? relative : name).constData())) {
+                return !pattern->negated;
+            }
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Returns a line of a file as preview text, shortened around a match if it is long.
+ */
+QString preview(const char *lineStart, const char *lineEnd, const char *match, int previewBytes) {
+    if (lineEnd > lineStart && lineEnd[-1] == '\r') {
+        --lineEnd;
+    }
+    const char *first = lineStart;
+    const char *last = lineEnd;
+    if (last - first > previewBytes) {
+        first = std::max(lineStart, match - previewBytes / 4);
+        last = std::min(lineEnd, first + previewBytes);
+    }
+    // Cut at character boundaries.
+    while (first > lineStart && (static_cast<unsigned char>(*first) & 0xC0) == 0x80) {
+        --first;
+    }
+    while (last < lineEnd && (static_cast<unsigned char>(*last) & 0xC0) == 0x80) {
+        ++last;
+    }
+    QString text = QString::fromUtf8(first, static_cast<int>(last - first)).trimmed();
+    if (first > lineStart) {
+        text.prepend(QStringLiteral("..."));
+    }
+    if (last < lineEnd) {
+        text.append(QStringLiteral("..."));
+    }
+    return text;
+}
+
+} // namespace
+
+double WorkspaceStats::filesPerSecond() const {
+    return elapsedMs > 0 ? files * 1000.0 / elapsedMs : 0;
+}
+
+double WorkspaceStats::megabytesPerSecond() const {
+    return elapsedMs > 0 ? bytes / 1048.576 / elapsedMs : 0;
+}
+
+WorkspaceSearch::WorkspaceSearch(QObject *parent) : QObject(parent) {}
+
+WorkspaceSearch::~WorkspaceSearch() {
+    stopWorker();
+}
+
+bool WorkspaceSearch::search(const QString &root, const FindOptions &options, QString *error) {
+    stopWorker();
+    if (options.pattern.isEmpty()) {
+        return false;
+    }
+    QFileInfo directory(root);
+    if (!directory.isDir()) {
+        if (error) {
+            *error = "Not a directory: " + root;
+        }
+        return false;
+    }
+    QRegularExpression check = FindEngine::expression(options);
+    if (!check.isValid()) {
+        if (error) {
+            *error = check.errorString();
+        }
+        return false;
+    }
+
+    current = std::make_shared<SearchState>();
+    current->root = directory.canonicalFilePath();
+    current->options = options;
+    if (!options.regex && options.caseSensitive && !options.wholeWords) {
+        current->needle = options.pattern.toUtf8();
+    }
+    current->timer.start();
+    worker = std::thread(&WorkspaceSearch::run, this, current);
+    return true;
+}
+
+void WorkspaceSearch::cancel() {
+    stopWorker();
+}
+
+bool WorkspaceSearch::isSearching() const {
+    return current != nullptr;
+}
+
+void WorkspaceSearch::stopWorker() {
+    if (current) {
+        current->cancelled = true;
+        current.reset();
+    }
+    if (worker.joinable()) {
+        worker.join();
+    }
+}
+
+void WorkspaceSearch::run(std::shared_ptr<SearchState> state) {
+    {
+        WorkStealingPool pool;
+        state->threads = pool.threadCount();
+        // Workers match with their own copy: a compiled expression is not shared between threads.
+        if (state->needle.isEmpty()) {
+            for (unsigned i = 0; i < state->threads; ++i) {
+                state->patterns.push_back(FindEngine::expression(state->options));
+            }
+        }
+        pool.push([this, state, &pool] { searchDirectory(state, pool, state->root, nullptr); });
+        pool.wait();
+    }
+
+    // Cancelled by the UI thread; a search stopped at the match limit still reports.
+    if (state->cancelled && state->matches < MaxMatches) {
+        return;
+    }
+    report(state, FileResult(), true);
+    WorkspaceStats stats = statsOf(*state);
+    QMetaObject::invokeMethod(this, [this, state, stats] {
+        if (state == current) {
+            current.reset();
+            emit finished(stats);
+        }
+    }, Qt::QueuedConnection);
+}
+
+void WorkspaceSearch::searchDirectory(const std::shared_ptr<SearchState> &state, WorkStealingPool &pool,
+                                      const QString &directory, std::shared_ptr<const IgnoreRules> rules) {
+    if (state->cancelled) {
+        return;
+    }
+
+    auto own = std::make_shared<IgnoreRules>();
+    readIgnoreFile(directory + "/.gitignore", own->patterns);
+    readIgnoreFile(directory + "/.ignore", own->patterns);
+    if (!own->patterns.empty()) {
+        own->parent = std::move(rules);
+        own->directory = directory + '/';
+        rules = std::move(own);
+    }
+
+    // Symbolic links are not followed, so the walk cannot loop.
+    QDirIterator entries(directory, QDir::Dirs | QDir::Files | QDir::Hidden | QDir::NoDotAndDotDot | QDir::NoSymLinks);
+    while (entries.hasNext() && !state->cancelled) {
+        QString path = entries.next();
+        QFileInfo info = entries.fileInfo();
+        bool isDirectory = info.isDir();
+        if (isDirectory && (info.fileName() == ".git" || info.fileName() == ".hg" || info.fileName() == ".svn")) {
+            continue;
+        }
+        if (isIgnored(rules.get(), path, isDirectory)) {
+            continue;
+        }
+        if (isDirectory) {
+            pool.push([this, state, &pool, path, rules] { searchDirectory(state, pool, path, rules); });
+        } else {
+            qint64 size = info.size();
+            pool.push([this, state, path, size] { searchFile(state, path, size); });
+        }
+    }
+}
+
+void WorkspaceSearch::searchFile(const std::shared_ptr<SearchState> &state, const QString &path, qint64 size) {
+    if (state->cancelled || size == 0) {
+        return;
+    }
+
+    // Mapping costs a few system calls and page faults; small files are cheaper to read.
+    MappedFile mapped;
+    QByteArray contents;
+    const char *data = nullptr;
+    if (size >= MapThreshold && mapped.open(path)) {
+        data = mapped.data();
+        size = mapped.size();
+    } else {
+        QFile file(path);
+        if (!file.open(QIODevice::ReadOnly)) {
+            return;
+        }
+        contents = file.readAll();
+        data = contents.constData();
+        size = contents.size();
+    }
+    if (std::memchr(data, '\0', static_cast<std::size_t>(qMin(size, SniffSize)))) {
+        ++state->skipped;
+        return;
+    }
+    ++state->files;
+    state->bytes += size;
+
+    FileResult result;
+    result.path = path;
+    const char *end = data + size;
+    const char *lineStart = data;
+    int line = 1;
+    // Moves lineStart and line to the line containing a position; positions only increase.
+    auto advance = [&](const char *position) {
+        while (true) {
+            const char *newline = LineIndex::findNewline(lineStart, position);
+            if (newline == position) {
+                return;
+            }
+            lineStart = newline + 1;
+            ++line;
+        }
+    };
+    auto add = [&](const char *match, int length) {
+        advance(match);
+        FileHit hit;
+        hit.line = line;
+        hit.column = static_cast<int>(FindEngine::utf16Length(lineStart, match)) + 1;
+        hit.length = length;
+        hit.preview = preview(lineStart, LineIndex::findNewline(match, end), match, PreviewBytes);
+        result.hits.append(hit);
+        return result.hits.size() < MaxHitsPerFile;
+    };
+
+    if (!state->needle.isEmpty()) {
+        const QByteArray &needle = state->needle;
+        int length = state->options.pattern.size();
+        const char *from = data;
+        while (true) {
+            const char *hit = FindEngine::findLiteral(from, end, needle.constData(),
+                                                      static_cast<std::size_t>(needle.size()));
+            if (hit == end || !add(hit, length)) {
+                break;
+            }
+            from = hit + needle.size();
+        }
+    } else {
+        // Match on the decoded text, then map each match back to its bytes for the line and preview.
+        // Utf8 decodes each invalid byte to one U+FFFD, so walking the bytes with the same rule keeps
+        // the units and the bytes in step. QString holds at most INT_MAX units; the rest of a file that
+        // large is not searched.
+        qint64 decoded = Utf8::completeLength(data, qMin(size, qint64(INT_MAX)));
+        QString text(static_cast<int>(decoded), Qt::Uninitialized);
+        text.resize(static_cast<int>(Utf8::toUtf16(data, decoded, text.data())));
+        const QRegularExpression &pattern = state->patterns[WorkStealingPool::currentWorker()];
+        QRegularExpressionMatchIterator matches = pattern.globalMatch(text);
+        const char *byte = data;
+        int unit = 0;
+        while (matches.hasNext()) {
+            QRegularExpressionMatch match = matches.next();
+            if (match.capturedLength() == 0) {
+                continue;
+            }
+            while (unit < match.capturedStart() && byte < end) {
+                int bytes = Utf8::characterLength(byte, end - byte);
+                unit += bytes == 4 ? 2 : 1;
+                byte += bytes;
+            }
+            // The length stays in UTF-16 units, like FileHit::length and the literal search's.
+            if (!add(byte, match.capturedLength())) {
+                break;
+            }
+        }
+    }
+
+    if (!result.hits.isEmpty() && state->matches.fetch_add(result.hits.size()) + result.hits.size() >= MaxMatches) {
+        state->cancelled = true;
+    }
+    report(state, std::move(result), false);
+}
+
+void WorkspaceSearch::report(const std::shared_ptr<SearchState> &state, FileResult result, bool force) {
+    std::lock_guard<std::mutex> lock(state->resultsMutex);
+    if (!result.hits.isEmpty()) {
+        state->results.append(std::move(result));
+    }
+    qint64 now = state->timer.elapsed();
+    if (!force && now - state->lastPostMs < BatchIntervalMs) {
+        return;
+    }
+    state->lastPostMs = now;
+
+    QVector<FileResult> results;
+    results.swap(state->results);
+    WorkspaceStats stats = statsOf(*state);
+    QMetaObject::invokeMethod(this, [this, state, results, stats] {
+        if (state == current) {
+            if (!results.isEmpty()) {
+                emit resultsFound(results);
+            }
+            emit progress(stats);
+        }
+    }, Qt::QueuedConnection);
+}
+
+WorkspaceStats WorkspaceSearch::statsOf(const SearchState &state) {
+    WorkspaceStats stats;
+    stats.files = state.files;
+    stats.bytes = state.bytes;
+    stats.skipped = state.skipped;
+    stats.matches = qMin(state.matches.load(), MaxMatches);
+    stats.elapsedMs = state.timer.elapsed();
+    stats.threads = state.threads;
+    stats.limited = state.matches >= MaxMatches;
+    return stats;
+}
+
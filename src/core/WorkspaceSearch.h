@@ -0,0 +1,210 @@
+/**
+ * @file WorkspaceSearch.h
+ * @brief Find in Files for the Coda text editor.
+ *        Walks a directory tree and searches its files in parallel on a WorkStealingPool: every directory
+ *        is a task that pushes a task per subdirectory and per file, so the walk itself runs on all cores.
+ *        Files named by .gitignore or .ignore files are skipped, large files are mapped instead of read,
+ *        and files with a NUL byte near their start are treated as binary and skipped.
+ * @author Dario Romandini
+ */
+
+#pragma once
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QString>
+#include <QVector>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "FindEngine.h"
+
+class WorkStealingPool;
+struct IgnoreRules;
+
+/**
+ * @struct FileHit
+ * @brief A match in a file.
+ */
+struct FileHit {
+    int line = 0;    ///< 1-based line.
+    int column = 0;  ///< 1-based column, in UTF-16 units like the editor's.
+    int length = 0;  ///< Length in UTF-16 units.
+    QString preview; ///< The matching line, shortened around the match if it is long.
+};
+
+/**
+ * @struct FileResult
+ * @brief The matches in one file.
+ */
+struct FileResult {
+    QString path;          ///< Absolute path of the file.
+    QVector<FileHit> hits; ///< Matches in file order.
+};
+
+/**
+ * @struct WorkspaceStats
+ * @brief Progress and throughput of a search.
+ */
+struct WorkspaceStats {
+    qint64 files = 0;      ///< Files searched.
+    qint64 bytes = 0;      ///< Bytes searched.
+    qint64 skipped = 0;    ///< Binary files skipped.
+    qint64 matches = 0;    ///< Matches found.
+    qint64 elapsedMs = 0;  ///< Time since the search started.
+    unsigned threads = 0;  ///< Workers searching.
+    bool limited = false;  ///< True if the search stopped at the match limit.
+
+    /**
+     * @brief Returns the number of files searched per second.
+     * @return Files per second.
+     */
+    double filesPerSecond() const;
+
+    /**
+     * @brief Returns the number of megabytes searched per second.
+     * @return MB per second.
+     */
+    double megabytesPerSecond() const;
+};
+
+/**
+ * @class WorkspaceSearch
+ * @brief Runs one search at a time. All signals are emitted on the thread the search object lives in.
+ *        Starting a new search or calling cancel() stops the previous one; results it had already
+ *        queued are dropped.
+ */
+class WorkspaceSearch : public QObject {
+    Q_OBJECT
+
+public:
+    static constexpr qint64 MaxMatches = 100000; ///< The search stops after this many matches.
+    static constexpr int MaxHitsPerFile = 1000;  ///< Matches reported per file.
+
+    /**
+     * @brief Constructor for WorkspaceSearch.
+     * @param parent Optional parent object.
+     */
+    explicit WorkspaceSearch(QObject *parent = nullptr);
+
+    /**
+     * @brief Destructor. Cancels a running search and waits for its threads.
+     */
+    ~WorkspaceSearch() override;
+
+    /**
+     * @brief Starts searching a directory tree, cancelling any search in progress.
+     * @param root Directory to search.
+     * @param options What to search for.
+     * @param error Receives the reason if the pattern is invalid or the directory does not exist.
+     * @return False if no search was started.
+     */
+    bool search(const QString &root, const FindOptions &options, QString *error = nullptr);
+
+    /**
+     * @brief Cancels the current search.
+     */
+    void cancel();
+
+    /**
+     * @brief Returns whether a search is in progress.
+     * @return True between search() and finished().
+     */
+    bool isSearching() const;
+
+signals:
+    /**
+     * @brief Emitted with the files that matched since the previous batch.
+     * @param results One entry per file, in no particular order.
+     */
+    void resultsFound(const QVector<FileResult> &results);
+
+    /**
+     * @brief Emitted regularly while the search runs.
+     * @param stats Counters so far.
+     */
+    void progress(const WorkspaceStats &stats);
+
+    /**
+     * @brief Emitted when every file has been searched or the match limit is reached.
+     * @param stats Final counters.
+     */
+    void finished(const WorkspaceStats &stats);
+
+private:
+    static constexpr qint64 MapThreshold = 256 * 1024; ///< Files at least this large are mapped, not read.
+    static constexpr qint64 SniffSize = 8000;          ///< Bytes checked for a NUL to detect binary files.
+    static constexpr int PreviewBytes = 160;           ///< Longest preview of a matching line.
+    static constexpr int BatchIntervalMs = 50;         ///< Shortest time between two batches.
+
+    /**
+     * @struct SearchState
+     * @brief State shared between the UI thread and the threads of one search.
+     */
+    struct SearchState {
+        QString root;                              ///< Directory being searched.
+        FindOptions options;                       ///< What to search for.
+        QByteArray needle;                         ///< UTF-8 pattern of a literal search, empty for a regex one.
+        std::vector<QRegularExpression> patterns;  ///< Compiled pattern of each worker for a regex search.
+        unsigned threads = 0;                      ///< Workers searching.
+        std::atomic_bool cancelled{false};         ///< Set by the UI thread, or at the match limit.
+        std::atomic<qint64> files{0};              ///< Files searched.
+        std::atomic<qint64> bytes{0};              ///< Bytes searched.
+        std::atomic<qint64> skipped{0};            ///< Binary files skipped.
+        std::atomic<qint64> matches{0};            ///< Matches found.
+        std::mutex resultsMutex;                   ///< Guards results and lastPostMs.
+        QVector<FileResult> results;               ///< Results not yet posted.
+        qint64 lastPostMs = 0;                     ///< When the last batch was posted.
+        QElapsedTimer timer;                       ///< Started with the search.
+    };
+
+    /**
+     * @brief Coordinator thread body: runs the pool until every file is searched.
+     * @param state State of the search.
+     */
+    void run(std::shared_ptr<SearchState> state);
+
+    /**
+     * @brief Lists a directory and pushes a task for every entry that is not ignored.
+     * @param state State of the search.
+     * @param pool The pool to push to.
+     * @param directory Absolute path of the directory.
+     * @param rules Ignore rules of the parent directories.
+     */
+    void searchDirectory(const std::shared_ptr<SearchState> &state, WorkStealingPool &pool,
+                         const QString &directory, std::shared_ptr<const IgnoreRules> rules);
+
+    /**
+     * @brief Searches one file.
+     * @param state State of the search.
+     * @param path Absolute path of the file.
+     * @param size Size of the file.
+     */
+    void searchFile(const std::shared_ptr<SearchState> &state, const QString &path, qint64 size);
+
+    /**
+     * @brief Records the hits of a file and posts the pending results if the last batch is old enough.
+     * @param state State of the search.
+     * @param result Hits of a file; may be empty to only report progress.
+     * @param force True to post even if the last batch is recent.
+     */
+    void report(const std::shared_ptr<SearchState> &state, FileResult result, bool force);
+
+    /**
+     * @brief Returns the counters of a search.
+     * @param state State of the search.
+     * @return The counters.
+     */
+    static WorkspaceStats statsOf(const SearchState &state);
+
+    /**
+     * @brief Stops the coordinator thread and waits for it.
+     */
+    void stopWorker();
+
+    std::thread worker;                   ///< Coordinator of the current search.
+    std::shared_ptr<SearchState> current; ///< State of the current search, null when idle.
+};
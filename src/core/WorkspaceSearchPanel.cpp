@@ -0,0 +1,186 @@
+/**
+ * @file WorkspaceSearchPanel.cpp
+ * @brief Implementation of the WorkspaceSearchPanel class for Coda.
+ * @author Dario Romandini
+ */
+
+#include "WorkspaceSearchPanel.h"
+#include <QDir>
+#include <QFileDialog>
+#include <QGridLayout>
+#include <QHeaderView>
+#include <QLabel>
+#include <QLineEdit>
+#include <QPushButton>
+#include <QToolButton>
+#include <QTreeWidget>
+
+namespace {
+
+/**
+ * @brief Item data roles of a hit item.
+ */
+enum HitRole {
+    PathRole = Qt::UserRole, ///< Absolute path of the file.
+    LineRole,                ///< 1-based line.
+    ColumnRole,              ///< 1-based column.
+    LengthRole               ///< Length of the match.
+};
+
+} // namespace
+
+WorkspaceSearchPanel::WorkspaceSearchPanel(QWidget *parent) : QWidget(parent) {
+    folderField = new QLineEdit(this);
+    folderField->setPlaceholderText("Folder");
+    auto *browseButton = new QToolButton(this);
+    browseButton->setText("...");
+    browseButton->setToolTip("Choose the folder to search");
+    patternField = new QLineEdit(this);
+    patternField->setPlaceholderText("Find in files");
+
+    auto toggle = [this](const QString &text, const QString &toolTip) {
+        auto *button = new QToolButton(this);
+        button->setText(text);
+        button->setToolTip(toolTip);
+        button->setCheckable(true);
+        return button;
+    };
+    caseButton = toggle("Aa", "Match case");
+    wordButton = toggle("W", "Match whole words");
+    regexButton = toggle(".*", "Regular expression");
+
+    searchButton = new QPushButton("Search", this);
+    statusLabel = new QLabel(this);
+    statusLabel->setWordWrap(true);
+
+    results = new QTreeWidget(this);
+    results->setHeaderHidden(true);
+    results->setUniformRowHeights(true);
+    results->header()->setStretchLastSection(true);
+
+    auto *layout = new QGridLayout(this);
+    layout->setContentsMargins(4, 4, 4, 4);
+    layout->addWidget(folderField, 0, 0, 1, 4);
+    layout->addWidget(browseButton, 0, 4);
+    layout->addWidget(patternField, 1, 0);
+    layout->addWidget(caseButton, 1, 1);
+    layout->addWidget(wordButton, 1, 2);
+    layout->addWidget(regexButton, 1, 3);
+    layout->addWidget(searchButton, 1, 4);
+    layout->addWidget(statusLabel, 2, 0, 1, 5);
+    layout->addWidget(results, 3, 0, 1, 5);
+
+    connect(browseButton, &QToolButton::clicked, this, [this] {
+        QString folder = QFileDialog::getExistingDirectory(this, "Find in Folder", folderField->text());
+        if (!folder.isEmpty()) {
+            folderField->setText(QDir::toNativeSeparators(folder));
+        }
+    });
+    connect(patternField, &QLineEdit::returnPressed, this, [this] {
+        search.cancel();
+        toggleSearch();
+    });
+    connect(searchButton, &QPushButton::clicked, this, &WorkspaceSearchPanel::toggleSearch);
+    connect(results, &QTreeWidget::itemActivated, this, &WorkspaceSearchPanel::onItemActivated);
+
+    connect(&search, &WorkspaceSearch::resultsFound, this, &WorkspaceSearchPanel::onResultsFound);
+    connect(&search, &WorkspaceSearch::progress, this, &WorkspaceSearchPanel::onProgress);
+    connect(&search, &WorkspaceSearch::finished, this, &WorkspaceSearchPanel::onFinished);
+}
+
+void WorkspaceSearchPanel::open(const QString &folder) {
+    if (folderField->text().isEmpty() && !folder.isEmpty()) {
+        folderField->setText(QDir::toNativeSeparators(folder));
+    }
+    patternField->setFocus();
+    patternField->selectAll();
+}
+
+void WorkspaceSearchPanel::toggleSearch() {
+    if (search.isSearching()) {
+        search.cancel();
+        searchButton->setText("Search");
+        statusLabel->setText(statusLabel->text() + " (stopped)");
+        return;
+    }
+
+    results->clear();
+    files.clear();
+    FindOptions options;
+    options.pattern = patternField->text();
+    options.regex = regexButton->isChecked();
+    options.caseSensitive = caseButton->isChecked();
+    options.wholeWords = wordButton->isChecked();
+    QString error;
+    if (!search.search(QDir::fromNativeSeparators(folderField->text()), options, &error)) {
+        statusLabel->setText(error);
+        return;
+    }
+    searchButton->setText("Stop");
+    statusLabel->setText("Searching...");
+}
+
+void WorkspaceSearchPanel::onResultsFound(const QVector<FileResult> &found) {
+    // Files arrive in the order the workers finish them; keep the tree sorted by path instead.
+    results->setSortingEnabled(false);
+    QString root = QDir::fromNativeSeparators(folderField->text());
+    for (const FileResult &result : found) {
+        QTreeWidgetItem *&file = files[result.path];
+        if (!file) {
+            file = new QTreeWidgetItem(results);
+            file->setToolTip(0, QDir::toNativeSeparators(result.path));
+        }
+        for (const FileHit &hit : result.hits) {
+            auto *item = new QTreeWidgetItem(file);
+            item->setText(0, QString("%1:%2  %3").arg(hit.line).arg(hit.column).arg(hit.preview));
+            item->setData(0, PathRole, result.path);
+            item->setData(0, LineRole, hit.line);
+            item->setData(0, ColumnRole, hit.column);
+            item->setData(0, LengthRole, hit.length);
+        }
+        QString name = QDir(root).relativeFilePath(result.path);
+        file->setText(0, QString("%1 (%2)").arg(QDir::toNativeSeparators(name)).arg(file->childCount()));
+    }
+    results->setSortingEnabled(true);
+    results->sortItems(0, Qt::AscendingOrder);
+}
+
+void WorkspaceSearchPanel::onProgress(const WorkspaceStats &stats) {
+    showStats(stats, false);
+}
+
+void WorkspaceSearchPanel::onFinished(const WorkspaceStats &stats) {
+    searchButton->setText("Search");
+    showStats(stats, true);
+}
+
+void WorkspaceSearchPanel::onItemActivated(QTreeWidgetItem *item) {
+    if (!item->parent()) {
+        item->setExpanded(!item->isExpanded());
+        return;
+    }
+    emit hitActivated(item->data(0, PathRole).toString(), item->data(0, LineRole).toInt(),
+                      item->data(0, ColumnRole).toInt(), item->data(0, LengthRole).toInt());
+}
+
+void WorkspaceSearchPanel::showStats(const WorkspaceStats &stats, bool done) {
+    QString text = QString("%1 matches in %2 files; %3 files, %4 MB searched")
+                       .arg(stats.matches)
+                       .arg(files.size())
+                       .arg(stats.files)
+                       .arg(stats.bytes / 1048576.0, 0, 'f', 1);
+    if (stats.skipped > 0) {
+        text += QString(", %1 binary skipped").arg(stats.skipped);
+    }
+    text += QString("\n%1 files/s, %2 MB/s on %3 threads")
+                .arg(stats.filesPerSecond(), 0, 'f', 0)
+                .arg(stats.megabytesPerSecond(), 0, 'f', 1)
+                .arg(stats.threads);
+    if (done) {
+        text += QString(" in %1 ms").arg(stats.elapsedMs);
+    }
+    if (stats.limited) {
+        text += QString("\nStopped at %1 matches").arg(WorkspaceSearch::MaxMatches);
+    }
+    statusLabel->setText(text);
+}
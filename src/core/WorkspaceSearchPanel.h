@@ -0,0 +1,101 @@
+/**
+ * @file WorkspaceSearchPanel.h
+ * @brief Find in Files panel for the Coda text editor.
+ *        Runs a WorkspaceSearch over a folder and lists the matching files with their hits as the results
+ *        stream in, along with the search throughput.
+ * @author Dario Romandini
+ */
+
+#pragma once
+
+#include <QHash>
+#include <QWidget>
+
+#include "WorkspaceSearch.h"
+
+class QLabel;
+class QLineEdit;
+class QPushButton;
+class QToolButton;
+class QTreeWidget;
+class QTreeWidgetItem;
+
+/**
+ * @class WorkspaceSearchPanel
+ * @brief Search fields and a tree of results, one top-level item per file.
+ */
+class WorkspaceSearchPanel : public QWidget {
+    Q_OBJECT
+
+public:
+    /**
+     * @brief Constructor for WorkspaceSearchPanel.
+     * @param parent Optional parent widget.
+     */
+    explicit WorkspaceSearchPanel(QWidget *parent = nullptr);
+
+    /**
+     * @brief Focuses the pattern field, filling in the folder if it is still empty.
+     * @param folder Folder to search by default.
+     */
+    void open(const QString &folder);
+
+signals:
+    /**
+     * @brief Emitted when a hit is activated in the results.
+     * @param path Absolute path of the file.
+     * @param line 1-based line of the hit.
+     * @param column 1-based column of the hit, in UTF-16 units.
+     * @param length Length of the hit, in UTF-16 units.
+     */
+    void hitActivated(const QString &path, int line, int column, int length);
+
+private slots:
+    /**
+     * @brief Starts a search, or stops the running one.
+     */
+    void toggleSearch();
+
+    /**
+     * @brief Adds a batch of results to the tree.
+     * @param results One entry per file.
+     */
+    void onResultsFound(const QVector<FileResult> &results);
+
+    /**
+     * @brief Shows the counters of the running search.
+     * @param stats Counters so far.
+     */
+    void onProgress(const WorkspaceStats &stats);
+
+    /**
+     * @brief Shows the final counters.
+     * @param stats Final counters.
+     */
+    void onFinished(const WorkspaceStats &stats);
+
+    /**
+     * @brief Emits hitActivated() for a hit item.
+     * @param item The activated item.
+     */
+    void onItemActivated(QTreeWidgetItem *item);
+
+private:
+    /**
+     * @brief Shows search counters in the status label.
+     * @param stats The counters.
+     * @param done True if the search is over.
+     */
+    void showStats(const WorkspaceStats &stats, bool done);
+
+    WorkspaceSearch search;                  ///< Runs the searches.
+    QLineEdit *folderField;                  ///< Folder to search.
+    QLineEdit *patternField;                 ///< Pattern.
+    QToolButton *caseButton;                 ///< Match case.
+    QToolButton *wordButton;                 ///< Match whole words.
+    QToolButton *regexButton;                ///< Pattern is a regular expression.
+    QPushButton *searchButton;               ///< Starts or stops the search.
+    QLabel *statusLabel;                     ///< Counters, throughput or error.
+    QTreeWidget *results;                    ///< Files and their hits.
+    QHash<QString, QTreeWidgetItem *> files; ///< Top-level item of each file with hits.
+};
@@ -0,0 +1,266 @@
+/**
+ * @file HighlightScheduler.cpp
+ * @brief Implementation of the HighlightScheduler class for Coda.
+ * @author Dario Romandini
+ */
+
+#include "HighlightScheduler.h"
+#include "EditorWidget.h"
+#include "KSyntaxHighlightingAdapter.h"
+#include <QElapsedTimer>
+
+HighlightScheduler::HighlightScheduler(KSyntaxHighlightingAdapter *highlighter, EditorWidget *editor)
+    : QObject(highlighter), highlighter(highlighter), editor(editor), worker(new HighlightWorker(this)) {
+    idleTimer.setSingleShot(true);
+    idleTimer.setInterval(0);
+    connect(&idleTimer, &QTimer::timeout, this, &HighlightScheduler::highlightIdleBatch);
+
+    viewportTimer.setSingleShot(true);
+    viewportTimer.setInterval(0);
+    connect(&viewportTimer, &QTimer::timeout, this, &HighlightScheduler::highlightViewport);
+
+    // Scrolls and full repaints (resize, new text) can reveal blocks; cursor blinks cannot.
+    connect(editor, &QPlainTextEdit::updateRequest, this, [this](const QRect &rect, int dy) {
+        if (dy != 0 || rect.contains(this->editor->viewport()->rect())) {
+            viewportTimer.start();
+        }
+    });
+    connect(editor->document(), &QTextDocument::contentsChange, this, &HighlightScheduler::onContentsChange);
+    connect(editor, &EditorWidget::bufferReset, this, &HighlightScheduler::restart);
+    connect(worker, &HighlightWorker::batchReady, this, &HighlightScheduler::onBatchReady);
+    connect(worker, &HighlightWorker::regionsReady, this, &HighlightScheduler::onRegionsReady);
+
+    lastBlockCount = editor->document()->blockCount();
+    highlighter->setScheduler(this);
+}
+
+void HighlightScheduler::restart() {
+    ++revision;
+    restartRevision = revision;
+    edits.clear();
+    highlightedBlocks = 0;
+    tokenizedLines = 0;
+    busyNanoseconds = 0;
+    lastFrameMs = 0;
+    maxFrameMs = 0;
+    lastBlockCount = editor->document()->blockCount();
+
+    worker->restart(highlighter->definition().name(), editor->snapshot(), revision);
+}
+
+void HighlightScheduler::themeChanged() {
+    ++currentTheme;
+    pendingFirst = 0;
+    pendingLast = editor->document()->blockCount() - 1;
+    highlightViewport();
+    idleTimer.start();
+}
+
+quint32 HighlightScheduler::themeGeneration() const {
+    return currentTheme;
+}
+
+void HighlightScheduler::blockHighlighted() {
+    ++highlightedBlocks;
+}
+
+HighlightMetrics HighlightScheduler::metrics() const {
+    HighlightMetrics result;
+    result.blocksHighlighted = highlightedBlocks;
+    result.linesTokenized = tokenizedLines;
+    result.blocksPerSecond = busyNanoseconds > 0 ? highlightedBlocks * 1e9 / busyNanoseconds : 0;
+    result.lastFrameMs = lastFrameMs;
+    result.maxFrameMs = maxFrameMs;
+    result.pendingBlocks = qMax(0, pendingLast - pendingFirst + 1);
+    result.blockCount = editor->document()->blockCount();
+    return result;
+}
+
+void HighlightScheduler::updateVisibleRange() {
+    QRect area = editor->viewport()->rect();
+    visibleFirst = editor->cursorForPosition(area.topLeft()).blockNumber();
+    visibleLast = editor->cursorForPosition(area.bottomLeft()).blockNumber() + ViewportMargin;
+}
+
+void HighlightScheduler::applyBlock(const QTextBlock &block) {
+    auto *data = dynamic_cast<HighlightBlockData *>(block.userData());
+    if (data && data->appliedTheme != currentTheme) {
+        highlighter->rehighlightBlock(block);
+    }
+}
+
+void HighlightScheduler::highlightViewport() {
+    QElapsedTimer timer;
+    timer.start();
+
+    updateVisibleRange();
+    QTextBlock block = editor->document()->findBlockByNumber(visibleFirst);
+    while (block.isValid() && block.blockNumber() <= visibleLast) {
+        applyBlock(block);
+        block = block.next();
+    }
+
+    recordFrame(timer.nsecsElapsed());
+}
+
+void HighlightScheduler::highlightIdleBatch() {
+    QElapsedTimer timer;
+    timer.start();
+
+    QTextBlock block = editor->document()->findBlockByNumber(pendingFirst);
+    while (block.isValid() && pendingFirst <= pendingLast && timer.elapsed() < SliceBudgetMs) {
+        applyBlock(block);
+        ++pendingFirst;
+        block = block.next();
+    }
+    if (!block.isValid()) {
+        pendingLast = pendingFirst - 1;
+    }
+
+    recordFrame(timer.nsecsElapsed());
+    if (pendingFirst <= pendingLast) {
+        idleTimer.start();
+    }
+}
+
+void HighlightScheduler::onContentsChange(int position, int, int charsAdded) {
+    // Progressive loads fill the text buffer at once when they end, which restarts the scheduler.
+    if (editor->isLoading()) {
+        return;
+    }
+
+    QTextDocument *document = editor->document();
+    int blockCount = document->blockCount();
+    int end = qMin(position + charsAdded, document->characterCount() - 1);
+
+    LineEdit edit;
+    edit.first = document->findBlock(position).blockNumber();
+    edit.delta = blockCount - lastBlockCount;
+    edit.oldLast = document->findBlock(end).blockNumber() - edit.delta;
+    lastBlockCount = blockCount;
+
+    if (pendingFirst <= pendingLast) {
+        int first = mapLine(pendingFirst, edit);
+        int last = mapLine(pendingLast, edit);
+        pendingFirst = first < 0 ? edit.first : first;
+        pendingLast = last < 0 ? edit.oldLast + edit.delta : last;
+    }
+
+    ++revision;
+    edits.append(RevisionEdit{revision, edit});
+    worker->edit(editor->snapshot(), revision, edit);
+}
+
+void HighlightScheduler::onBatchReady(const HighlightBatch &batch) {
+    worker->batchConsumed();
+    if (batch.revision < restartRevision) {
+        return;
+    }
+
+    // Batches arrive in revision order: edits up to this one are already part of its text.
+    int consumed = 0;
+    while (consumed < edits.size() && edits[consumed].revision <= batch.revision) {
+        ++consumed;
+    }
+    edits.remove(0, consumed);
+
+    QElapsedTimer timer;
+    timer.start();
+    updateVisibleRange();
+
+    QTextDocument *document = editor->document();
+    QTextBlock block;
+    int previous = -2;
+    for (int i = 0; i < batch.lines.size(); ++i) {
+        int line = batch.firstLine + i;
+        for (const RevisionEdit &later : edits) {
+            line = mapLine(line, later.edit);
+            if (line < 0) {
+                break;
+            }
+        }
+        if (line < 0 || line >= document->blockCount()) {
+            continue;
+        }
+
+        block = line == previous + 1 ? block.next() : document->findBlockByNumber(line);
+        previous = line;
+
+        auto *data = dynamic_cast<HighlightBlockData *>(block.userData());
+        if (!data) {
+            data = new HighlightBlockData;
+            block.setUserData(data);
+        }
+        data->runs = batch.lines[i];
+        data->styles = batch.styles;
+        data->appliedTheme = 0;
+
+        if (line >= visibleFirst && line <= visibleLast) {
+            highlighter->rehighlightBlock(block);
+        } else if (pendingFirst <= pendingLast) {
+            pendingFirst = qMin(pendingFirst, line);
+            pendingLast = qMax(pendingLast, line);
+        } else {
+            pendingFirst = line;
+            pendingLast = line;
+        }
+    }
+    tokenizedLines += batch.lines.size();
+
+    recordFrame(timer.nsecsElapsed());
+    if (pendingFirst <= pendingLast && !idleTimer.isActive()) {
+        idleTimer.start();
+    }
+}
+
+void HighlightScheduler::onRegionsReady(const FoldUpdate &update) {
+    if (update.revision < restartRevision) {
+        return;
+    }
+    int consumed = 0;
+    while (consumed < edits.size() && edits[consumed].revision <= update.revision) {
+        ++consumed;
+    }
+    edits.remove(0, consumed);
+
+    // A region whose first or last line changed since is dropped, and a bound on a changed line widens over
+    // the changed lines; the worker sends the regions there again after its next pass.
+    int first = update.first;
+    int last = update.last;
+    for (const RevisionEdit &later : edits) {
+        const LineEdit &edit = later.edit;
+        first = first < edit.first ? first : first > edit.oldLast ? first + edit.delta : edit.first;
+        last = last < edit.first ? last : last > edit.oldLast ? last + edit.delta : edit.oldLast + edit.delta;
+    }
+    std::vector<FoldRegion> mapped;
+    mapped.reserve(update.regions.size());
+    for (FoldRegion region : update.regions) {
+        for (const RevisionEdit &later : edits) {
+            region.start = mapLine(region.start, later.edit);
+            region.end = mapLine(region.end, later.edit);
+            if (region.start < 0 || region.end < 0) {
+                break;
+            }
+        }
+        if (region.start >= 0 && region.end >= 0) {
+            mapped.push_back(region);
+        }
+    }
+    editor->updateFoldRegions(first, last, mapped);
+}
+
+void HighlightScheduler::recordFrame(qint64 nanoseconds) {
+    busyNanoseconds += nanoseconds;
+    lastFrameMs = nanoseconds / 1e6;
+    maxFrameMs = qMax(maxFrameMs, lastFrameMs);
+}
+
+int HighlightScheduler::mapLine(int line, const LineEdit &edit) {
+    if (line < edit.first) {
+        return line;
+    }
+    if (line > edit.oldLast) {
+        return line + edit.delta;
+    }
+    return -1;
+}
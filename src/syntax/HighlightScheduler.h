@@ -0,0 +1,184 @@
+/**
+ * @file HighlightScheduler.h
+ * @brief Viewport-first syntax highlighting scheduler for Coda.
+ *        Tokenization runs on a HighlightWorker thread; the scheduler stores the style runs it
+ *        returns on the blocks and applies them to the visible blocks immediately and to the rest of
+ *        the document in small idle batches, so the UI thread never runs the syntax rules.
+ *        A theme change re-applies the stored runs the same way, without tokenizing again.
+ *        Fold regions matched by the worker are handed to the editor the same way.
+ * @author Dario Romandini
+ */
+
+#pragma once
+
+#include <QObject>
+#include <QTextBlock>
+#include <QTimer>
+#include <QVector>
+#include <memory>
+
+#include "HighlightWorker.h"
+
+class EditorWidget;
+class KSyntaxHighlightingAdapter;
+
+/**
+ * @struct HighlightBlockData
+ * @brief Style runs of a block, as last tokenized by the worker.
+ *        Kept on the block, so any highlighter attached to the document later can draw it.
+ */
+struct HighlightBlockData : public QTextBlockUserData {
+    QVector<StyleRun> runs;             ///< Style runs of the block.
+    std::shared_ptr<StyleTable> styles; ///< Table the style ids refer to.
+    quint32 appliedTheme = 0;           ///< Theme generation the runs were last applied with, 0 if never.
+};
+
+/**
+ * @struct HighlightMetrics
+ * @brief Throughput and latency figures of a HighlightScheduler.
+ */
+struct HighlightMetrics {
+    qint64 blocksHighlighted = 0; ///< Blocks whose runs were applied since the last restart.
+    qint64 linesTokenized = 0;    ///< Lines received from the worker since the last restart.
+    double blocksPerSecond = 0;   ///< Throughput of the UI thread while it was applying runs.
+    double lastFrameMs = 0;       ///< Time spent in the most recent viewport pass, batch or idle slice.
+    double maxFrameMs = 0;        ///< Longest viewport pass, batch or idle slice since the last restart.
+    int pendingBlocks = 0;        ///< Blocks that may still have runs waiting to be applied.
+    int blockCount = 0;           ///< Blocks in the document.
+};
+
+/**
+ * @class HighlightScheduler
+ * @brief Connects a KSyntaxHighlightingAdapter to a HighlightWorker.
+ *        Every document edit is forwarded to the worker with a snapshot of the text. Batches come back
+ *        tagged with the revision they were tokenized from; line numbers are moved past the edits made
+ *        since, and lines changed in the meantime are skipped, since a later batch covers them.
+ */
+class HighlightScheduler : public QObject {
+    Q_OBJECT
+
+public:
+    /**
+     * @brief Constructor. Registers the scheduler with the highlighter, which takes ownership of it.
+     * @param highlighter The highlighter to drive.
+     * @param editor The editor whose viewport is highlighted first and whose text is tokenized.
+     */
+    HighlightScheduler(KSyntaxHighlightingAdapter *highlighter, EditorWidget *editor);
+
+    /**
+     * @brief Tokenizes the whole document again, e.g. after the definition or the whole text changed.
+     */
+    void restart();
+
+    /**
+     * @brief Re-applies the stored runs with the highlighter's new theme: the viewport now, the rest when idle.
+     */
+    void themeChanged();
+
+    /**
+     * @brief Returns the current theme generation, bumped by every theme change.
+     * @return The generation blocks record when their runs are applied.
+     */
+    quint32 themeGeneration() const;
+
+    /**
+     * @brief Counts a highlighted block for the metrics.
+     */
+    void blockHighlighted();
+
+    /**
+     * @brief Returns the current metrics.
+     * @return Throughput and per-frame timing.
+     */
+    HighlightMetrics metrics() const;
+
+private slots:
+    /**
+     * @brief Applies the runs of the visible blocks that have not been applied with the current theme.
+     */
+    void highlightViewport();
+
+    /**
+     * @brief Applies waiting runs for one time slice.
+     */
+    void highlightIdleBatch();
+
+    /**
+     * @brief Forwards an edit to the worker and moves the waiting range along with the text.
+     * @param position Position of the change.
+     * @param charsRemoved Number of characters removed.
+     * @param charsAdded Number of characters added.
+     */
+    void onContentsChange(int position, int charsRemoved, int charsAdded);
+
+    /**
+     * @brief Stores a batch of style runs on its blocks.
+     * @param batch The tokenized lines.
+     */
+    void onBatchReady(const HighlightBatch &batch);
+
+    /**
+     * @brief Moves a range of fold regions past the edits made since they were matched and gives it to the
+     *        editor.
+     * @param update The changed range of regions.
+     */
+    void onRegionsReady(const FoldUpdate &update);
+
+private:
+    static constexpr int SliceBudgetMs = 8;    ///< Time one idle batch may take (half a 60 Hz frame).
+    static constexpr int ViewportMargin = 10;  ///< Blocks below the viewport highlighted along with it.
+
+    /**
+     * @struct RevisionEdit
+     * @brief An edit and the revision it produced.
+     */
+    struct RevisionEdit {
+        quint64 revision; ///< Revision of the text after the edit.
+        LineEdit edit;    ///< Lines touched by the edit.
+    };
+
+    /**
+     * @brief Recomputes the block range shown in the viewport.
+     */
+    void updateVisibleRange();
+
+    /**
+     * @brief Applies a block's stored runs unless they are applied with the current theme already.
+     * @param block The block.
+     */
+    void applyBlock(const QTextBlock &block);
+
+    /**
+     * @brief Records the duration of a viewport pass, batch or idle slice.
+     * @param nanoseconds Time spent.
+     */
+    void recordFrame(qint64 nanoseconds);
+
+    /**
+     * @brief Moves a line number past an edit.
+     * @param line Line number before the edit.
+     * @param edit The edit.
+     * @return Line number after the edit, or -1 if the edit changed the line.
+     */
+    static int mapLine(int line, const LineEdit &edit);
+
+    KSyntaxHighlightingAdapter *highlighter; ///< The highlighter being driven.
+    EditorWidget *editor;                    ///< The editor showing the document.
+    HighlightWorker *worker;                 ///< Tokenizes snapshots on a background thread.
+    QTimer idleTimer;                        ///< Fires the next idle batch.
+    QTimer viewportTimer;                    ///< Coalesces viewport passes while scrolling.
+    quint64 revision = 0;                    ///< Revision of the current text; bumped by every edit.
+    quint64 restartRevision = 0;             ///< Batches older than this belong to a previous restart.
+    quint32 currentTheme = 1;                ///< Theme generation; bumped by themeChanged().
+    QVector<RevisionEdit> edits;             ///< Edits newer than the last batch received.
+    int pendingFirst = 0;                    ///< First block that may have runs waiting.
+    int pendingLast = -1;                    ///< Last block that may have runs waiting.
+    int visibleFirst = 0;                    ///< First block in the viewport.
+    int visibleLast = -1;                    ///< Last block in the viewport, plus the margin.
+    int lastBlockCount = 0;                  ///< Block count before the latest edit.
+    qint64 highlightedBlocks = 0;            ///< Blocks highlighted since restart().
+    qint64 tokenizedLines = 0;               ///< Lines received from the worker since restart().
+    qint64 busyNanoseconds = 0;              ///< Time spent in passes and batches since restart().
+    double lastFrameMs = 0;                  ///< Duration of the latest pass or batch.
+    double maxFrameMs = 0;                   ///< Longest pass or batch since restart().
+};
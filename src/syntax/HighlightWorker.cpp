@@ -0,0 +1,502 @@
+/**
+ * @file HighlightWorker.cpp
+ * @brief Implementation of the HighlightWorker class for Coda.
+ * @author Dario Romandini
+ */
+
+#include "HighlightWorker.h"
+#include "LineIndex.h"
+#include "LongLineLayout.h"
+#include <KSyntaxHighlighting/AbstractHighlighter>
+#include <KSyntaxHighlighting/Definition>
+#include <KSyntaxHighlighting/FoldingRegion>
+#include <KSyntaxHighlighting/Format>
+#include <KSyntaxHighlighting/Repository>
+#include <QMetaObject>
+#include <algorithm>
+#include <climits>
+
+namespace {
+
+/// Bytes of a line read at most. A UTF-16 unit takes at most three bytes, so a line with more bytes is
+/// longer than LongLineLayout::Threshold whatever it holds, and is not tokenized.
+constexpr qint64 MaxLineBytes = 3 * LongLineLayout::Threshold;
+
+} // namespace
+
+/**
+ * @class LineTokenizer
+ * @brief Highlighter that collects the formats of one line as style runs, and its folding markers.
+ */
+class LineTokenizer : public KSyntaxHighlighting::AbstractHighlighter {
+public:
+    /**
+     * @brief Constructor.
+     * @param styles Table the formats are registered in.
+     */
+    explicit LineTokenizer(StyleTable *styles) : styles(styles) {}
+
+    /**
+     * @brief Tokenizes one line.
+     * @param text The line, without its line break.
+     * @param state State at the start of the line.
+     * @param runs Receives the style runs of the line.
+     * @param folds Receives the folding markers of the line that are not closed on the line itself.
+     * @return State at the start of the next line.
+     */
+    KSyntaxHighlighting::State highlight(const QString &text, const KSyntaxHighlighting::State &state,
+                                         QVector<StyleRun> &runs, QVector<FoldMarker> &folds) {
+        current = &runs;
+        currentFolds = &folds;
+        covered = 0;
+        KSyntaxHighlighting::State next = highlightLine(text, state);
+        current = nullptr;
+        currentFolds = nullptr;
+        return next;
+    }
+
+protected:
+    void applyFormat(int offset, int length, const KSyntaxHighlighting::Format &format) override {
+        if (offset < covered) {
+            length -= covered - offset;
+            offset = covered;
+        }
+        if (length <= 0) {
+            return;
+        }
+        if (offset > covered) {
+            appendRun(StyleTable::NoStyle, offset - covered);
+        }
+        appendRun(format.isValid() ? styles->add(format) : StyleTable::NoStyle, length);
+        covered = offset + length;
+    }
+
+    void applyFolding(int offset, int length, KSyntaxHighlighting::FoldingRegion region) override {
+        Q_UNUSED(offset);
+        Q_UNUSED(length);
+        if (region.type() == KSyntaxHighlighting::FoldingRegion::Begin) {
+            currentFolds->append(FoldMarker{region.id(), true});
+        } else if (region.type() == KSyntaxHighlighting::FoldingRegion::End) {
+            // A region opened and closed on the same line cannot be folded.
+            if (!currentFolds->isEmpty() && currentFolds->last() == FoldMarker{region.id(), true}) {
+                currentFolds->removeLast();
+            } else {
+                currentFolds->append(FoldMarker{region.id(), false});
+            }
+        }
+    }
+
+private:
+    /**
+     * @brief Appends a run, merging it with the previous one and splitting it at the run length limit.
+     * @param style Style id of the run.
+     * @param length Length of the run.
+     */
+    void appendRun(quint16 style, int length) {
+        while (length > 0) {
+            if (!current->isEmpty() && current->last().style == style && current->last().length < 0xffff) {
+                int merged = qMin(length, 0xffff - current->last().length);
+                current->last().length += merged;
+                length -= merged;
+                continue;
+            }
+            int part = qMin(length, 0xffff);
+            current->append(StyleRun{style, static_cast<quint16>(part)});
+            length -= part;
+        }
+    }
+
+    StyleTable *styles;                   ///< Table the formats are registered in.
+    QVector<StyleRun> *current = nullptr;       ///< Runs of the line being tokenized.
+    QVector<FoldMarker> *currentFolds = nullptr; ///< Folding markers of the line being tokenized.
+    int covered = 0;                            ///< Length of the line covered by runs so far.
+};
+
+HighlightWorker::HighlightWorker(QObject *parent) : QObject(parent), styles(std::make_shared<StyleTable>()) {
+    worker = std::thread(&HighlightWorker::run, this);
+}
+
+HighlightWorker::~HighlightWorker() {
+    {
+        QMutexLocker locker(&mutex);
+        stopping = true;
+    }
+    wake.wakeAll();
+    worker.join();
+}
+
+void HighlightWorker::restart(const QString &definition, const PieceTable &text, quint64 revision) {
+    QMutexLocker locker(&mutex);
+    definitionName = definition;
+    pendingText = text;
+    pendingRevision = revision;
+    hasRequest = true;
+    resetRequested = true;
+    hasEdit = false;
+    abortPass = true;
+    wake.wakeOne();
+}
+
+void HighlightWorker::edit(const PieceTable &text, quint64 revision, const LineEdit &lineEdit) {
+    QMutexLocker locker(&mutex);
+    pendingEdit = hasEdit ? merge(pendingEdit, lineEdit) : lineEdit;
+    hasEdit = true;
+    pendingText = text;
+    pendingRevision = revision;
+    hasRequest = true;
+    abortPass = true;
+    wake.wakeOne();
+}
+
+void HighlightWorker::batchConsumed() {
+    credits.release();
+}
+
+LineEdit HighlightWorker::merge(const LineEdit &earlier, const LineEdit &later) {
+    // Express the end of the later edit in line numbers before the earlier one.
+    int earlierNewLast = earlier.oldLast + earlier.delta;
+    int laterOldLast = later.oldLast;
+    if (later.oldLast > earlierNewLast) {
+        laterOldLast = later.oldLast - earlier.delta;
+    } else if (later.oldLast >= earlier.first) {
+        laterOldLast = earlier.oldLast;
+    }
+
+    LineEdit merged;
+    merged.first = qMin(earlier.first, later.first);
+    merged.oldLast = qMax(earlier.oldLast, laterOldLast);
+    merged.delta = earlier.delta + later.delta;
+    return merged;
+}
+
+void HighlightWorker::run() {
+    repository = std::make_unique<KSyntaxHighlighting::Repository>();
+    tokenizer = std::make_unique<LineTokenizer>(styles.get());
+
+    while (true) {
+        PieceTable text;
+        quint64 revision;
+        bool reset;
+        bool edited;
+        LineEdit lineEdit;
+        QString definition;
+        {
+            QMutexLocker locker(&mutex);
+            while (!hasRequest && !stopping) {
+                wake.wait(&mutex);
+            }
+            if (stopping) {
+                break;
+            }
+            text = pendingText;
+            revision = pendingRevision;
+            reset = resetRequested;
+            edited = hasEdit;
+            lineEdit = pendingEdit;
+            definition = definitionName;
+            pendingText = PieceTable();
+            hasRequest = false;
+            resetRequested = false;
+            hasEdit = false;
+            abortPass = false;
+        }
+
+        if (reset) {
+            tokenizer->setDefinition(repository->definitionForName(definition));
+            checkpoints = {Checkpoint{0, KSyntaxHighlighting::State()}};
+            cleanUntil = 0;
+            convergeAfter = -1;
+            lineFolds.clear();
+            foldsChanged = true;
+            sentRegions.clear();
+            resendFirst = 0;
+            resendLast = INT_MAX;
+        } else if (edited) {
+            applyEdit(lineEdit);
+        }
+        tokenize(text, revision);
+    }
+
+    // States and definitions belong to this thread's repository.
+    checkpoints.clear();
+    tokenizer.reset();
+    repository.reset();
+}
+
+void HighlightWorker::applyEdit(const LineEdit &lineEdit) {
+    // The state at the start of the first changed line only depends on the lines above it.
+    auto changed = std::remove_if(checkpoints.begin(), checkpoints.end(), [&lineEdit](const Checkpoint &checkpoint) {
+        return checkpoint.line > lineEdit.first && checkpoint.line <= lineEdit.oldLast;
+    });
+    checkpoints.erase(changed, checkpoints.end());
+    for (Checkpoint &checkpoint : checkpoints) {
+        if (checkpoint.line > lineEdit.oldLast) {
+            checkpoint.line += lineEdit.delta;
+        }
+    }
+
+    cleanUntil = qMin(cleanUntil, lineEdit.first);
+    if (convergeAfter > lineEdit.oldLast) {
+        convergeAfter += lineEdit.delta;
+    }
+    convergeAfter = qMax(convergeAfter, lineEdit.oldLast + lineEdit.delta);
+
+    // Changed lines keep their old markers, so the pass can tell whether tokenizing them again changed
+    // them; lines removed from the end of the range drop theirs and lines added there start without any.
+    int first = lineEdit.first;
+    int oldLast = lineEdit.oldLast;
+    int newLast = oldLast + lineEdit.delta;
+    if (first < lineFolds.size()) {
+        int end = qMin(oldLast + 1, lineFolds.size());
+        if (lineEdit.delta < 0) {
+            int removed = qMax(newLast + 1, first);
+            for (int line = removed; line < end; ++line) {
+                foldsChanged = foldsChanged || !lineFolds[line].isEmpty();
+            }
+            lineFolds.remove(removed, qMax(0, end - removed));
+        } else if (lineEdit.delta > 0) {
+            lineFolds.insert(end, lineEdit.delta, QVector<FoldMarker>());
+        }
+    }
+
+    // The UI thread clamps the regions with a first or last line among the changed ones edit by edit, while
+    // this worker may see several edits merged into one: those regions are sent again after the pass.
+    bool clamped = false;
+    int clampedFirst = first;
+    sentRegions.visit(first, oldLast + 1, [&](const FoldRegion &region) {
+        if (region.start >= first || region.end <= oldLast) {
+            clamped = true;
+            clampedFirst = qMin(clampedFirst, region.start);
+        }
+    });
+    sentRegions.applyEdit(first, oldLast, lineEdit.delta);
+    if (resendFirst <= resendLast) {
+        resendFirst = resendFirst < first ? resendFirst : resendFirst > oldLast ? resendFirst + lineEdit.delta : first;
+        if (resendLast != INT_MAX) {
+            resendLast = resendLast < first ? resendLast : resendLast > oldLast ? resendLast + lineEdit.delta : newLast;
+        }
+    }
+    if (clamped) {
+        resendFirst = qMin(resendFirst, clampedFirst);
+        resendLast = qMax(resendLast, newLast);
+        foldsChanged = true;
+    }
+}
+
+void HighlightWorker::tokenize(const PieceTable &text, quint64 revision) {
+    if (cleanUntil == CleanToEnd) {
+        return;
+    }
+
+    auto start = std::upper_bound(checkpoints.begin(), checkpoints.end(), cleanUntil,
+                                  [](int line, const Checkpoint &checkpoint) { return line < checkpoint.line; }) - 1;
+    int startLine = start->line;
+    KSyntaxHighlighting::State state = start->state;
+
+    // Checkpoints are rebuilt while passing; old ones are kept to detect convergence.
+    QVector<Checkpoint> rebuilt(checkpoints.begin(), start + 1);
+    int old = static_cast<int>(start - checkpoints.begin()) + 1;
+
+    HighlightBatch batch;
+    batch.revision = revision;
+    batch.firstLine = startLine;
+    batch.styles = styles;
+
+    int line = startLine;
+    bool converged = false;
+    bool stopped = false;
+    auto processLine = [&](const QString &lineText) {
+        if (interrupted()) {
+            stopped = true;
+            return false;
+        }
+        if (line != startLine) {
+            while (old < checkpoints.size() && checkpoints[old].line < line) {
+                ++old;
+            }
+            bool hasOld = old < checkpoints.size() && checkpoints[old].line == line;
+            if (hasOld && line > convergeAfter && checkpoints[old].state == state) {
+                // Same state as before the edit: the following lines keep their formats.
+                converged = true;
+                return false;
+            }
+            if (hasOld || line % CheckpointInterval == 0) {
+                rebuilt.append(Checkpoint{line, state});
+            }
+        }
+
+        // Long lines are not laid out, so they are drawn without styles and keep the state they start with.
+        QVector<StyleRun> runs;
+        QVector<FoldMarker> folds;
+        if (lineText.size() <= LongLineLayout::Threshold) {
+            state = tokenizer->highlight(lineText, state, runs, folds);
+        }
+        if (line >= lineFolds.size()) {
+            lineFolds.resize(line + 1);
+        }
+        if (lineFolds[line] != folds) {
+            lineFolds[line] = folds;
+            foldsChanged = true;
+        }
+        batch.lines.append(runs);
+        ++line;
+
+        if (batch.lines.size() == BatchLines && !send(batch)) {
+            stopped = true;
+            return false;
+        }
+        return true;
+    };
+
+    qint64 offset = text.lineStartByte(startLine);
+    QByteArray pending;
+    bool more = true;
+    text.readBytes(offset, text.byteSize() - offset, [&](const char *data, qint64 size) {
+        const char *end = data + size;
+        while (data < end) {
+            const char *newline = LineIndex::findNewline(data, end);
+            pending.append(data, static_cast<int>(qMin<qint64>(newline - data, MaxLineBytes + 1 - pending.size())));
+            if (newline == end) {
+                break;
+            }
+            if (!processLine(QString::fromUtf8(pending))) {
+                more = false;
+                return false;
+            }
+            pending.clear();
+            data = newline + 1;
+        }
+        return true;
+    });
+    if (more) {
+        processLine(QString::fromUtf8(pending));
+    }
+
+    if (!stopped && !batch.lines.isEmpty() && !send(batch)) {
+        stopped = true;
+    }
+
+    if (stopped) {
+        // Lines from the first unsent one are stale, and so are checkpoints this pass already replaced.
+        while (old < checkpoints.size() && checkpoints[old].line <= line) {
+            ++old;
+        }
+        rebuilt.append(checkpoints.mid(old));
+        cleanUntil = batch.firstLine;
+        convergeAfter = qMax(convergeAfter, line);
+    } else {
+        if (converged) {
+            rebuilt.append(checkpoints.mid(old));
+        }
+        cleanUntil = CleanToEnd;
+        convergeAfter = -1;
+    }
+    checkpoints.swap(rebuilt);
+
+    if (!stopped) {
+        if (!converged && lineFolds.size() > line) {
+            lineFolds.resize(line);
+        }
+        if (foldsChanged) {
+            sendRegions(revision);
+        }
+    }
+}
+
+bool HighlightWorker::send(HighlightBatch &batch) {
+    while (!credits.tryAcquire(1, 20)) {
+        if (interrupted()) {
+            return false;
+        }
+    }
+
+    HighlightBatch next;
+    next.revision = batch.revision;
+    next.firstLine = batch.firstLine + batch.lines.size();
+    next.styles = batch.styles;
+    std::swap(batch, next);
+    QMetaObject::invokeMethod(this, [this, ready = std::move(next)]() {
+        emit batchReady(ready);
+    }, Qt::QueuedConnection);
+    return true;
+}
+
+void HighlightWorker::sendRegions(quint64 revision) {
+    foldsChanged = false;
+
+    // An end closes the latest open start with the same id, dropping starts left open inside it.
+    std::vector<FoldRegion> regions;
+    std::vector<std::pair<quint16, int>> open;
+    for (int line = 0; line < lineFolds.size(); ++line) {
+        for (const FoldMarker &marker : qAsConst(lineFolds[line])) {
+            if (marker.begin) {
+                open.emplace_back(marker.id, line);
+                continue;
+            }
+            for (int i = static_cast<int>(open.size()) - 1; i >= 0; --i) {
+                if (open[i].first == marker.id) {
+                    if (line > open[i].second) {
+                        regions.push_back(FoldRegion{open[i].second, line});
+                    }
+                    open.resize(i);
+                    break;
+                }
+            }
+        }
+    }
+
+    // Regions sharing a start line fold as the outermost one.
+    std::sort(regions.begin(), regions.end(), [](const FoldRegion &a, const FoldRegion &b) {
+        return a.start < b.start || (a.start == b.start && a.end > b.end);
+    });
+    regions.erase(std::unique(regions.begin(), regions.end(),
+                              [](const FoldRegion &a, const FoldRegion &b) { return a.start == b.start; }),
+                  regions.end());
+
+    // The UI thread has the regions sent before, moved with the edits since: both lists are sorted by start,
+    // so the regions that differ lie between their common head and tail.
+    std::vector<FoldRegion> previous;
+    previous.reserve(sentRegions.size());
+    sentRegions.visit(0, INT_MAX, [&previous](const FoldRegion &region) { previous.push_back(region); });
+    auto same = [](const FoldRegion &a, const FoldRegion &b) { return a.start == b.start && a.end == b.end; };
+    size_t head = 0;
+    while (head < regions.size() && head < previous.size() && same(regions[head], previous[head])) {
+        ++head;
+    }
+    size_t tail = 0;
+    while (head + tail < regions.size() && head + tail < previous.size() &&
+           same(regions[regions.size() - 1 - tail], previous[previous.size() - 1 - tail])) {
+        ++tail;
+    }
+
+    FoldUpdate update;
+    update.revision = revision;
+    update.first = resendFirst;
+    update.last = resendLast;
+    for (const std::vector<FoldRegion> *list : {&regions, &previous}) {
+        if (head + tail < list->size()) {
+            update.first = qMin(update.first, (*list)[head].start);
+            update.last = qMax(update.last, (*list)[list->size() - 1 - tail].start);
+        }
+    }
+    resendFirst = INT_MAX;
+    resendLast = -1;
+    sentRegions.assign(regions);
+    if (update.first > update.last) {
+        return;
+    }
+    update.last = qMin(update.last, lineFolds.size());
+
+    auto byStart = [](const FoldRegion &region, int line) { return region.start < line; };
+    auto from = std::lower_bound(regions.begin(), regions.end(), update.first, byStart);
+    auto to = std::lower_bound(from, regions.end(), update.last + 1, byStart);
+    update.regions.assign(from, to);
+
+    QMetaObject::invokeMethod(this, [this, update = std::move(update)]() {
+        emit regionsReady(update);
+    }, Qt::QueuedConnection);
+}
+
+bool HighlightWorker::interrupted() const {
+    return stopping || abortPass;
+}
@@ -0,0 +1,231 @@
+/**
+ * @file HighlightWorker.h
+ * @brief Background syntax tokenizer for the Coda text editor.
+ *        Runs KSyntaxHighlighting on a worker thread over PieceTable snapshots, keeps the highlighter
+ *        state every few lines so an edit only re-tokenizes from the nearest checkpoint, and hands the
+ *        resulting style runs to the UI thread in batches.
+ *        It also keeps the folding markers of every line and, after each pass that changed them, matches
+ *        them into fold regions and sends the UI thread the range of regions that differ from those it has.
+ * @author Dario Romandini
+ */
+
+#pragma once
+
+#include <QMutex>
+#include <QObject>
+#include <QSemaphore>
+#include <QString>
+#include <QVector>
+#include <QWaitCondition>
+#include <atomic>
+#include <climits>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <KSyntaxHighlighting/State>
+
+#include "FoldTree.h"
+#include "PieceTable.h"
+#include "StyleTable.h"
+
+namespace KSyntaxHighlighting {
+class Repository;
+}
+
+class LineTokenizer;
+
+/**
+ * @struct LineEdit
+ * @brief Lines touched by a document edit.
+ *        Lines first..oldLast of the old text became lines first..oldLast + delta of the new text;
+ *        lines after oldLast moved by delta.
+ */
+struct LineEdit {
+    int first = 0;   ///< First changed line.
+    int oldLast = 0; ///< Last changed line, in the text before the edit.
+    int delta = 0;   ///< Number of lines added (negative if removed).
+};
+
+/**
+ * @struct FoldMarker
+ * @brief Start or end of a folding region on a line, as reported by the syntax definition.
+ */
+struct FoldMarker {
+    quint16 id; ///< Region id; an end closes the latest open start with the same id.
+    bool begin; ///< True for a start, false for an end.
+
+    bool operator==(const FoldMarker &other) const {
+        return id == other.id && begin == other.begin;
+    }
+};
+
+/**
+ * @struct HighlightBatch
+ * @brief Style runs of consecutive lines, tokenized from one snapshot.
+ */
+struct HighlightBatch {
+    quint64 revision = 0;                  ///< Revision of the snapshot the lines belong to.
+    int firstLine = 0;                     ///< Line number of the first entry, in that snapshot.
+    QVector<QVector<StyleRun>> lines;      ///< Style runs of each line.
+    std::shared_ptr<StyleTable> styles;    ///< Table the style ids refer to.
+};
+
+/**
+ * @struct FoldUpdate
+ * @brief Fold regions starting on a range of lines, replacing the regions the UI thread has there.
+ */
+struct FoldUpdate {
+    quint64 revision = 0;            ///< Revision of the snapshot the regions belong to.
+    int first = 0;                   ///< First line of the range, in that snapshot.
+    int last = -1;                   ///< Last line of the range, in that snapshot.
+    std::vector<FoldRegion> regions; ///< Regions starting in the range, sorted by start, one per line at most.
+};
+
+/**
+ * @class HighlightWorker
+ * @brief Owns one worker thread with its own syntax repository (repositories are not thread-safe).
+ *        Runs do not depend on the theme; colours are resolved on the UI thread through the StyleTable.
+ *        The UI thread reports every edit; pending edits are merged, and a new request stops the
+ *        running pass at the next line. batchReady() is emitted on the worker object's thread, and
+ *        every batch must be acknowledged with batchConsumed() before more than a few are sent.
+ */
+class HighlightWorker : public QObject {
+    Q_OBJECT
+
+public:
+    /**
+     * @brief Constructor. Starts the worker thread.
+     * @param parent Optional parent object.
+     */
+    explicit HighlightWorker(QObject *parent = nullptr);
+
+    /**
+     * @brief Destructor. Stops the running pass and waits for the worker thread.
+     */
+    ~HighlightWorker() override;
+
+    /**
+     * @brief Drops all checkpoints and tokenizes the whole text.
+     * @param definition Name of the syntax definition, empty for none.
+     * @param text Snapshot of the text.
+     * @param revision Revision of the snapshot.
+     */
+    void restart(const QString &definition, const PieceTable &text, quint64 revision);
+
+    /**
+     * @brief Re-tokenizes the lines affected by an edit, until the state converges with the old one.
+     * @param text Snapshot of the text after the edit.
+     * @param revision Revision of the snapshot.
+     * @param lineEdit Lines touched by the edit.
+     */
+    void edit(const PieceTable &text, quint64 revision, const LineEdit &lineEdit);
+
+    /**
+     * @brief Acknowledges a batch, letting the worker send another one.
+     */
+    void batchConsumed();
+
+    /**
+     * @brief Combines two consecutive edits into one.
+     * @param earlier The edit applied first.
+     * @param later The edit applied second, in line numbers after the first edit.
+     * @return An edit with the same effect on line numbers as both.
+     */
+    static LineEdit merge(const LineEdit &earlier, const LineEdit &later);
+
+signals:
+    /**
+     * @brief Emitted for every batch of tokenized lines, in the order they were produced.
+     * @param batch The tokenized lines.
+     */
+    void batchReady(const HighlightBatch &batch);
+
+    /**
+     * @brief Emitted after a pass that changed fold regions, following its last batch.
+     * @param update The changed range of regions.
+     */
+    void regionsReady(const FoldUpdate &update);
+
+private:
+    static constexpr int CheckpointInterval = 64; ///< Lines between two saved highlighter states.
+    static constexpr int BatchLines = 512;        ///< Lines per batch sent to the UI thread.
+    static constexpr int MaxBatchesInFlight = 8;  ///< Batches the worker may queue ahead of the UI thread.
+    static constexpr int CleanToEnd = 0x7fffffff; ///< cleanUntil value when every line is up to date.
+
+    /**
+     * @struct Checkpoint
+     * @brief Highlighter state at the start of a line.
+     */
+    struct Checkpoint {
+        int line;                        ///< Line the state applies to.
+        KSyntaxHighlighting::State state; ///< State before tokenizing the line.
+    };
+
+    /**
+     * @brief Worker thread body: waits for requests and tokenizes.
+     */
+    void run();
+
+    /**
+     * @brief Shifts and drops checkpoints for an edit and marks the changed lines dirty.
+     * @param lineEdit Lines touched by the edit.
+     */
+    void applyEdit(const LineEdit &lineEdit);
+
+    /**
+     * @brief Tokenizes from the last clean checkpoint until the state converges or the text ends.
+     * @param text Snapshot to tokenize.
+     * @param revision Revision of the snapshot.
+     */
+    void tokenize(const PieceTable &text, quint64 revision);
+
+    /**
+     * @brief Hands a batch to the UI thread, waiting for a free slot.
+     * @param batch The batch to send; cleared afterwards.
+     * @return False if the pass was interrupted while waiting.
+     */
+    bool send(HighlightBatch &batch);
+
+    /**
+     * @brief Matches the folding markers of all lines into regions and hands the UI thread those that
+     *        differ from the regions sent before.
+     * @param revision Revision of the snapshot the markers belong to.
+     */
+    void sendRegions(quint64 revision);
+
+    /**
+     * @brief Returns whether the running pass should stop.
+     * @return True if a new request arrived or the worker is shutting down.
+     */
+    bool interrupted() const;
+
+    // Request state, guarded by mutex.
+    QMutex mutex;                      ///< Guards the request state.
+    QWaitCondition wake;               ///< Signals a new request or shutdown.
+    bool hasRequest = false;           ///< True if a request is waiting.
+    bool resetRequested = false;       ///< True if the waiting request drops all checkpoints.
+    bool hasEdit = false;              ///< True if pendingEdit holds edits not applied yet.
+    LineEdit pendingEdit;              ///< Merged edits since the worker last picked up a request.
+    PieceTable pendingText;            ///< Latest snapshot.
+    quint64 pendingRevision = 0;       ///< Revision of the latest snapshot.
+    QString definitionName;            ///< Syntax definition requested by the last restart.
+
+    std::atomic_bool stopping{false};  ///< Set to shut the worker down.
+    std::atomic_bool abortPass{false}; ///< Set when a new request supersedes the running pass.
+    QSemaphore credits{MaxBatchesInFlight}; ///< Limits how far the worker runs ahead of the UI thread.
+    std::shared_ptr<StyleTable> styles;     ///< Formats of the worker's repository, shared with the blocks.
+    std::thread worker;                ///< The worker thread.
+
+    // Worker-only state.
+    std::unique_ptr<KSyntaxHighlighting::Repository> repository; ///< Definitions of the worker thread.
+    std::unique_ptr<LineTokenizer> tokenizer;                    ///< Highlighter producing the style runs.
+    QVector<Checkpoint> checkpoints;   ///< Saved states, sorted by line; line 0 is always present.
+    int cleanUntil = 0;                ///< Lines before this one have up-to-date formats and checkpoints.
+    int convergeAfter = -1;            ///< A pass may stop at a matching checkpoint only after this line.
+    QVector<QVector<FoldMarker>> lineFolds; ///< Folding markers of every line, in order.
+    bool foldsChanged = false;         ///< True if markers changed since regions were last sent.
+    FoldTree sentRegions;              ///< Regions last sent, moved with the edits since.
+    int resendFirst = INT_MAX;         ///< First line whose regions are sent even if unchanged.
+    int resendLast = -1;               ///< Last line whose regions are sent even if unchanged.
+};
@@ -1,38 +1,40 @@
 /**
  * @file KSyntaxHighlightingAdapter.cpp
  * @brief Implementation of the KSyntaxHighlightingAdapter class for Coda. Bridges KSyntaxHighlighting and ISyntaxHighlighter interface for OCP compliance.
- *        Dynamically detects language based on file path using KDE's syntax definitions.
+ *        Dynamically detects language based on file path using the shared SyntaxRepository.
  *        Sets a default dark theme and allows theme changes at runtime.
  * @author Dario Romandini
  */
 
 #include "KSyntaxHighlightingAdapter.h"
-#include <QMimeDatabase>
-#include <QFileInfo>
+#include "HighlightScheduler.h"
+#include "LongLineLayout.h"
+#include <QTextLayout>
+#include "SyntaxRepository.h"
 #include <QDebug>
 
 KSyntaxHighlightingAdapter::KSyntaxHighlightingAdapter(QTextDocument *document)
     : KSyntaxHighlighting::SyntaxHighlighter(document) {
     // Set default theme to Breeze Dark
-    setTheme(repository.theme("Breeze Dark"));
+    setTheme(SyntaxRepository::instance().theme("Breeze Dark"));
 }
 
 void KSyntaxHighlightingAdapter::setFilePath(const QString &filePath) {
-    QMimeDatabase mimeDb;
-    QMimeType mime = mimeDb.mimeTypeForFile(filePath);
-
-    definition = repository.definitionForMimeType(mime.name());
-    if (!definition.isValid()) {
-        definition = repository.definitionForFileName(QFileInfo(filePath).fileName());
-    }
-
+    definition = SyntaxRepository::instance().definitionForFile(filePath);
     if (definition.isValid()) {
-        setDefinition(definition);
         languageId = definition.name();
     } else {
         qWarning() << "No syntax definition found for file:" << filePath;
         languageId = "";
     }
+
+    if (scheduler) {
+        // Skip SyntaxHighlighter's synchronous whole-document pass; the scheduler tokenizes in the background.
+        AbstractHighlighter::setDefinition(definition);
+        scheduler->restart();
+    } else {
+        setDefinition(definition);
+    }
 }
 
 QString KSyntaxHighlightingAdapter::language() const {
@@ -45,4 +47,47 @@ void KSyntaxHighlightingAdapter::attachToDocument(QTextDocument *document) {
 
 void KSyntaxHighlightingAdapter::setTheme(const KSyntaxHighlighting::Theme &theme) {
     SyntaxHighlighter::setTheme(theme);
+    if (scheduler) {
+        // Runs do not depend on the theme: only their colours are looked up again.
+        scheduler->themeChanged();
+    }
+}
+
+void KSyntaxHighlightingAdapter::setScheduler(HighlightScheduler *highlightScheduler) {
+    scheduler = highlightScheduler;
+}
+
+HighlightScheduler *KSyntaxHighlightingAdapter::getScheduler() const {
+    return scheduler;
+}
+
+void KSyntaxHighlightingAdapter::highlightBlock(const QString &text) {
+    if (!scheduler) {
+        // Long lines are not laid out; tokenizing them would stall the UI thread for nothing.
+        if (text.size() <= LongLineLayout::Threshold) {
+            SyntaxHighlighter::highlightBlock(text);
+        }
+        return;
+    }
+
+    // Tokenizing happens on the scheduler's worker; only draw the runs it produced for this block.
+    auto *data = dynamic_cast<HighlightBlockData *>(currentBlockUserData());
+    if (data) {
+        int start = 0;
+        for (const StyleRun &run : qAsConst(data->runs)) {
+            if (const QTextCharFormat *format = data->styles->charFormat(run.style, theme())) {
+                setFormat(start, run.length, *format);
+            }
+            start += run.length;
+        }
+        data->appliedTheme = scheduler->themeGeneration();
+        scheduler->blockHighlighted();
+        return;
+    }
+
+    // QSyntaxHighlighter clears formats that are not set again; keep what the block already has.
+    const QVector<QTextLayout::FormatRange> ranges = currentBlock().layout()->formats();
+    for (const QTextLayout::FormatRange &range : ranges) {
+        setFormat(range.start, range.length, range.format);
+    }
 }
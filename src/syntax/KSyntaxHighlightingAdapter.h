@@ -3,17 +3,19 @@
  * @brief Adapter for integrating KSyntaxHighlighting into Coda's OCP architecture via the ISyntaxHighlighter interface.
  *        Provides syntax highlighting for multiple languages based on KDE's syntax definition files.
  *        Dynamically detects language by file path and supports theme changes at runtime.
+ *        When a HighlightScheduler is attached, tokenizing runs on its worker thread and the adapter only applies the results.
  * @author Dario Romandini
  */
 
 #pragma once
 
 #include <KSyntaxHighlighting/SyntaxHighlighter>
-#include <KSyntaxHighlighting/Repository>
 #include <KSyntaxHighlighting/Definition>
 #include <KSyntaxHighlighting/Theme>
 #include "ISyntaxHighlighter.h"
 
+class HighlightScheduler;
+
 /**
  * @class KSyntaxHighlightingAdapter
  * @brief Adapts the KSyntaxHighlighting library to the ISyntaxHighlighter interface for use in Coda.
@@ -53,8 +55,27 @@ public:
      */
     void setTheme(const KSyntaxHighlighting::Theme &theme);
 
+    /**
+     * @brief Attaches the scheduler that tokenizes the document in the background.
+     * @param scheduler The scheduler, or nullptr to highlight every block synchronously.
+     */
+    void setScheduler(HighlightScheduler *scheduler);
+
+    /**
+     * @brief Returns the attached scheduler.
+     * @return Pointer to the HighlightScheduler, or nullptr.
+     */
+    HighlightScheduler *getScheduler() const;
+
+protected:
+    /**
+     * @brief Highlights a block, or with a scheduler applies the formats its worker produced for it.
+     * @param text The text of the block.
+     */
+    void highlightBlock(const QString &text) override;
+
 private:
-    KSyntaxHighlighting::Repository repository;    ///< Repository of syntax definitions.
     KSyntaxHighlighting::Definition definition;    ///< The syntax definition for the detected language.
     QString languageId;                            ///< The name of the detected language.
+    HighlightScheduler *scheduler = nullptr;       ///< Background highlighting scheduler, if attached.
 };
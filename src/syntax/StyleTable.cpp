@@ -0,0 +1,81 @@
+/**
+ * @file StyleTable.cpp
+ * @brief Implementation of the StyleTable class for Coda.
+ * @author Dario Romandini
+ */
+
+#include "StyleTable.h"
+#include <QMutexLocker>
+
+quint16 StyleTable::add(const KSyntaxHighlighting::Format &format) {
+    quint16 style = format.id();
+    if (style < registered.size() && registered[style]) {
+        return style;
+    }
+
+    QMutexLocker locker(&mutex);
+    if (style >= formats.size()) {
+        formats.resize(style + 1);
+    }
+    formats[style] = format;
+    if (style >= registered.size()) {
+        registered.resize(style + 1);
+    }
+    registered[style] = true;
+    return style;
+}
+
+const QTextCharFormat *StyleTable::charFormat(quint16 style, const KSyntaxHighlighting::Theme &theme) {
+    if (style == NoStyle) {
+        return nullptr;
+    }
+    if (theme.name() != themeName) {
+        themeName = theme.name();
+        charFormats.clear();
+        resolved.clear();
+    }
+    if (style >= resolved.size()) {
+        charFormats.resize(style + 1);
+        resolved.resize(style + 1);
+    }
+
+    if (resolved[style] == 0) {
+        KSyntaxHighlighting::Format format;
+        {
+            QMutexLocker locker(&mutex);
+            if (style < formats.size()) {
+                format = formats[style];
+            }
+        }
+        if (!format.isValid() || format.isDefaultTextStyle(theme)) {
+            resolved[style] = -1;
+        } else {
+            charFormats[style] = toCharFormat(format, theme);
+            resolved[style] = 1;
+        }
+    }
+    return resolved[style] > 0 ? &charFormats[style] : nullptr;
+}
+
+QTextCharFormat StyleTable::toCharFormat(const KSyntaxHighlighting::Format &format, const KSyntaxHighlighting::Theme &theme) {
+    QTextCharFormat charFormat;
+    if (format.hasTextColor(theme)) {
+        charFormat.setForeground(format.textColor(theme));
+    }
+    if (format.hasBackgroundColor(theme)) {
+        charFormat.setBackground(format.backgroundColor(theme));
+    }
+    if (format.isBold(theme)) {
+        charFormat.setFontWeight(QFont::Bold);
+    }
+    if (format.isItalic(theme)) {
+        charFormat.setFontItalic(true);
+    }
+    if (format.isUnderline(theme)) {
+        charFormat.setFontUnderline(true);
+    }
+    if (format.isStrikeThrough(theme)) {
+        charFormat.setFontStrikeOut(true);
+    }
+    return charFormat;
+}
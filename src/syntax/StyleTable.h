@@ -0,0 +1,68 @@
+/**
+ * @file StyleTable.h
+ * @brief Style table shared between a syntax tokenizer thread and the UI thread in Coda.
+ *        Tokenized text is stored as runs of style ids; the table maps each id to its syntax format and,
+ *        per theme, to the QTextCharFormat drawn on screen, so changing the theme only rebuilds the table.
+ * @author Dario Romandini
+ */
+
+#pragma once
+
+#include <KSyntaxHighlighting/Format>
+#include <KSyntaxHighlighting/Theme>
+#include <QMutex>
+#include <QString>
+#include <QTextCharFormat>
+#include <QVector>
+
+/**
+ * @struct StyleRun
+ * @brief A stretch of a line drawn with one style.
+ */
+struct StyleRun {
+    quint16 style;  ///< Style id, or StyleTable::NoStyle for unformatted text.
+    quint16 length; ///< Length of the run in UTF-16 units.
+};
+
+/**
+ * @class StyleTable
+ * @brief Style ids are the Format ids of one KSyntaxHighlighting repository. The tokenizer registers
+ *        formats as it meets them; the UI thread resolves ids to character formats for a theme.
+ *        Blocks keep a reference to the table their runs belong to, so they can be drawn by any highlighter.
+ */
+class StyleTable {
+public:
+    static constexpr quint16 NoStyle = 0xffff; ///< Style id of text without a format.
+
+    /**
+     * @brief Registers a format. May be called from the tokenizer thread.
+     * @param format The syntax format.
+     * @return The style id of the format.
+     */
+    quint16 add(const KSyntaxHighlighting::Format &format);
+
+    /**
+     * @brief Returns the character format of a style in a theme. UI thread only.
+     * @param style The style id.
+     * @param theme The theme to draw with.
+     * @return The character format, or nullptr if the style is drawn as default text.
+     */
+    const QTextCharFormat *charFormat(quint16 style, const KSyntaxHighlighting::Theme &theme);
+
+private:
+    /**
+     * @brief Converts a syntax format to a character format, as SyntaxHighlighter does.
+     * @param format The syntax format.
+     * @param theme The theme to draw with.
+     * @return The character format.
+     */
+    static QTextCharFormat toCharFormat(const KSyntaxHighlighting::Format &format, const KSyntaxHighlighting::Theme &theme);
+
+    QMutex mutex;                                  ///< Guards formats.
+    QVector<KSyntaxHighlighting::Format> formats;  ///< Registered formats by style id.
+    QVector<bool> registered;                      ///< Tokenizer-side record of registered ids, read without locking.
+
+    QString themeName;                             ///< Theme the character formats were built for.
+    QVector<QTextCharFormat> charFormats;          ///< Character formats by style id.
+    QVector<qint8> resolved;                       ///< Per style id: 0 not built yet, 1 formatted, -1 default text.
+};
@@ -0,0 +1,177 @@
+/**
+ * @file SyntaxRepository.cpp
+ * @brief Implementation of the SyntaxRepository class for Coda.
+ * @author Dario Romandini
+ */
+
+#include "SyntaxRepository.h"
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMimeDatabase>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QTimer>
+#include <ksyntaxhighlighting_version.h>
+
+SyntaxRepository &SyntaxRepository::instance() {
+    static SyntaxRepository repository;
+    return repository;
+}
+
+SyntaxRepository::SyntaxRepository()
+    : cachePath(QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/syntax-definitions.json") {
+    // A pending write would be lost: its timer does not fire once the event loop has stopped.
+    if (QCoreApplication::instance()) {
+        QObject::connect(QCoreApplication::instance(), &QCoreApplication::aboutToQuit, [this] {
+            if (cacheDirty) {
+                saveCache();
+            }
+        });
+    }
+}
+
+KSyntaxHighlighting::Repository &SyntaxRepository::repository() {
+    if (!syntaxRepository) {
+        syntaxRepository = std::make_unique<KSyntaxHighlighting::Repository>();
+    }
+    return *syntaxRepository;
+}
+
+KSyntaxHighlighting::Definition SyntaxRepository::definitionForFile(const QString &filePath) {
+    if (!cacheLoaded) {
+        loadCache();
+    }
+
+    QString key = cacheKey(filePath);
+    auto cached = definitionNames.constFind(key);
+    if (cached != definitionNames.constEnd()) {
+        if (cached->isEmpty()) {
+            return KSyntaxHighlighting::Definition();
+        }
+        KSyntaxHighlighting::Definition definition = repository().definitionForName(*cached);
+        if (definition.isValid()) {
+            return definition;
+        }
+    }
+
+    QMimeDatabase mimeDb;
+    QMimeType mime = mimeDb.mimeTypeForFile(filePath);
+    KSyntaxHighlighting::Definition definition = repository().definitionForMimeType(mime.name());
+    if (!definition.isValid()) {
+        definition = repository().definitionForFileName(QFileInfo(filePath).fileName());
+    }
+
+    definitionNames.insert(key, definition.isValid() ? definition.name() : QString());
+    scheduleSave();
+    return definition;
+}
+
+KSyntaxHighlighting::Theme SyntaxRepository::theme(const QString &name) {
+    auto cached = themes.constFind(name);
+    if (cached != themes.constEnd()) {
+        return *cached;
+    }
+
+    KSyntaxHighlighting::Theme result = repository().theme(name);
+    themes.insert(name, result);
+    return result;
+}
+
+QString SyntaxRepository::cacheKey(const QString &filePath) {
+    QFileInfo info(filePath);
+    QString suffix = info.suffix().toLower();
+    return suffix.isEmpty() ? "name:" + info.fileName() : "ext:" + suffix;
+}
+
+QString SyntaxRepository::fingerprint() {
+    // Definitions built into the library change only with its version; installed ones are files in the
+    // search paths, and any edit, addition or removal changes the listing.
+    QStringList entries{QStringLiteral(KSYNTAXHIGHLIGHTING_VERSION_STRING)};
+    const QStringList paths = QStandardPaths::locateAll(QStandardPaths::GenericDataLocation,
+                                                        QStringLiteral("org.kde.syntax-highlighting/syntax"),
+                                                        QStandardPaths::LocateDirectory);
+    for (const QString &path : paths) {
+        entries << path;
+        const QFileInfoList files = QDir(path).entryInfoList(QDir::Files, QDir::Name);
+        for (const QFileInfo &file : files) {
+            entries << QString("%1:%2:%3")
+                           .arg(file.fileName())
+                           .arg(file.size())
+                           .arg(file.lastModified().toMSecsSinceEpoch());
+        }
+    }
+    QByteArray listing = entries.join('\n').toUtf8();
+    return QString::fromLatin1(QCryptographicHash::hash(listing, QCryptographicHash::Sha1).toHex());
+}
+
+void SyntaxRepository::loadCache() {
+    cacheLoaded = true;
+    definitionsFingerprint = fingerprint();
+
+    QFile file(cachePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return;
+    }
+
+    QJsonParseError parseError;
+    QJsonDocument doc = QJsonDocument::fromJson(file.readAll(), &parseError);
+    if (parseError.error != QJsonParseError::NoError || !doc.isObject()) {
+        qWarning() << "Ignoring invalid syntax cache:" << cachePath;
+        return;
+    }
+
+    QJsonObject root = doc.object();
+    if (root.value("version").toInt() != CacheVersion || root.value("fingerprint").toString() != definitionsFingerprint) {
+        return;
+    }
+
+    QJsonObject definitions = root.value("definitions").toObject();
+    for (auto it = definitions.constBegin(); it != definitions.constEnd(); ++it) {
+        definitionNames.insert(it.key(), it.value().toString());
+    }
+}
+
+void SyntaxRepository::scheduleSave() {
+    cacheDirty = true;
+    if (!QCoreApplication::instance()) {
+        saveCache();
+        return;
+    }
+    if (saveScheduled) {
+        return;
+    }
+    saveScheduled = true;
+    QTimer::singleShot(SaveDelayMs, QCoreApplication::instance(), [this] {
+        saveScheduled = false;
+        if (cacheDirty) {
+            saveCache();
+        }
+    });
+}
+
+void SyntaxRepository::saveCache() {
+    cacheDirty = false;
+
+    QJsonObject definitions;
+    for (auto it = definitionNames.constBegin(); it != definitionNames.constEnd(); ++it) {
+        definitions.insert(it.key(), it.value());
+    }
+
+    QJsonObject root;
+    root.insert("version", CacheVersion);
+    root.insert("fingerprint", definitionsFingerprint);
+    root.insert("definitions", definitions);
+
+    QDir().mkpath(QFileInfo(cachePath).absolutePath());
+    QSaveFile file(cachePath);
+    if (!file.open(QIODevice::WriteOnly) || file.write(QJsonDocument(root).toJson()) < 0 || !file.commit()) {
+        qWarning() << "Could not write syntax cache:" << cachePath;
+    }
+}
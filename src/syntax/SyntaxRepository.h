@@ -0,0 +1,103 @@
+/**
+ * @file SyntaxRepository.h
+ * @brief Process-wide syntax definition and theme service for the Coda text editor.
+ *        Owns the single KSyntaxHighlighting::Repository of the UI thread, created on first use, and
+ *        remembers which definition each file extension resolved to in a cache file, so opening a file
+ *        or switching themes does not rescan the definitions or query the MIME database again.
+ * @author Dario Romandini
+ */
+
+#pragma once
+
+#include <KSyntaxHighlighting/Definition>
+#include <KSyntaxHighlighting/Repository>
+#include <KSyntaxHighlighting/Theme>
+#include <QHash>
+#include <QString>
+#include <memory>
+
+/**
+ * @class SyntaxRepository
+ * @brief Lazily initialized singleton around KSyntaxHighlighting::Repository.
+ *        Repositories are not thread-safe: use it from the UI thread only. Worker threads need their own.
+ */
+class SyntaxRepository {
+public:
+    /**
+     * @brief Returns the shared instance.
+     * @return The process-wide SyntaxRepository.
+     */
+    static SyntaxRepository &instance();
+
+    SyntaxRepository(const SyntaxRepository &) = delete;
+    SyntaxRepository &operator=(const SyntaxRepository &) = delete;
+
+    /**
+     * @brief Returns the underlying repository, loading it on first use.
+     * @return Reference to the repository.
+     */
+    KSyntaxHighlighting::Repository &repository();
+
+    /**
+     * @brief Finds the syntax definition for a file, using the cache when possible.
+     * @param filePath Path of the file.
+     * @return The definition, invalid if no definition matches the file.
+     */
+    KSyntaxHighlighting::Definition definitionForFile(const QString &filePath);
+
+    /**
+     * @brief Returns a theme by name.
+     * @param name Name of the theme, e.g. "Breeze Dark".
+     * @return The theme, invalid if there is none with that name.
+     */
+    KSyntaxHighlighting::Theme theme(const QString &name);
+
+private:
+    static constexpr int CacheVersion = 2;   ///< Format version of the cache file.
+    static constexpr int SaveDelayMs = 2000; ///< Delay that batches cache updates into one write.
+
+    /**
+     * @brief Private constructor; use instance().
+     */
+    SyntaxRepository();
+
+    /**
+     * @brief Returns the cache key of a file: its lower-case suffix, or its name if it has none.
+     * @param filePath Path of the file.
+     * @return The cache key.
+     */
+    static QString cacheKey(const QString &filePath);
+
+    /**
+     * @brief Returns a fingerprint of the installed definitions; a different one invalidates the cache.
+     *        Only the search paths are listed, so the definitions themselves are not loaded.
+     * @return Hash of the library version and the name, size and modification time of every file in the
+     *         definition search paths.
+     */
+    static QString fingerprint();
+
+    /**
+     * @brief Reads the cache file, if it exists and matches the installed definitions.
+     */
+    void loadCache();
+
+    /**
+     * @brief Writes the cache file SaveDelayMs after the first unsaved change, so a burst of lookups is
+     *        written once, or when the application quits.
+     */
+    void scheduleSave();
+
+    /**
+     * @brief Writes the cache file.
+     */
+    void saveCache();
+
+    std::unique_ptr<KSyntaxHighlighting::Repository> syntaxRepository; ///< Created on first use.
+    QHash<QString, QString> definitionNames;                 ///< Definition name by cache key; empty for none.
+    QHash<QString, KSyntaxHighlighting::Theme> themes;       ///< Themes looked up so far, by name.
+    QString cachePath;                                       ///< Location of the cache file.
+    QString definitionsFingerprint;                          ///< Fingerprint of the installed definitions.
+    bool cacheLoaded = false;                                ///< True once loadCache() has run.
+    bool cacheDirty = false;                                 ///< True if the cache file is behind definitionNames.
+    bool saveScheduled = false;                              ///< True while a write is pending.
+};